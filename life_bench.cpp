@@ -0,0 +1,466 @@
+// Benchmarks for the engines: stepping, frame copies, population reads,
+// random fills, soup searches and file I/O over fixed, seeded workloads.
+// Results are printed as a table and can be written as JSON and compared
+// against an earlier run, failing when anything got slower than a threshold
+// allows, and always failing when a stepping or frame loop allocates.
+// Builds against life_engine.cpp only, without wxWidgets.
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <new>
+
+#include "life_engine.h"
+
+// ---------------- Allocation Counting ----------------
+// Every heap allocation in the process goes through these, so a benchmark
+// can report how many its loop made. Stepping, frame copies and stamps
+// should make none once the engine has sized its buffers, and life_bench
+// fails when any of them does.
+static std::atomic<uint64_t> g_allocations{0};
+
+static void* CountedAlloc(size_t size, size_t align) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    void* p = align > alignof(std::max_align_t) ? std::aligned_alloc(align, (size + align - 1) / align * align)
+                                                : std::malloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size) { return CountedAlloc(size, 0); }
+void* operator new[](size_t size) { return CountedAlloc(size, 0); }
+void* operator new(size_t size, std::align_val_t align) { return CountedAlloc(size, (size_t)align); }
+void* operator new[](size_t size, std::align_val_t align) { return CountedAlloc(size, (size_t)align); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+// Allocations made by body(), per call of it.
+template <typename Body>
+static double AllocationsPer(int calls, Body body) {
+    const uint64_t before = g_allocations.load();
+    body();
+    return (double)(g_allocations.load() - before) / calls;
+}
+
+// ---------------- Results ----------------
+// Every benchmark reports one 'rate' (higher is better), which is what the
+// baseline comparison looks at, plus whatever else describes it.
+struct BenchResult {
+    std::string name;
+    double rate = 0;
+    std::string unit;
+    std::vector<std::pair<std::string, double>> metrics;
+};
+
+struct BenchOptions {
+    std::string filter;       // run only benchmarks whose name contains this
+    std::string outPath;
+    std::string baselinePath;
+    double threshold = 10;    // percent slower than the baseline that fails
+    int threads = 0;
+    unsigned seed = 1;
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double SecondsSince(Clock::time_point t0) {
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+// Times body() after setup(), repeating both until at least kRuns runs and
+// kMinSeconds of timed work are done, and returns the fastest run. The
+// fastest run is far more stable from one invocation to the next than the
+// mean, which picks up whatever else the machine was doing.
+static const int kRuns = 3;
+static const double kMinSeconds = 0.3;
+
+template <typename Setup, typename Body>
+static double BestTime(Setup setup, Body body) {
+    double best = 1e30, total = 0;
+    for (int run = 0; run < kRuns || total < kMinSeconds; ++run) {
+        setup();
+        Clock::time_point t0 = Clock::now();
+        body();
+        const double s = SecondsSince(t0);
+        best = std::min(best, s);
+        total += s;
+    }
+    return best;
+}
+
+// A w x h board filled to 'percent' from a fixed seed, so every run steps
+// the same cells.
+static void SeedUniverse(Universe& u, int w, int h, int percent, unsigned seed) {
+    u.Resize(w, h);
+    u.Randomize(percent / 100.0, seed, 0, 0, w, h);
+}
+
+// ---------------- Benchmarks ----------------
+// Generations per run are scaled to the board so each takes a similar time.
+static int GenerationsFor(int w, int h) {
+    const int64_t cells = (int64_t)w * h;
+    return (int)std::max<int64_t>(20, std::min<int64_t>(5000, 2000000000LL / cells));
+}
+
+// With 'history', past generations are recorded as the board steps; a
+// non-empty 'rule' replaces B3/S23 and is appended to the name.
+static BenchResult BenchStep(const BenchOptions& opt, const std::string& boundary, int w, int h, int percent,
+                             bool history=false, const std::string& rule="") {
+    Universe u;
+    u.SetThreadCount(opt.threads);
+    Boundary edges;
+    if (ParseBoundary(boundary, edges)) u.SetBoundary(edges);
+    u.SetHistoryMemory(history ? 256 : 0);
+    LifeRule parsed;
+    if (!rule.empty() && LifeRule::Parse(rule, parsed)) u.SetRule(parsed);
+    const int gens = GenerationsFor(w, h);
+    const double s = BestTime([&]{ SeedUniverse(u, w, h, percent, opt.seed); },
+                              [&]{ for (int i = 0; i < gens; ++i) u.Step(); });
+    const double updates = (double)w * h * gens;
+    const uint64_t population = u.Population();
+    // the same run again from the same soup, after the timed runs have
+    // sized everything it needs
+    SeedUniverse(u, w, h, percent, opt.seed);
+    const double allocs = AllocationsPer(gens, [&]{ for (int i = 0; i < gens; ++i) u.Step(); });
+
+    BenchResult r;
+    r.name = "step/" + boundary + "/" + std::to_string(w) + "x" + std::to_string(h) + "/" + std::to_string(percent) + "%";
+    if (history) r.name += "/history";
+    if (!rule.empty()) r.name += "/" + rule;
+    r.rate = updates / s;
+    r.unit = "cells/s";
+    r.metrics = { {"generations", (double)gens}, {"gen_per_s", gens / s},
+                  {"cell_updates_per_s", updates / s}, {"ns_per_cell", s * 1e9 / updates},
+                  {"population", (double)population},
+                  // kept checkpoints are the history's storage, so those are
+                  // reported but not held against the step
+                  {history ? "history_allocs_per_step" : "allocs_per_step", allocs} };
+    return r;
+}
+
+// The engine's share of a repaint: copying a window-sized view out, at one
+// pixel per cell and zoomed out to 8x8 blocks per pixel.
+static BenchResult BenchFrame(const BenchOptions& opt, int w, int h, int shift) {
+    Universe u;
+    u.SetThreadCount(opt.threads);
+    SeedUniverse(u, w, h, 25, opt.seed);
+    ViewWindow v;
+    v.w = 1280; v.h = 800; v.shift = shift;
+    UniverseSnapshot frame;
+    const int frames = 16;
+    const double s = BestTime([]{}, [&]{ for (int i = 0; i < frames; ++i) u.Engine().CopyView(frame, v); });
+
+    BenchResult r;
+    r.name = "frame/" + std::to_string(w) + "x" + std::to_string(h) + "/1:" + std::to_string(1 << shift);
+    r.rate = frames / s;
+    r.unit = "frames/s";
+    r.metrics = { {"us_per_frame", s * 1e6 / frames},
+                  {"allocs_per_frame", AllocationsPer(frames, [&]{ for (int i = 0; i < frames; ++i) u.Engine().CopyView(frame, v); })} };
+    return r;
+}
+
+static BenchResult BenchPopulation(const BenchOptions& opt, int w, int h) {
+    Universe u;
+    SeedUniverse(u, w, h, 25, opt.seed);
+    volatile uint64_t sink = 0;
+    const int calls = 1000000;
+    const double s = BestTime([]{}, [&]{ for (int i = 0; i < calls; ++i) sink = sink + u.Population(); });
+
+    BenchResult r;
+    r.name = "population/" + std::to_string(w) + "x" + std::to_string(h);
+    r.rate = calls / s;
+    r.unit = "calls/s";
+    r.metrics = { {"ns_per_call", s * 1e9 / calls} };
+    return r;
+}
+
+// Filling a board with a random soup, as a soup search does before every
+// run.
+static BenchResult BenchRandomize(const BenchOptions& opt, int w, int h, int percent) {
+    Universe u;
+    u.SetThreadCount(opt.threads);
+    u.Resize(w, h);
+    unsigned seed = opt.seed;
+    const double s = BestTime([]{}, [&]{ u.Randomize(percent / 100.0, seed++, 0, 0, w, h); });
+
+    BenchResult r;
+    r.name = "randomize/" + std::to_string(w) + "x" + std::to_string(h) + "/" + std::to_string(percent) + "%";
+    r.rate = (double)w * h / s;
+    r.unit = "cells/s";
+    r.metrics = { {"ms_per_fill", s * 1e3}, {"ns_per_cell", s * 1e9 / ((double)w * h)} };
+    return r;
+}
+
+// A soup search: 'count' side x side soups run until they settle.
+static BenchResult BenchSoups(const BenchOptions& opt, int side, uint64_t count) {
+    SoupSearchOptions options;
+    options.soupSide = side;
+    options.seed = opt.seed;
+    SoupSearch search;
+    search.SetOptions(options);
+    WorkerPool pool(opt.threads);
+    std::vector<SoupResult> results;
+    const double s = BestTime([]{}, [&]{ search.Run(count, results, &pool); });
+    uint64_t generations = 0;
+    for (const SoupResult& r : results) generations += r.lifetime;
+
+    BenchResult r;
+    r.name = "soups/" + std::to_string(side) + "x" + std::to_string(side);
+    r.rate = count / s;
+    r.unit = "soups/s";
+    r.metrics = { {"soups", (double)count}, {"mean_lifetime", (double)generations / count},
+                  {"soup_gen_per_s", generations / s} };
+    return r;
+}
+
+// Stamping a library-sized pattern, 200x200 at 25% (about 10k cells), into
+// a large board with XOR, so every stamp changes the words it touches.
+static BenchResult BenchStamp(const BenchOptions& opt, int w, int h) {
+    Universe pattern;
+    SeedUniverse(pattern, 200, 200, 25, opt.seed);
+    UniverseSnapshot cells;
+    pattern.Engine().CopyTo(cells, 0, 0, 200, 200);
+    Universe u;
+    u.SetHistoryMemory(0);
+    SeedUniverse(u, w, h, 25, opt.seed);
+    const int stamps = 256;
+    auto run = [&]{
+        for (int i = 0; i < stamps; ++i) u.Stamp(cells, (i * 977) % (w - 200), (i * 613) % (h - 200), PasteMode::Xor);
+    };
+    const double s = BestTime([]{}, run);
+
+    BenchResult r;
+    r.name = "stamp/" + std::to_string(w) + "x" + std::to_string(h) + "/200x200";
+    r.rate = stamps / s;
+    r.unit = "stamps/s";
+    r.metrics = { {"us_per_stamp", s * 1e6 / stamps}, {"pattern_cells", (double)pattern.Population()},
+                  {"allocs_per_stamp", AllocationsPer(stamps, run)} };
+    return r;
+}
+
+static long long FileSize(const std::string& path) {
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return 0;
+    std::fseek(f, 0, SEEK_END);
+    long long n = std::ftell(f);
+    std::fclose(f);
+    return n;
+}
+
+// Saves and reloads a board in one format. The rate is cells per second over
+// the save and the load together, so formats of different density compare.
+static BenchResult BenchFile(const BenchOptions& opt, const std::string& ext, int w, int h) {
+    Universe u;
+    SeedUniverse(u, w, h, 25, opt.seed);
+    const std::string path = "life_bench_tmp." + ext;
+    bool saved = true, loaded = true;
+    Universe in;
+    const double save = BestTime([]{}, [&]{ saved = u.Save(path) && saved; });
+    const double load = BestTime([]{}, [&]{ loaded = in.Load(path) && loaded; });
+    const long long bytes = FileSize(path);
+    std::remove(path.c_str());
+
+    BenchResult r;
+    r.name = "file/" + ext + "/" + std::to_string(w) + "x" + std::to_string(h);
+    const bool ok = saved && loaded && in.Population() == u.Population();
+    r.rate = ok ? (double)w * h / (save + load) : 0;
+    r.unit = "cells/s";
+    r.metrics = { {"save_ms", save * 1e3}, {"load_ms", load * 1e3}, {"bytes", (double)bytes},
+                  {"save_mb_per_s", bytes / save / 1048576.0}, {"load_mb_per_s", bytes / load / 1048576.0} };
+    return r;
+}
+
+// Allocation counts are reported as metrics named allocs_per_<call>.
+static bool Allocates(const BenchResult& r) {
+    for (const auto& m : r.metrics)
+        if (m.first.compare(0, 11, "allocs_per_") == 0 && m.second > 0) return true;
+    return false;
+}
+
+// ---------------- JSON ----------------
+// One result per line, so the reader below only has to understand what the
+// writer produces.
+static bool WriteResults(const std::string& path, const std::vector<BenchResult>& results) {
+    std::FILE* f = std::fopen(path.c_str(), "w");
+    if (!f) return false;
+    std::fputs("[\n", f);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        std::fprintf(f, "{\"name\":\"%s\",\"rate\":%.6g,\"unit\":\"%s\"", r.name.c_str(), r.rate, r.unit.c_str());
+        for (const auto& m : r.metrics) std::fprintf(f, ",\"%s\":%.6g", m.first.c_str(), m.second);
+        std::fputs(i + 1 < results.size() ? "},\n" : "}\n", f);
+    }
+    std::fputs("]\n", f);
+    return std::fclose(f) == 0;
+}
+
+static bool ReadResults(const std::string& path, std::vector<BenchResult>& results) {
+    std::FILE* f = std::fopen(path.c_str(), "r");
+    if (!f) return false;
+    char line[4096];
+    while (std::fgets(line, sizeof line, f)) {
+        const char* name = std::strstr(line, "\"name\":\"");
+        const char* rate = std::strstr(line, "\"rate\":");
+        if (!name || !rate) continue;
+        name += 8;
+        const char* end = std::strchr(name, '"');
+        if (!end) continue;
+        BenchResult r;
+        r.name.assign(name, end);
+        r.rate = std::strtod(rate + 7, nullptr);
+        results.push_back(r);
+    }
+    std::fclose(f);
+    return true;
+}
+
+// Prints every benchmark that is slower than the baseline by more than the
+// threshold; returns how many there were.
+static int CompareResults(const std::vector<BenchResult>& results, const std::vector<BenchResult>& baseline, double threshold) {
+    int regressions = 0;
+    for (const BenchResult& r : results) {
+        for (const BenchResult& b : baseline) {
+            if (b.name != r.name || b.rate <= 0) continue;
+            const double change = (r.rate / b.rate - 1) * 100;
+            const bool regressed = change < -threshold;
+            if (regressed) ++regressions;
+            std::printf("%-40s %+7.1f%%%s\n", r.name.c_str(), change, regressed ? "  REGRESSION" : "");
+        }
+    }
+    return regressions;
+}
+
+// ---------------- Main ----------------
+static void Usage() {
+    std::fprintf(stderr,
+        "usage: life_bench [options]\n"
+        "  --filter <text>     run only benchmarks whose name contains text\n"
+        "  -t <threads>        stepping threads, 0 = one per CPU (default 0)\n"
+        "  --seed <n>          seed for the random boards (default 1)\n"
+        "  -o <file>           write the results as JSON\n"
+        "  --baseline <file>   compare against results written earlier with -o\n"
+        "  --threshold <pct>   fail when a rate drops by more than this (default 10)\n");
+}
+
+static bool ParseArgs(int argc, char** argv, BenchOptions& opt) {
+    for (int i = 1; i < argc; ++i) {
+        const char* a = argv[i];
+        if (i + 1 >= argc) return false; // every option takes a value
+        const char* v = argv[++i];
+        if (!std::strcmp(a, "--filter")) opt.filter = v;
+        else if (!std::strcmp(a, "-t")) opt.threads = std::atoi(v);
+        else if (!std::strcmp(a, "--seed")) opt.seed = (unsigned)std::strtoul(v, nullptr, 10);
+        else if (!std::strcmp(a, "-o")) opt.outPath = v;
+        else if (!std::strcmp(a, "--baseline")) opt.baselinePath = v;
+        else if (!std::strcmp(a, "--threshold")) opt.threshold = std::atof(v);
+        else return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions opt;
+    if (!ParseArgs(argc, argv, opt)) {
+        Usage();
+        return 2;
+    }
+
+    // names are built the same way the benchmarks build them, so the filter
+    // can skip a benchmark before paying for its setup
+    std::vector<std::pair<std::string, std::function<BenchResult()>>> suite;
+    const int sizes[][2] = { {50, 30}, {512, 512}, {2048, 2048}, {8192, 8192} };
+    for (const char* boundary : {"Finite", "Toroidal"})
+        for (const auto& sz : sizes)
+            for (int percent : {5, 25, 50}) {
+                std::string name = std::string("step/") + boundary + "/" + std::to_string(sz[0]) + "x" + std::to_string(sz[1]) + "/" + std::to_string(percent) + "%";
+                suite.emplace_back(name, [&opt, boundary, sz, percent]{ return BenchStep(opt, boundary, sz[0], sz[1], percent); });
+            }
+    // the other edges only differ at the first and last row and word
+    for (const char* boundary : {"KleinBottle", "Mirror"})
+        for (int side : {512, 2048}) {
+            std::string name = std::string("step/") + boundary + "/" + std::to_string(side) + "x" + std::to_string(side) + "/25%";
+            suite.emplace_back(name, [&opt, boundary, side]{ return BenchStep(opt, boundary, side, side, 25); });
+        }
+    for (const auto& sz : sizes) {
+        if (sz[0] < 2048) continue;
+        std::string name = "step/Toroidal/" + std::to_string(sz[0]) + "x" + std::to_string(sz[1]) + "/25%/history";
+        suite.emplace_back(name, [&opt, sz]{ return BenchStep(opt, "Toroidal", sz[0], sz[1], 25, true); });
+    }
+    // the multi-state engine: Brian's Brain, a 100-state Generations rule and
+    // Bosco's Rule, whose radius 5 neighbourhood costs no more than radius 1
+    for (const char* rule : {"B2/S/C3", "B3/S23/C100", "R5,C0,M1,S34..58,B34..45,NM"}) {
+        std::string name = std::string("step/Toroidal/2048x2048/25%/") + rule;
+        suite.emplace_back(name, [&opt, rule]{ return BenchStep(opt, "Toroidal", 2048, 2048, 25, false, rule); });
+    }
+    // a two-state Larger than Life rule keeps 8 cells a byte, so a width that
+    // is not a multiple of 8 steps a part-filled last byte on every row
+    suite.emplace_back("step/Finite/2045x2045/25%/R2,C0,M1,S2..4,B3..3,NM",
+                       [&opt]{ return BenchStep(opt, "Finite", 2045, 2045, 25, false, "R2,C0,M1,S2..4,B3..3,NM"); });
+    for (const auto& sz : sizes)
+        for (int shift : {0, 3}) {
+            std::string name = "frame/" + std::to_string(sz[0]) + "x" + std::to_string(sz[1]) + "/1:" + std::to_string(1 << shift);
+            suite.emplace_back(name, [&opt, sz, shift]{ return BenchFrame(opt, sz[0], sz[1], shift); });
+        }
+    suite.emplace_back("population/2048x2048", [&opt]{ return BenchPopulation(opt, 2048, 2048); });
+    for (int percent : {25, 30, 50}) {
+        std::string name = "randomize/8192x8192/" + std::to_string(percent) + "%";
+        suite.emplace_back(name, [&opt, percent]{ return BenchRandomize(opt, 8192, 8192, percent); });
+    }
+    suite.emplace_back("soups/16x16", [&opt]{ return BenchSoups(opt, 16, 1024); });
+    suite.emplace_back("soups/32x32", [&opt]{ return BenchSoups(opt, 32, 256); });
+    suite.emplace_back("stamp/4096x4096/200x200", [&opt]{ return BenchStamp(opt, 4096, 4096); });
+    for (const char* ext : {"txt", "rle", "cells", "lifb", "lift"}) {
+        std::string name = std::string("file/") + ext + "/4096x4096";
+        suite.emplace_back(name, [&opt, ext]{ return BenchFile(opt, ext, 4096, 4096); });
+    }
+
+    std::vector<BenchResult> results;
+    int allocating = 0;
+    for (const auto& b : suite) {
+        if (!opt.filter.empty() && b.first.find(opt.filter) == std::string::npos) continue;
+        results.push_back(b.second());
+        const BenchResult& r = results.back();
+        std::printf("%-40s %12.4g %-9s", r.name.c_str(), r.rate, r.unit.c_str());
+        for (const auto& m : r.metrics) std::printf("  %s=%.4g", m.first.c_str(), m.second);
+        if (Allocates(r)) {
+            std::printf("  ALLOCATES");
+            ++allocating;
+        }
+        std::printf("\n");
+        std::fflush(stdout);
+    }
+
+    if (!opt.outPath.empty() && !WriteResults(opt.outPath, results)) {
+        std::fprintf(stderr, "life_bench: cannot write %s\n", opt.outPath.c_str());
+        return 1;
+    }
+    if (!opt.baselinePath.empty()) {
+        std::vector<BenchResult> baseline;
+        if (!ReadResults(opt.baselinePath, baseline)) {
+            std::fprintf(stderr, "life_bench: cannot read %s\n", opt.baselinePath.c_str());
+            return 1;
+        }
+        std::printf("\nagainst %s (threshold %.0f%%):\n", opt.baselinePath.c_str(), opt.threshold);
+        int regressions = CompareResults(results, baseline, opt.threshold);
+        if (regressions) {
+            std::printf("%d regression%s\n", regressions, regressions == 1 ? "" : "s");
+            return 1;
+        }
+    }
+    if (allocating) {
+        std::printf("%d benchmark%s allocated in the loop\n", allocating, allocating == 1 ? "" : "s");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,309 @@
+// Headless Game of Life runner: loads a universe, steps it as fast as it can
+// and writes the final board and, optionally, per-generation statistics. Or,
+// with --soups, runs a soup search over many small random boards.
+// Builds against life_engine.cpp only, without wxWidgets.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <chrono>
+#include <vector>
+
+#include "life_engine.h"
+
+// ---------------- Options ----------------
+struct CliOptions {
+    std::string input;
+    std::string output;
+    std::string statsPath;      // "-" = standard output
+    uint64_t generations = 100;
+    bool generationsGiven = false;
+    int threads = 0;            // 0 = one per hardware thread
+    Boundary boundary = Boundary::Toroidal;
+    std::string rule;           // empty = the input file's, else B3/S23
+    bool hashlife = false;
+    int hashlifeStep = 0;
+    int hashlifeMemoryMB = 512;
+    int width = 0, height = 0;  // board size when there is no input file
+    double percent = 0;         // ... filled at random to this density
+    uint64_t seed = 1;          // ... from this seed
+    bool quiet = false;
+    uint64_t soups = 0;         // > 0 = soup search over this many soups
+    SoupSearchOptions search;   // ... with these; its seed is 'seed' above
+};
+
+static void Usage() {
+    std::fprintf(stderr,
+        "usage: life_cli [options] [input]\n"
+        "  -n <gens>          generations to run (default 100)\n"
+        "  -t <threads>       stepping threads, 0 = one per CPU (default 0)\n"
+        "  -b <boundary>      Finite, Toroidal, KleinBottle, Mirror or Infinite\n"
+        "                     (default Toroidal)\n"
+        "  -r <rule>          rule in B/S, Generations or Larger than Life notation,\n"
+        "                     e.g. B36/S23 or B2/S/C3 (default: the\n"
+        "                     input file's, else B3/S23)\n"
+        "  -e <engine>        Packed or HashLife (default Packed)\n"
+        "  --step <k>         HashLife advances 2^k generations per step\n"
+        "  --memory <MB>      HashLife node cache limit (default 512)\n"
+        "  --random <W>x<H>:<percent>\n"
+        "                     start from a random board instead of a file; the\n"
+        "                     percent may have a fraction, e.g. 12.5\n"
+        "  --seed <n>         seed for --random and --soups; the same seed gives\n"
+        "                     the same boards on any thread count (default 1)\n"
+        "  -o <file>          write the final board; format follows the extension\n"
+        "  --stats <file>     per-step statistics, JSON for .json, CSV otherwise,\n"
+        "                     '-' for CSV on standard output\n"
+        "  -q                 no summary on standard error\n"
+        "soup search:\n"
+        "  --soups <count>    run this many random soups until each settles\n"
+        "                     instead of one board; -n caps each soup (default\n"
+        "                     10000), -o writes one record per soup, JSON for\n"
+        "                     .json, CSV otherwise\n"
+        "  --soup-size <n>    soups are n x n, 1 to 64 (default 16)\n"
+        "  --field <n>        ... in the middle of an n x n finite field\n"
+        "                     (default 4 x soup size)\n"
+        "  --density <pct>    live cells in a soup (default 50)\n");
+}
+
+static bool ParseCount(const char* s, uint64_t& out) {
+    char* end = nullptr;
+    unsigned long long v = std::strtoull(s, &end, 10);
+    if (!*s || *end) return false;
+    out = v;
+    return true;
+}
+
+static bool ParseInt(const char* s, int& out) {
+    uint64_t v;
+    if (!ParseCount(s, v) || v > INT_MAX) return false;
+    out = (int)v;
+    return true;
+}
+
+static bool ParseArgs(int argc, char** argv, CliOptions& opt) {
+    for (int i = 1; i < argc; ++i) {
+        const char* a = argv[i];
+        // every option but -q takes a value
+        const char* v = (std::strcmp(a, "-q") != 0 && a[0] == '-' && a[1] && i+1 < argc) ? argv[i+1] : nullptr;
+        bool ok = true;
+        if (!std::strcmp(a, "-q")) { opt.quiet = true; continue; }
+        else if (a[0] != '-' || !a[1]) {
+            if (!opt.input.empty()) return false;
+            opt.input = a;
+            continue;
+        }
+        else if (!v) return false;
+        else if (!std::strcmp(a, "-n")) ok = opt.generationsGiven = ParseCount(v, opt.generations);
+        else if (!std::strcmp(a, "-t")) ok = ParseInt(v, opt.threads);
+        else if (!std::strcmp(a, "-b")) ok = ParseBoundary(v, opt.boundary);
+        else if (!std::strcmp(a, "-r")) {
+            LifeRule rule;
+            opt.rule = v;
+            ok = LifeRule::Parse(opt.rule, rule);
+        }
+        else if (!std::strcmp(a, "-e")) {
+            opt.hashlife = !std::strcmp(v, "HashLife");
+            ok = opt.hashlife || !std::strcmp(v, "Packed");
+        }
+        else if (!std::strcmp(a, "--step")) ok = ParseInt(v, opt.hashlifeStep);
+        else if (!std::strcmp(a, "--memory")) ok = ParseInt(v, opt.hashlifeMemoryMB);
+        else if (!std::strcmp(a, "--random"))
+            ok = std::sscanf(v, "%dx%d:%lf", &opt.width, &opt.height, &opt.percent) == 3
+                && opt.width > 0 && opt.height > 0 && opt.percent >= 0 && opt.percent <= 100;
+        else if (!std::strcmp(a, "--seed")) ok = ParseCount(v, opt.seed);
+        else if (!std::strcmp(a, "-o")) opt.output = v;
+        else if (!std::strcmp(a, "--stats")) opt.statsPath = v;
+        else if (!std::strcmp(a, "--soups")) ok = ParseCount(v, opt.soups) && opt.soups > 0;
+        else if (!std::strcmp(a, "--soup-size")) ok = ParseInt(v, opt.search.soupSide);
+        else if (!std::strcmp(a, "--field")) ok = ParseInt(v, opt.search.fieldSide);
+        else if (!std::strcmp(a, "--density")) {
+            char* end = nullptr;
+            opt.search.density = std::strtod(v, &end) / 100;
+            ok = *v && !*end && opt.search.density >= 0 && opt.search.density <= 1;
+        }
+        else return false;
+        if (!ok) return false;
+        ++i;
+    }
+    return !opt.input.empty() || opt.width > 0 || opt.soups > 0;
+}
+
+// ---------------- Stats Output ----------------
+// One record per step: the generation reached, the population, the cells
+// born and died on the way (packed and sparse engines) and the time the step
+// took. Written as it goes so a long run can be watched with tail -f.
+class StatsWriter {
+public:
+    ~StatsWriter() { Close(); }
+
+    bool Open(const std::string& path) {
+        m_json = path.size() >= 5 && path.compare(path.size()-5, 5, ".json") == 0;
+        m_file = path == "-" ? stdout : std::fopen(path.c_str(), "w");
+        if (!m_file) return false;
+        std::fputs(m_json ? "[\n" : "generation,population,births,deaths,step_ns\n", m_file);
+        return true;
+    }
+
+    void Write(uint64_t generation, uint64_t population, const EngineStats& st, int64_t ns) {
+        if (!m_file) return;
+        if (m_json) {
+            std::fprintf(m_file, "%s{\"generation\":%llu,\"population\":%llu,\"births\":%llu,\"deaths\":%llu,\"step_ns\":%lld}",
+                m_first ? "" : ",\n", (unsigned long long)generation, (unsigned long long)population,
+                (unsigned long long)st.births, (unsigned long long)st.deaths, (long long)ns);
+        } else {
+            std::fprintf(m_file, "%llu,%llu,%llu,%llu,%lld\n", (unsigned long long)generation,
+                (unsigned long long)population, (unsigned long long)st.births,
+                (unsigned long long)st.deaths, (long long)ns);
+        }
+        m_first = false;
+    }
+
+    bool Close() {
+        if (!m_file) return true;
+        if (m_json) std::fputs(m_first ? "]\n" : "\n]\n", m_file);
+        bool ok = m_file == stdout ? std::fflush(m_file) == 0 : std::fclose(m_file) == 0;
+        m_file = nullptr;
+        return ok;
+    }
+
+private:
+    std::FILE* m_file = nullptr;
+    bool m_json = false;
+    bool m_first = true;
+};
+
+// ---------------- Soup Search ----------------
+static bool WriteSoupResults(const std::string& path, const std::vector<SoupResult>& results) {
+    const bool json = path.size() >= 5 && path.compare(path.size()-5, 5, ".json") == 0;
+    std::FILE* f = std::fopen(path.c_str(), "w");
+    if (!f) return false;
+    std::fputs(json ? "[\n" : "soup,lifetime,population,period\n", f);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const SoupResult& r = results[i];
+        if (json) {
+            std::fprintf(f, "{\"soup\":%zu,\"lifetime\":%u,\"population\":%u,\"period\":%u}%s\n",
+                i, r.lifetime, r.population, (unsigned)r.period, i + 1 < results.size() ? "," : "");
+        } else {
+            std::fprintf(f, "%zu,%u,%u,%u\n", i, r.lifetime, r.population, (unsigned)r.period);
+        }
+    }
+    if (json) std::fputs("]\n", f);
+    return std::fclose(f) == 0;
+}
+
+static int RunSoupSearch(const CliOptions& opt) {
+    SoupSearchOptions options = opt.search;
+    options.seed = opt.seed;
+    if (opt.generationsGiven) options.maxGenerations = (uint32_t)std::min<uint64_t>(opt.generations, UINT32_MAX);
+    if (!opt.rule.empty()) LifeRule::Parse(opt.rule, options.rule);
+    SoupSearch search;
+    if (!search.SetOptions(options)) {
+        std::fprintf(stderr, "life_cli: soup search needs a life-like rule without B0 and a soup size of 1 to 64\n");
+        return 1;
+    }
+    WorkerPool pool(opt.threads);
+    std::vector<SoupResult> results;
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point t0 = Clock::now();
+    search.Run(opt.soups, results, &pool);
+    const double seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+
+    if (!opt.output.empty() && !WriteSoupResults(opt.output, results)) {
+        std::fprintf(stderr, "life_cli: cannot write %s\n", opt.output.c_str());
+        return 1;
+    }
+    if (!opt.quiet) {
+        uint64_t generations = 0, unsettled = 0;
+        size_t longest = 0;
+        for (size_t i = 0; i < results.size(); ++i) {
+            generations += results[i].lifetime;
+            if (!results[i].period) ++unsettled;
+            else if (results[longest].period == 0 || results[i].lifetime > results[longest].lifetime) longest = i;
+        }
+        const SoupSearchOptions& o = search.GetOptions();
+        std::fprintf(stderr, "%llu soups of %dx%d in %dx%d under %s in %.3f s (%.1f soups/s, %.3g gen/s)\n",
+            (unsigned long long)opt.soups, o.soupSide, o.soupSide, o.fieldSide, o.fieldSide,
+            o.rule.ToString().c_str(), seconds, seconds > 0 ? opt.soups / seconds : 0.0,
+            seconds > 0 ? generations / seconds : 0.0);
+        std::fprintf(stderr, "mean lifetime %.1f, longest %u (soup %zu), %llu still running at %u generations\n",
+            (double)generations / results.size(), results[longest].lifetime, longest,
+            (unsigned long long)unsettled, o.maxGenerations);
+    }
+    return 0;
+}
+
+// ---------------- Main ----------------
+int main(int argc, char** argv) {
+    CliOptions opt;
+    if (!ParseArgs(argc, argv, opt)) {
+        Usage();
+        return 2;
+    }
+    if (opt.soups) return RunSoupSearch(opt);
+
+    Universe universe;
+    universe.SetThreadCount(opt.threads);
+    universe.SetHashLifeStep(opt.hashlifeStep);
+    universe.SetHashLifeMemory(opt.hashlifeMemoryMB);
+    universe.SetBoundary(opt.boundary);
+    universe.SetHashLife(opt.hashlife);
+    if (!opt.input.empty()) {
+        if (!universe.Load(opt.input)) {
+            std::fprintf(stderr, "life_cli: cannot read %s\n", opt.input.c_str());
+            return 1;
+        }
+    } else {
+        universe.Resize(opt.width, opt.height);
+        universe.Randomize(opt.percent / 100, opt.seed, 0, 0, universe.Width(), universe.Height());
+    }
+    LifeRule rule;
+    if (!opt.rule.empty() && LifeRule::Parse(opt.rule, rule) && !universe.SetRule(rule)) {
+        std::fprintf(stderr, "life_cli: %s needs a bounded board\n", opt.rule.c_str());
+        return 1;
+    }
+
+    StatsWriter stats;
+    const bool wantStats = !opt.statsPath.empty();
+    if (wantStats && !stats.Open(opt.statsPath)) {
+        std::fprintf(stderr, "life_cli: cannot write %s\n", opt.statsPath.c_str());
+        return 1;
+    }
+
+    // HashLife may advance many generations per step; stop at the first step
+    // that reaches the target rather than splitting one
+    using Clock = std::chrono::steady_clock;
+    const uint64_t start = universe.Generation(), target = start + opt.generations;
+    const Clock::time_point t0 = Clock::now();
+    Clock::time_point last = t0;
+    while (universe.Generation() < target) {
+        if (!universe.Step()) break;
+        if (wantStats) {
+            Clock::time_point now = Clock::now();
+            stats.Write(universe.Generation(), universe.Population(), universe.Stats(),
+                std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count());
+            last = now;
+        }
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+
+    if (!stats.Close()) {
+        std::fprintf(stderr, "life_cli: cannot write %s\n", opt.statsPath.c_str());
+        return 1;
+    }
+    if (!opt.output.empty() && !universe.Save(opt.output)) {
+        std::fprintf(stderr, "life_cli: cannot write %s\n", opt.output.c_str());
+        return 1;
+    }
+    if (!opt.quiet) {
+        const uint64_t ran = universe.Generation() - start;
+        std::fprintf(stderr, "%llu generations of %s in %.3f s (%.1f gen/s), population %llu\n",
+            (unsigned long long)ran, universe.GetRule().ToString().c_str(), seconds,
+            seconds > 0 ? ran / seconds : 0.0, (unsigned long long)universe.Population());
+        const CycleDetector& cycles = universe.Cycles();
+        if (cycles.Found()) {
+            std::fprintf(stderr, "period %llu since generation %llu\n",
+                (unsigned long long)cycles.Period(), (unsigned long long)cycles.Start());
+        }
+    }
+    return 0;
+}
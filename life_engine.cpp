@@ -0,0 +1,3659 @@
+#include "life_engine.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define LIFE_HAVE_X86_SIMD 1
+#define LIFE_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// ---------------- Rules Impl ----------------
+// Digits 0-8 as a mask of neighbor counts.
+static bool ParseCounts(const std::string& digits, uint16_t& mask) {
+    mask = 0;
+    for (char c : digits) {
+        if (c < '0' || c > '8') return false;
+        mask |= 1 << (c - '0');
+    }
+    return true;
+}
+
+// A whole decimal number in [lo, hi].
+static bool ParseNumber(const std::string& digits, int lo, int hi, int& value) {
+    if (digits.empty() || digits.size() > 4 || digits.find_first_not_of("0123456789") != std::string::npos) return false;
+    value = std::atoi(digits.c_str());
+    return value >= lo && value <= hi;
+}
+
+// "<min>..<max>", both in [0, hi].
+static bool ParseRange(const std::string& text, int hi, int& lo, int& up) {
+    size_t dots = text.find("..");
+    return dots != std::string::npos && ParseNumber(text.substr(0, dots), 0, hi, lo)
+        && ParseNumber(text.substr(dots + 2), lo, hi, up);
+}
+
+// Golly's Larger than Life notation, comma-separated R<radius>, C<states>
+// (below 3 means 2), M<1 if the cell counts itself>, S<min>..<max>,
+// B<min>..<max> and N<neighborhood>; only the Moore square (NM) is run. The
+// cell counting itself only matters when it is alive, so M1 moves the
+// survival range down by one and the cell is left out from then on.
+static bool ParseLargerThanLife(const std::string& t, LifeRule& rule) {
+    LifeRule r;
+    bool centre = false, gotBirth = false, gotSurvival = false;
+    int radius = 0;
+    std::vector<std::string> fields;
+    for (size_t pos = 0; pos <= t.size(); ) {
+        size_t comma = std::min(t.find(',', pos), t.size());
+        fields.push_back(t.substr(pos, comma - pos));
+        pos = comma + 1;
+    }
+    for (const std::string& f : fields) {
+        if (f.empty()) return false;
+        std::string v = f.substr(1);
+        int n = 0;
+        switch (f[0]) {
+        case 'R': if (!ParseNumber(v, 1, LifeRule::kMaxRadius, radius)) return false; break;
+        case 'C': if (!ParseNumber(v, 0, LifeRule::kMaxStates, n)) return false; r.states = std::max(n, 2); break;
+        case 'M': if (v != "0" && v != "1") return false; centre = v == "1"; break;
+        case 'S': gotSurvival = !v.empty(); if (gotSurvival && !ParseRange(v, 121, r.survivalMin, r.survivalMax)) return false; break;
+        case 'B': gotBirth = !v.empty(); if (gotBirth && !ParseRange(v, 121, r.birthMin, r.birthMax)) return false; break;
+        case 'N': if (v != "M") return false; break;
+        default: return false;
+        }
+    }
+    if (!radius) return false;
+    const int cells = (2*radius + 1) * (2*radius + 1);
+    if (r.birthMax >= cells || r.survivalMax > cells) return false;
+    if (!gotBirth) r.birthMin = 1, r.birthMax = 0;   // empty ranges
+    if (!gotSurvival) r.survivalMin = 1, r.survivalMax = 0;
+    else if (!centre && r.survivalMax == cells) return false;
+    else if (centre && r.survivalMax == 0) r.survivalMin = 1; // it only ever counted itself
+    else if (centre) { r.survivalMin = std::max(r.survivalMin - 1, 0); --r.survivalMax; }
+    if (radius == 1) {
+        // the eight nearest neighbors: masks, as the B/S notation gives
+        r.birth = r.survival = 0;
+        for (int k=0; k<9; ++k) {
+            if (k >= r.birthMin && k <= r.birthMax) r.birth |= 1 << k;
+            if (k >= r.survivalMin && k <= r.survivalMax) r.survival |= 1 << k;
+        }
+        r.birthMin = r.birthMax = r.survivalMin = r.survivalMax = 0;
+    } else {
+        r.radius = radius;
+        r.birth = r.survival = 0;
+    }
+    rule = r;
+    return true;
+}
+
+bool LifeRule::Parse(const std::string& text, LifeRule& rule) {
+    std::string t;
+    for (char c : text) {
+        if (!std::isspace((unsigned char)c)) t += (char)std::toupper((unsigned char)c);
+    }
+    if (!t.empty() && t[0] == 'R') return ParseLargerThanLife(t, rule);
+    size_t slash = t.find('/');
+    if (slash == std::string::npos) return false;
+    std::string a = t.substr(0, slash), b = t.substr(slash + 1), c;
+    size_t slash2 = b.find('/');
+    if (slash2 != std::string::npos) {
+        c = b.substr(slash2 + 1);
+        b.resize(slash2);
+        if (!c.empty() && (c[0] == 'C' || c[0] == 'G')) c.erase(0, 1);
+    }
+    LifeRule r;
+    if (!a.empty() && (a[0] == 'B' || a[0] == 'S')) {
+        if (b.empty() || b[0] != (a[0] == 'B' ? 'S' : 'B')) return false;
+        if (a[0] == 'S') std::swap(a, b);
+        if (!ParseCounts(a.substr(1), r.birth) || !ParseCounts(b.substr(1), r.survival)) return false;
+    } else if (!ParseCounts(a, r.survival) || !ParseCounts(b, r.birth)) {
+        return false;
+    }
+    if (slash2 != std::string::npos && !ParseNumber(c, 2, kMaxStates, r.states)) return false;
+    rule = r;
+    return true;
+}
+
+std::string LifeRule::ToString() const {
+    if (radius > 1) {
+        // an empty range is written as a bare letter
+        auto range = [](char tag, int lo, int hi) {
+            return tag + (lo <= hi ? std::to_string(lo) + ".." + std::to_string(hi) : std::string());
+        };
+        return "R" + std::to_string(radius) + ",C" + std::to_string(states > 2 ? states : 0) + ",M0,"
+            + range('S', survivalMin, survivalMax) + "," + range('B', birthMin, birthMax) + ",NM";
+    }
+    std::string s = "B";
+    for (int n=0; n<9; ++n) if ((birth >> n) & 1) s += (char)('0' + n);
+    s += "/S";
+    for (int n=0; n<9; ++n) if ((survival >> n) & 1) s += (char)('0' + n);
+    if (states > 2) s += "/C" + std::to_string(states);
+    return s;
+}
+
+// ---------------- Boundaries Impl ----------------
+static const char* const kBoundaryNames[] = { "Finite", "Toroidal", "KleinBottle", "Mirror", "Infinite" };
+
+const char* BoundaryName(Boundary boundary) {
+    return kBoundaryNames[(int)boundary];
+}
+
+bool ParseBoundary(const std::string& name, Boundary& boundary) {
+    for (int i=0; i<(int)(sizeof kBoundaryNames / sizeof kBoundaryNames[0]); ++i) {
+        if (name == kBoundaryNames[i]) { boundary = (Boundary)i; return true; }
+    }
+    return false;
+}
+
+// ---------------- PackedUniverse Impl ----------------
+// Adds the live cells among the 64 starting at column x (a multiple of 64) to
+// one row of per-pixel counts for CopyDensity.
+static inline void CountBits64(uint64_t bits, int64_t x, int64_t x0, int shift, uint64_t* counts, int w) {
+    if (!bits) return;
+    if (shift >= 6) {
+        int64_t px = (x - x0) >> shift;
+        if (px>=0 && px<w) counts[px] += PopCount64(bits);
+        return;
+    }
+    const int k = 1 << shift;
+    const uint64_t mask = (uint64_t(1) << k) - 1;
+    for (int j=0; j<64; j+=k) {
+        uint64_t block = (bits >> j) & mask;
+        if (!block) continue;
+        int64_t px = (x + j - x0) >> shift;
+        if (px>=0 && px<w) counts[px] += PopCount64(block);
+    }
+}
+
+// Neighbor counting is done 64 cells at a time with bit-sliced adders. For
+// each row we precompute x = W^E and a = W&E, where W/E are the row shifted
+// so that bit i holds the west/east neighbor of cell i. Together with the
+// row itself (c) that gives the 3-cell horizontal sum as lo=x^c, hi=a|(c&x)
+// for the rows above and below, and the 2-cell sum (x, a) for the centre row.
+// The count (0..8) comes out as four bit planes, u[3] u[2] u[1] u[0].
+template<class V>
+static inline void CountNeighbors(V u[4], const V& xT, const V& aT, const V& cT, const V& xM, const V& aM,
+                                  const V& xB, const V& aB, const V& cB) {
+    // horizontal sums of the rows above and below (0..3 each)
+    V tLo = xT ^ cT, tHi = aT | (cT & xT);
+    V bLo = xB ^ cB, bHi = aB | (cB & xB);
+    // above + below (0..6) -> s2 s1 s0
+    V s0 = tLo ^ bLo;
+    V c0 = tLo & bLo;
+    V s1 = tHi ^ bHi ^ c0;
+    V s2 = (tHi & bHi) | (c0 & (tHi ^ bHi));
+    // + west/east of the centre row (0..8) -> u3 u2 u1 u0
+    u[0] = s0 ^ xM;
+    V c1 = s0 & xM;
+    u[1] = s1 ^ aM ^ c1;
+    V c2 = (s1 & aM) | (c1 & (s1 ^ aM));
+    u[2] = s2 ^ c2;
+    u[3] = s2 & c2;
+}
+
+// out = l[n] bit by bit, n being the cell's neighbor count: a multiplexer
+// tree over the count planes. A count of 8 is the only one with u[3] set.
+template<class V>
+static inline void SelectByCount(V& out, const V u[4], const V l[9]) {
+    V q[4];
+    for (int k=0; k<4; ++k) q[k] = l[2*k] ^ ((l[2*k+1] ^ l[2*k]) & u[0]);
+    V lo = q[0] ^ ((q[1] ^ q[0]) & u[1]), hi = q[2] ^ ((q[3] ^ q[2]) & u[1]);
+    V m = lo ^ ((hi ^ lo) & u[2]);
+    out = m ^ ((l[8] ^ m) & u[3]);
+}
+
+// A rule turns the count planes and the current cells (c) into the next
+// generation. Rules that aren't known until run time get masks per count,
+// broadcast once per row by RuleMasks(); the others ignore them.
+//
+// A rule fixed at compile time: the tree, simplified while it is
+// instantiated. Each subtree is known by its truth table over the counts
+// it covers and the cell's state, so a select between two identical
+// subtrees, or involving a constant, costs nothing or one operation.
+template<unsigned Birth, unsigned Survival>
+struct FixedRule {
+    // Bit 2j+s: the next state of a cell in state s with count first+j.
+    static constexpr unsigned Table(int first, int count) {
+        unsigned t = 0;
+        for (int j=0; j<count; ++j)
+            t |= (((Birth >> (first+j)) & 1) | ((Survival >> (first+j)) & 1) << 1) << 2*j;
+        return t;
+    }
+
+    // The subtree over counts [First, First+Count), Count a power of two.
+    template<int First, int Count, class V>
+    static inline void Node(V& out, const V u[4], const V& c) {
+        constexpr unsigned t = Table(First, Count), ones = (1u << 2*Count) - 1;
+        if constexpr (t == 0) out = V();
+        else if constexpr (t == ones) out = ~V();
+        else if constexpr (Count == 1) out = t == 2 ? c : ~c;
+        else {
+            constexpr int half = Count/2, bit = half==1 ? 0 : half==2 ? 1 : 2;
+            constexpr unsigned lo = Table(First, half), hi = Table(First+half, half), all = (1u << 2*half) - 1;
+            const V& sel = u[bit];
+            if constexpr (lo == hi) Node<First, half>(out, u, c);
+            else if constexpr (lo == 0 && hi == all) out = sel;
+            else if constexpr (lo == all && hi == 0) out = ~sel;
+            else {
+                V a, b;
+                Node<First+half, half>(a, u, c);
+                Node<First, half>(b, u, c);
+                if constexpr (lo == 0) out = a & sel;
+                else if constexpr (hi == 0) out = b & ~sel;
+                else if constexpr (lo == all) out = a | ~sel;
+                else if constexpr (hi == all) out = b | sel;
+                else out = b ^ ((a ^ b) & sel);
+            }
+        }
+    }
+
+    template<class V>
+    static inline void Next(V& out, const V u[4], const V& c, const V*, const V*) {
+        Node<0, 8>(out, u, c);
+        // u[3] means a count of 8 with the other planes all zero, where the
+        // tree gives count 0's leaf
+        if constexpr (Table(8, 1) != Table(0, 1)) {
+            V l8;
+            Node<8, 1>(l8, u, c);
+            out = out ^ ((l8 ^ out) & u[3]);
+        }
+    }
+};
+
+// Every other rule: leaf n is born[n] ^ (c & flip[n]).
+struct MaskRule {
+    template<class V>
+    static inline void Next(V& out, const V u[4], const V& c, const V* born, const V* flip) {
+        V l[9];
+        for (int n=0; n<9; ++n) l[n] = born[n] ^ (c & flip[n]);
+        SelectByCount(out, u, l);
+    }
+};
+
+template<class V>
+static inline void RuleMasks(const LifeRule& rule, V born[9], V flip[9]) {
+    for (int n=0; n<9; ++n) {
+        const bool b = (rule.birth >> n) & 1, s = (rule.survival >> n) & 1;
+        born[n] = b ? ~V() : V();
+        flip[n] = b != s ? ~V() : V();
+    }
+}
+
+struct RowInputs {
+    const uint64_t *xT, *aT, *cT, *xM, *aM, *cM, *xB, *aB, *cB;
+};
+
+// The new row goes to next, which holds the row two generations back. The
+// cells born and died since the current row (cM) are counted into
+// births/deaths, and bits that differ from the old row are ORed into
+// changed2, both per word, so the caller can tell which tiles are settled.
+struct RowOutputs {
+    uint64_t *next, *changed2, *births, *deaths;
+};
+
+typedef void (*CombineRowFn)(const RowInputs& in, const RowOutputs& out, int begin, int end, const LifeRule& rule);
+typedef uint64_t (*NextWordFn)(const RowInputs& in, int i, const LifeRule& rule);
+
+// One word of the next generation, for the words the row kernels don't do.
+template<class Rule>
+static uint64_t NextWord(const RowInputs& in, int i, const LifeRule& rule) {
+    uint64_t u[4], born[9], flip[9], r;
+    RuleMasks(rule, born, flip);
+    CountNeighbors<uint64_t>(u, in.xT[i], in.aT[i], in.cT[i], in.xM[i], in.aM[i], in.xB[i], in.aB[i], in.cB[i]);
+    Rule::Next(r, u, in.cM[i], born, flip);
+    return r;
+}
+
+template<class Rule>
+static void CombineRowScalar(const RowInputs& in, const RowOutputs& out, int begin, int end, const LifeRule& rule) {
+    uint64_t born[9], flip[9];
+    RuleMasks(rule, born, flip);
+    for (int i=begin; i<end; ++i) {
+        uint64_t u[4], r;
+        CountNeighbors<uint64_t>(u, in.xT[i], in.aT[i], in.cT[i], in.xM[i], in.aM[i], in.xB[i], in.aB[i], in.cB[i]);
+        Rule::Next(r, u, in.cM[i], born, flip);
+        out.changed2[i] |= r ^ out.next[i];
+        out.births[i] += PopCount64(r & ~in.cM[i]);
+        out.deaths[i] += PopCount64(in.cM[i] & ~r);
+        out.next[i] = r;
+    }
+}
+
+#ifdef LIFE_HAVE_X86_SIMD
+LIFE_TARGET("sse2")
+static inline __m128i LoadSSE2(const uint64_t* p, int i) { return _mm_loadu_si128((const __m128i*)(p+i)); }
+
+LIFE_TARGET("sse2")
+static inline void OrIntoSSE2(uint64_t* p, int i, const __m128i& v) {
+    _mm_storeu_si128((__m128i*)(p+i), _mm_or_si128(LoadSSE2(p, i), v));
+}
+
+// Population count of each 64-bit lane: the usual SWAR reduction to byte
+// counts, then psadbw sums the bytes of each lane.
+LIFE_TARGET("sse2")
+static inline void AddPopCountSSE2(uint64_t* p, int i, const __m128i& v) {
+    const __m128i m1 = _mm_set1_epi8(0x55), m2 = _mm_set1_epi8(0x33), m4 = _mm_set1_epi8(0x0F);
+    __m128i x = _mm_sub_epi64(v, _mm_and_si128(_mm_srli_epi64(v, 1), m1));
+    x = _mm_add_epi64(_mm_and_si128(x, m2), _mm_and_si128(_mm_srli_epi64(x, 2), m2));
+    x = _mm_and_si128(_mm_add_epi64(x, _mm_srli_epi64(x, 4)), m4);
+    x = _mm_sad_epu8(x, _mm_setzero_si128());
+    _mm_storeu_si128((__m128i*)(p+i), _mm_add_epi64(LoadSSE2(p, i), x));
+}
+
+template<class Rule>
+LIFE_TARGET("sse2")
+static void CombineRowSSE2(const RowInputs& in, const RowOutputs& out, int begin, int end, const LifeRule& rule) {
+    __m128i born[9], flip[9];
+    RuleMasks(rule, born, flip);
+    auto ld = LoadSSE2;
+    int i=begin;
+    for (; i+2<=end; i+=2) {
+        __m128i u[4], c = ld(in.cM,i);
+        CountNeighbors<__m128i>(u, ld(in.xT,i), ld(in.aT,i), ld(in.cT,i), ld(in.xM,i), ld(in.aM,i),
+                                ld(in.xB,i), ld(in.aB,i), ld(in.cB,i));
+        __m128i r;
+        Rule::Next(r, u, c, born, flip);
+        OrIntoSSE2(out.changed2, i, _mm_xor_si128(r, ld(out.next,i)));
+        AddPopCountSSE2(out.births, i, _mm_andnot_si128(c, r));
+        AddPopCountSSE2(out.deaths, i, _mm_andnot_si128(r, c));
+        _mm_storeu_si128((__m128i*)(out.next+i), r);
+    }
+    CombineRowScalar<Rule>(in, out, i, end, rule);
+}
+
+LIFE_TARGET("avx2")
+static inline __m256i LoadAVX2(const uint64_t* p, int i) { return _mm256_loadu_si256((const __m256i*)(p+i)); }
+
+LIFE_TARGET("avx2")
+static inline void OrIntoAVX2(uint64_t* p, int i, const __m256i& v) {
+    _mm256_storeu_si256((__m256i*)(p+i), _mm256_or_si256(LoadAVX2(p, i), v));
+}
+
+LIFE_TARGET("avx2")
+static inline void AddPopCountAVX2(uint64_t* p, int i, const __m256i& v) {
+    const __m256i m1 = _mm256_set1_epi8(0x55), m2 = _mm256_set1_epi8(0x33), m4 = _mm256_set1_epi8(0x0F);
+    __m256i x = _mm256_sub_epi64(v, _mm256_and_si256(_mm256_srli_epi64(v, 1), m1));
+    x = _mm256_add_epi64(_mm256_and_si256(x, m2), _mm256_and_si256(_mm256_srli_epi64(x, 2), m2));
+    x = _mm256_and_si256(_mm256_add_epi64(x, _mm256_srli_epi64(x, 4)), m4);
+    x = _mm256_sad_epu8(x, _mm256_setzero_si256());
+    _mm256_storeu_si256((__m256i*)(p+i), _mm256_add_epi64(LoadAVX2(p, i), x));
+}
+
+template<class Rule>
+LIFE_TARGET("avx2")
+static void CombineRowAVX2(const RowInputs& in, const RowOutputs& out, int begin, int end, const LifeRule& rule) {
+    __m256i born[9], flip[9];
+    RuleMasks(rule, born, flip);
+    auto ld = LoadAVX2;
+    int i=begin;
+    for (; i+4<=end; i+=4) {
+        __m256i u[4], c = ld(in.cM,i);
+        CountNeighbors<__m256i>(u, ld(in.xT,i), ld(in.aT,i), ld(in.cT,i), ld(in.xM,i), ld(in.aM,i),
+                                ld(in.xB,i), ld(in.aB,i), ld(in.cB,i));
+        __m256i r;
+        Rule::Next(r, u, c, born, flip);
+        OrIntoAVX2(out.changed2, i, _mm256_xor_si256(r, ld(out.next,i)));
+        AddPopCountAVX2(out.births, i, _mm256_andnot_si256(c, r));
+        AddPopCountAVX2(out.deaths, i, _mm256_andnot_si256(r, c));
+        _mm256_storeu_si256((__m256i*)(out.next+i), r);
+    }
+    CombineRowScalar<Rule>(in, out, i, end, rule);
+}
+#endif
+
+struct RuleKernels {
+    CombineRowFn combineRow; // widest the CPU supports
+    NextWordFn nextWord;
+};
+
+template<class Rule>
+static const RuleKernels* RuleKernelsFor() {
+    static const RuleKernels kernels = [] {
+        RuleKernels k = { CombineRowScalar<Rule>, NextWord<Rule> };
+#ifdef LIFE_HAVE_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) k.combineRow = CombineRowAVX2<Rule>;
+        else if (__builtin_cpu_supports("sse2")) k.combineRow = CombineRowSSE2<Rule>;
+#endif
+        return k;
+    }();
+    return &kernels;
+}
+
+// Neighbor counts as a rule mask, e.g. RuleCounts("23") = 0b1100.
+static constexpr unsigned RuleCounts(const char* digits) {
+    unsigned mask = 0;
+    for (; *digits; ++digits) mask |= 1u << (*digits - '0');
+    return mask;
+}
+
+// Well-known rules get kernels of their own, which for Conway's rule comes
+// down to (c|u0) & u1 & ~u2. The rest share the mask kernel, which takes
+// about twice as long per word.
+const RuleKernels* KernelsForRule(const LifeRule& rule) {
+#define LIFE_RULE_KERNEL(b, s) \
+    if (rule.birth == RuleCounts(b) && rule.survival == RuleCounts(s)) \
+        return RuleKernelsFor<FixedRule<RuleCounts(b), RuleCounts(s)>>()
+    LIFE_RULE_KERNEL("3", "23");        // Life
+    LIFE_RULE_KERNEL("36", "23");       // HighLife
+    LIFE_RULE_KERNEL("3678", "34678");  // Day & Night
+    LIFE_RULE_KERNEL("2", "");          // Seeds
+    LIFE_RULE_KERNEL("3", "012345678"); // Life without Death
+    LIFE_RULE_KERNEL("36", "125");      // 2x2
+    LIFE_RULE_KERNEL("3", "12345");     // Maze
+    LIFE_RULE_KERNEL("1357", "1357");   // Replicator
+    LIFE_RULE_KERNEL("34", "34");       // 34 Life
+    LIFE_RULE_KERNEL("368", "245");     // Morley
+    LIFE_RULE_KERNEL("35678", "5678");  // Diamoeba
+    LIFE_RULE_KERNEL("4678", "35678");  // Anneal
+#undef LIFE_RULE_KERNEL
+    return RuleKernelsFor<MaskRule>();
+}
+
+// Boards smaller than this (in words) are not worth waking the pool for.
+static const size_t kParallelMinWords = 16384;
+// More stripes than threads so that uneven stripes still balance out.
+static const int kStripesPerThread = 4;
+// Per stripe: three rolling (x, a) row pairs and the per-word change, birth
+// and death accumulators of the current band.
+static const int kScratchRows = 9;
+
+// Hash of one word of the board at word index pos. All-zero words hash to
+// nothing, so empty areas cost nothing to hash.
+static inline uint64_t WordHash(uint64_t pos, uint64_t w) {
+    uint64_t x = w ^ (pos * 0x9E3779B97F4A7C15ULL);
+    x ^= x >> 32; x *= 0xD6E8FEB86659FD93ULL;
+    x ^= x >> 32; x *= 0xD6E8FEB86659FD93ULL;
+    return x ^ (x >> 32);
+}
+
+void PackedUniverse::Resize(int w, int h) {
+    m_width = w; m_height = h;
+    m_stride = (w + 63) / 64;
+    const int lineWords = (int)(kCacheLine / sizeof(uint64_t));
+    m_pitch = (m_stride + lineWords-1) / lineWords * lineWords;
+    m_cells.assign((size_t)m_pitch*(m_height+2), 0);
+    m_next.assign(m_cells.size(), 0);
+    m_scratch.assign((size_t)m_pitch*kScratchRows, 0);
+    m_tileFlags.assign((size_t)m_stride*TileRows(), kTileDirty);
+    m_tileActive.assign(m_tileFlags.size(), 1);
+    m_tileOr.assign(m_tileFlags.size(), 0);
+    m_tileBirths.assign(m_tileFlags.size(), 0);
+    m_tileDeaths.assign(m_tileFlags.size(), 0);
+    m_tileHash.assign(m_tileFlags.size(), 0);
+    m_tileHash2.assign(m_tileFlags.size(), 0);
+    m_tileHashed.assign(m_tileFlags.size(), 0);
+    m_activeTiles = m_tileFlags.size();
+    m_population = m_births = m_deaths = 0;
+}
+
+void PackedUniverse::Clear() {
+    std::fill(m_cells.begin(), m_cells.end(), 0);
+    MarkAllDirty();
+    m_population = m_births = m_deaths = 0;
+}
+
+// Hashes the tiles whose cached hash is out of date, a band at a time with
+// the rows outermost so each row is read in order, then combines them all.
+bool PackedUniverse::StateHash(uint64_t& hash) {
+    hash = 0;
+    for (int b=0; b<TileRows(); ++b) {
+        uint64_t* tileHash = &m_tileHash[(size_t)b*m_stride];
+        uint8_t* hashed = &m_tileHashed[(size_t)b*m_stride];
+        m_staleTiles.clear();
+        for (int i=0; i<m_stride; ++i) {
+            if (!(hashed[i] & 1)) m_staleTiles.push_back(i);
+        }
+        if (!m_staleTiles.empty()) {
+            for (int i : m_staleTiles) tileHash[i] = 0;
+            int y0 = b*kTileRows, y1 = std::min(m_height, y0 + kTileRows);
+            for (int y=y0; y<y1; ++y) {
+                const size_t base = (size_t)y*m_stride;
+                const uint64_t* row = Row(y);
+                for (int i : m_staleTiles)
+                    if (row[i]) tileHash[i] ^= WordHash(base + i, row[i]);
+            }
+            for (int i : m_staleTiles) hashed[i] |= 1;
+        }
+        for (int i=0; i<m_stride; ++i) hash ^= tileHash[i];
+    }
+    return true;
+}
+
+void PackedUniverse::GetStats(EngineStats& stats) const {
+    stats.tiles = m_tileFlags.size();
+    stats.activeTiles = m_activeTiles;
+    stats.memoryBytes = (m_cells.size() + m_next.size() + m_scratch.size())*sizeof(uint64_t);
+    stats.births = m_births;
+    stats.deaths = m_deaths;
+}
+
+// A skipped tile is only right if the generations before it were stepped
+// under the same rule, so every tile is computed again.
+bool PackedUniverse::SetRule(const LifeRule& rule) {
+    if (!rule.IsLifeLike()) return false;
+    if (rule == m_rule) return true;
+    m_rule = rule;
+    m_kernels = KernelsForRule(rule);
+    MarkAllDirty();
+    return true;
+}
+
+// Only the tiles whose words changed are marked, so a small paste onto a
+// large settled board leaves the rest of it skipped.
+void PackedUniverse::Paste(const UniverseSnapshot& snap, int64_t x0, int64_t y0, PasteMode mode) {
+    int64_t ya = std::max<int64_t>(y0, 0), yb = std::min<int64_t>(y0 + snap.height, m_height);
+    int64_t xa = std::max<int64_t>(x0, 0), xb = std::min<int64_t>(x0 + snap.width, m_width);
+    if (ya>=yb || xa>=xb) return;
+    for (int64_t y=ya; y<yb; ++y) {
+        const uint64_t* src = snap.Row((int)(y-y0));
+        uint64_t* dst = Row((int)y);
+        for (int64_t w = xa>>6; w <= (xb-1)>>6; ++w) {
+            uint64_t mask = ColumnMask(w, xa, xb);
+            uint64_t bits = ReadBits64(src, snap.stride, w*64 - x0) & mask;
+            uint64_t now = PasteWord(dst[w], bits, mask, mode);
+            if (now == dst[w]) continue;
+            m_population += PopCount64(now) - PopCount64(dst[w]);
+            dst[w] = now;
+            MarkDirty((int)(w*64), (int)y);
+        }
+    }
+}
+
+void PackedUniverse::CopyTo(UniverseSnapshot& snap, int64_t x0, int64_t y0, int w, int h) const {
+    if (x0==0 && y0==0 && w==m_width && h==m_height) {
+        // the common whole-board case is a straight copy
+        snap.width = w; snap.height = h; snap.stride = m_stride;
+        snap.cells.resize((size_t)m_stride*h);
+        for (int y=0; y<h; ++y) std::copy(Row(y), Row(y) + m_stride, snap.Row(y));
+        snap.states.clear();
+        return;
+    }
+    snap.Reset(w, h);
+    for (int y=0; y<h; ++y) {
+        int64_t sy = y0 + y;
+        if (sy<0 || sy>=m_height) continue;
+        const uint64_t* src = Row((int)sy);
+        uint64_t* dst = snap.Row(y);
+        for (int i=0; i<snap.stride; ++i)
+            dst[i] = ReadBits64(src, m_stride, x0 + 64*i) & ColumnMask(i, 0, w);
+    }
+}
+
+void PackedUniverse::CopyDensity(UniverseSnapshot& snap, int64_t x0, int64_t y0, int w, int h, int shift) const {
+    snap.width = w; snap.height = h; snap.stride = 0;
+    snap.cells.clear();
+    std::vector<uint64_t>& counts = DensityCounts(snap, w, h);
+    // only the part of the board inside the window is visited
+    int64_t ya = std::max<int64_t>(y0, 0), yb = std::min<int64_t>(y0 + ((int64_t)h << shift), m_height);
+    int64_t xa = std::max<int64_t>(x0, 0), xb = std::min<int64_t>(x0 + ((int64_t)w << shift), m_width);
+    if (xa < xb) {
+        for (int64_t y=ya; y<yb; ++y) {
+            const uint64_t* src = Row((int)y);
+            uint64_t* row = &counts[(size_t)((y - y0) >> shift) * w];
+            for (int64_t i = xa>>6; i <= (xb-1)>>6; ++i) CountBits64(src[i], i*64, x0, shift, row, w);
+        }
+    }
+    StoreDensity(snap, shift);
+}
+
+// dst is src with columns [0, width) in the opposite order; the two must
+// not overlap.
+static void ReverseRow(const uint64_t* src, uint64_t* dst, int stride, int width) {
+    const int pad = stride*64 - width;
+    for (int i=0; i<stride; ++i) dst[i] = ReverseBits64(src[stride-1-i]);
+    if (!pad) return;
+    // the padding bits came out at the bottom of the first word
+    for (int i=0; i<stride; ++i) dst[i] = (dst[i] >> pad) | (i+1<stride ? dst[i+1] << (64-pad) : 0);
+}
+
+// Only m_cells' ghost rows are read, so m_next's are left alone.
+template <Boundary B>
+void PackedUniverse::RefreshGhostRows() {
+    uint64_t* above = Row(-1);
+    uint64_t* below = Row(m_height);
+    const uint64_t* top = Row(0);
+    const uint64_t* bottom = Row(m_height-1);
+    if constexpr (B == Boundary::Toroidal) {
+        std::copy(bottom, bottom + m_stride, above);
+        std::copy(top, top + m_stride, below);
+    } else if constexpr (B == Boundary::KleinBottle) {
+        ReverseRow(bottom, above, m_stride, m_width);
+        ReverseRow(top, below, m_stride, m_width);
+    } else if constexpr (B == Boundary::Mirror) {
+        std::copy(top, top + m_stride, above);
+        std::copy(bottom, bottom + m_stride, below);
+    } else {
+        std::fill(above, above + m_stride, 0);
+        std::fill(below, below + m_stride, 0);
+    }
+}
+
+template <Boundary B>
+void PackedUniverse::HorizontalPairs(const uint64_t* row, uint64_t* x, uint64_t* a, int begin, int end) const {
+    const int last = m_stride-1;
+    // the cells just past the left and right edges
+    const int right = (m_width-1) & 63;
+    uint64_t wrapW = 0, wrapE = 0;
+    if constexpr (B == Boundary::Toroidal || B == Boundary::KleinBottle) {
+        wrapW = (row[last] >> right) & 1;
+        wrapE = (row[0] & 1) << right;
+    } else if constexpr (B == Boundary::Mirror) {
+        wrapW = row[0] & 1;
+        wrapE = row[last] & (uint64_t(1) << right);
+    }
+    auto edge = [&](int i) {
+        uint64_t w = row[i];
+        uint64_t west = (w << 1) | (i>0 ? row[i-1] >> 63 : wrapW);
+        uint64_t east = (w >> 1) | (i<last ? row[i+1] << 63 : wrapE);
+        if (i==last) west &= LastWordMask();
+        x[i] = west ^ east;
+        a[i] = west & east;
+    };
+    // the first and last words are done apart, so the loop between them has
+    // no edge cases and vectorizes
+    if (begin==0) edge(0);
+    for (int i=std::max(begin, 1); i<std::min(end, last); ++i) {
+        uint64_t w = row[i];
+        uint64_t west = (w << 1) | (row[i-1] >> 63);
+        uint64_t east = (w >> 1) | (row[i+1] << 63);
+        x[i] = west ^ east;
+        a[i] = west & east;
+    }
+    if (end==m_stride && last>0) edge(last);
+}
+
+// Computes words [begin, end) of rows [y0, y1) into m_next. Returns, per
+// word, how many cells were born and died, and whether anything changed
+// against the generation before the current one, which m_next still holds.
+template <Boundary B>
+void PackedUniverse::StepRows(int y0, int y1, int begin, int end, uint64_t* scratch) {
+    if (y0>=y1 || begin>=end) return;
+    // three rolling (x, a) pairs: above, centre, below
+    uint64_t* xs[3] = { scratch, scratch + 2*m_pitch, scratch + 4*m_pitch };
+    uint64_t* as[3] = { scratch + m_pitch, scratch + 3*m_pitch, scratch + 5*m_pitch };
+    uint64_t* acc2 = scratch + 6*m_pitch;
+    uint64_t* born = scratch + 7*m_pitch;
+    uint64_t* died = scratch + 8*m_pitch;
+    const uint64_t* cs[3];
+    for (int k=0; k<3; ++k) {
+        cs[k] = Row(y0-1+k);
+        HorizontalPairs<B>(cs[k], xs[k], as[k], begin, end);
+    }
+    int top=0;
+    for (int y=y0; y<y1; ++y) {
+        int mid=(top+1)%3, bot=(top+2)%3;
+        RowInputs in = { xs[top], as[top], cs[top], xs[mid], as[mid], cs[mid], xs[bot], as[bot], cs[bot] };
+        RowOutputs out = { &m_next[(size_t)(y+1)*m_pitch], acc2, born, died };
+        if (end<m_stride) {
+            m_kernels->combineRow(in, out, begin, end, m_rule);
+        } else {
+            // the last word gets its padding bits cleared before it is compared
+            m_kernels->combineRow(in, out, begin, end-1, m_rule);
+            const int i = end-1;
+            uint64_t r = m_kernels->nextWord(in, i, m_rule) & LastWordMask();
+            acc2[i] |= r ^ out.next[i];
+            born[i] += PopCount64(r & ~in.cM[i]);
+            died[i] += PopCount64(in.cM[i] & ~r);
+            out.next[i] = r;
+        }
+        if (y+1<y1) {
+            // the old top row becomes the new bottom row
+            cs[top] = Row(y+2);
+            HorizontalPairs<B>(cs[top], xs[top], as[top], begin, end);
+            top = mid;
+        }
+    }
+}
+
+// Steps the tile bands [b0, b1), computing only runs of active tiles and
+// updating the change flags and cached hashes of every tile in them.
+template <Boundary B>
+void PackedUniverse::StepBands(int b0, int b1, uint64_t* scratch) {
+    uint64_t* acc2 = scratch + 6*m_pitch;
+    uint64_t* born = scratch + 7*m_pitch;
+    uint64_t* died = scratch + 8*m_pitch;
+    for (int b=b0; b<b1; ++b) {
+        const uint8_t* active = &m_tileActive[(size_t)b*m_stride];
+        uint8_t* flags = &m_tileFlags[(size_t)b*m_stride];
+        uint16_t* births = &m_tileBirths[(size_t)b*m_stride];
+        uint16_t* deaths = &m_tileDeaths[(size_t)b*m_stride];
+        uint64_t* tileHash = &m_tileHash[(size_t)b*m_stride];
+        uint64_t* tileHash2 = &m_tileHash2[(size_t)b*m_stride];
+        uint8_t* hashed = &m_tileHashed[(size_t)b*m_stride];
+        int y0 = b*kTileRows, y1 = std::min(m_height, y0 + kTileRows);
+        for (int i=0; i<m_stride; ) {
+            if (!active[i]) {
+                // unchanged against two generations ago by construction, so
+                // this step undoes the last one (or both changed nothing)
+                flags[i] &= kTileChanged1;
+                std::swap(births[i], deaths[i]);
+                std::swap(tileHash[i], tileHash2[i]);
+                hashed[i] = (uint8_t)(((hashed[i] & 1) << 1) | (hashed[i] >> 1));
+                ++i;
+                continue;
+            }
+            int end = i;
+            while (end<m_stride && active[end]) ++end;
+            std::fill(acc2+i, acc2+end, 0);
+            std::fill(born+i, born+end, 0);
+            std::fill(died+i, died+end, 0);
+            StepRows<B>(y0, y1, i, end, scratch);
+            for (; i<end; ++i) {
+                tileHash2[i] = tileHash[i];
+                hashed[i] = (uint8_t)((hashed[i] & 1) << 1);
+                births[i] = (uint16_t)born[i];
+                deaths[i] = (uint16_t)died[i];
+                uint8_t f = (born[i] || died[i] ? kTileChanged1 : 0) | (acc2[i] ? kTileChanged2 : 0);
+                if (flags[i] & kTileEdited) f |= kTileChanged2;
+                flags[i] = f;
+            }
+        }
+    }
+}
+
+// A tile must be computed unless all nine tiles around it are unchanged
+// since the last generation, or all are unchanged since the one before.
+// Past a mirror edge a tile only sees itself. Past the top or bottom of a
+// Klein bottle it sees the opposite row of tiles flipped, where the words
+// its columns land in are the one holding its mirror image and the one
+// either side.
+template <Boundary B>
+void PackedUniverse::FindActiveTiles() {
+    constexpr bool wraps = B == Boundary::Toroidal || B == Boundary::KleinBottle;
+    const int rows = TileRows(), cols = m_stride;
+    // OR of the flags over each tile's row of three, then over the column
+    for (int ty=0; ty<rows; ++ty) {
+        const uint8_t* f = &m_tileFlags[(size_t)ty*cols];
+        uint8_t* o = &m_tileOr[(size_t)ty*cols];
+        for (int tx=0; tx<cols; ++tx) {
+            uint8_t v = f[tx];
+            if (tx>0) v |= f[tx-1]; else if (wraps) v |= f[cols-1];
+            if (tx+1<cols) v |= f[tx+1]; else if (wraps) v |= f[0];
+            o[tx] = v;
+        }
+    }
+    m_activeTiles = 0;
+    for (int ty=0; ty<rows; ++ty) {
+        const uint8_t* above = ty>0 ? &m_tileOr[(size_t)(ty-1)*cols] : (wraps ? &m_tileOr[(size_t)(rows-1)*cols] : nullptr);
+        const uint8_t* below = ty+1<rows ? &m_tileOr[(size_t)(ty+1)*cols] : (wraps ? &m_tileOr[0] : nullptr);
+        const uint8_t* o = &m_tileOr[(size_t)ty*cols];
+        uint8_t* active = &m_tileActive[(size_t)ty*cols];
+        const bool flipAbove = B == Boundary::KleinBottle && ty == 0;
+        const bool flipBelow = B == Boundary::KleinBottle && ty+1 == rows;
+        for (int tx=0; tx<cols; ++tx) {
+            const int flipped = (m_width-1 - 64*tx) >> 6;
+            uint8_t v = o[tx] | (above ? above[flipAbove ? flipped : tx] : 0) | (below ? below[flipBelow ? flipped : tx] : 0);
+            active[tx] = (v & (kTileChanged1|kTileChanged2)) == (kTileChanged1|kTileChanged2);
+            m_activeTiles += active[tx];
+        }
+    }
+}
+
+// The boundary is only looked at here, to pick the step specialized for it.
+uint64_t PackedUniverse::Step() {
+    if (m_width<=0 || m_height<=0) return 1;
+    switch (m_boundary) {
+    case Boundary::Toroidal: StepWith<Boundary::Toroidal>(); break;
+    case Boundary::KleinBottle: StepWith<Boundary::KleinBottle>(); break;
+    case Boundary::Mirror: StepWith<Boundary::Mirror>(); break;
+    default: StepWith<Boundary::Finite>(); break;
+    }
+    m_cells.swap(m_next);
+    m_births = m_deaths = 0;
+    for (size_t t=0; t<m_tileBirths.size(); ++t) {
+        m_births += m_tileBirths[t];
+        m_deaths += m_tileDeaths[t];
+    }
+    m_population += m_births - m_deaths;
+    return 1;
+}
+
+template <Boundary B>
+void PackedUniverse::StepWith() {
+    FindActiveTiles<B>();
+    RefreshGhostRows<B>();
+    const int bands = TileRows();
+    int stripes = 1;
+    if (m_pool && m_pool->GetThreadCount()>1 && m_activeTiles*kTileRows >= kParallelMinWords)
+        stripes = std::max(1, std::min(m_pool->GetThreadCount()*kStripesPerThread, bands));
+    size_t scratchWords = (size_t)m_pitch*kScratchRows;
+    if (m_scratch.size() < scratchWords*stripes) m_scratch.resize(scratchWords*stripes);
+
+    if (stripes==1) {
+        StepBands<B>(0, bands, m_scratch.data());
+    } else {
+        // Stripes are whole tile bands and only write their own rows of
+        // m_next and their own tile flags. The halo rows just outside a
+        // stripe (and the ghost rows at the top/bottom edge) are read
+        // straight from m_cells, which nobody modifies during the step.
+        m_pool->Run(stripes, [this, stripes, bands](int s) {
+            size_t words = (size_t)m_pitch*kScratchRows;
+            StepBands<B>((int)((int64_t)bands*s/stripes), (int)((int64_t)bands*(s+1)/stripes),
+                         &m_scratch[words*s]);
+        });
+    }
+}
+
+// ---------------- MultiStateUniverse Impl ----------------
+void MultiStateUniverse::Resize(int w, int h) {
+    m_width = w; m_height = h;
+    m_rowBytes = ((size_t)w*m_bits + 7) / 8;
+    m_cells.assign(m_rowBytes*h, 0);
+    m_next.assign(m_cells.size(), 0);
+    m_population = m_births = m_deaths = 0;
+}
+
+void MultiStateUniverse::Clear() {
+    std::fill(m_cells.begin(), m_cells.end(), 0);
+    m_population = m_births = m_deaths = 0;
+}
+
+void MultiStateUniverse::SetState(int x, int y, int state) {
+    const size_t bit = (size_t)x*m_bits;
+    const int shift = (int)(bit & 7), mask = (1 << m_bits) - 1;
+    uint8_t& b = Row(y)[bit >> 3];
+    const int old = (b >> shift) & mask;
+    m_population += (state == 1) - (old == 1);
+    b = (uint8_t)((b & ~(mask << shift)) | (state << shift));
+}
+
+// Calls fn(x, y, state) for every cell in [x0, x1) x [y0, y1) that isn't
+// dead, skipping whole bytes of dead cells.
+template <class Fn>
+void MultiStateUniverse::ForEachCellIn(int64_t x0, int64_t y0, int64_t x1, int64_t y1, Fn fn) const {
+    x0 = std::max<int64_t>(x0, 0); x1 = std::min<int64_t>(x1, m_width);
+    y0 = std::max<int64_t>(y0, 0); y1 = std::min<int64_t>(y1, m_height);
+    const int perByte = 8 / m_bits;
+    for (int64_t y=y0; y<y1; ++y) {
+        const uint8_t* row = Row((int)y);
+        for (int64_t x=x0; x<x1; ++x) {
+            if (!row[(x*m_bits) >> 3]) { x = (x/perByte + 1)*perByte - 1; continue; }
+            int s = GetState((int)x, (int)y);
+            if (s) fn((int)x, (int)y, s);
+        }
+    }
+}
+
+// Moves the cells into rows of 'bits' per cell, clearing the ones in states
+// at or past 'states'.
+void MultiStateUniverse::Repack(int bits, int states) {
+    const size_t rowBytes = ((size_t)m_width*bits + 7) / 8;
+    AlignedVector<uint8_t> cells(rowBytes*m_height, 0);
+    m_population = 0;
+    ForEachCellIn(0, 0, m_width, m_height, [&](int x, int y, int s) {
+        if (s >= states) return;
+        m_population += s == 1;
+        cells[(size_t)y*rowBytes + ((size_t)x*bits >> 3)] |= (uint8_t)(s << ((x*bits) & 7));
+    });
+    m_bits = bits;
+    m_rowBytes = rowBytes;
+    m_cells.swap(cells);
+    m_next.assign(m_cells.size(), 0);
+}
+
+// The rule becomes tables of the next state: by live-neighbor count for dead
+// and live cells, and by state for dying ones, which just move on.
+bool MultiStateUniverse::SetRule(const LifeRule& rule) {
+    const int bits = BitsForStates(rule.states);
+    if (bits != m_bits || rule.states < m_rule.states) Repack(bits, rule.states);
+    m_rule = rule;
+    const int counts = (2*rule.radius + 1) * (2*rule.radius + 1) - 1;
+    for (int n=0; n<=kMaxCount; ++n) {
+        m_transition[n] = n <= counts && rule.Born(n) ? 1 : 0;
+        m_transition[kMaxCount + 1 + n] = n <= counts && rule.Survives(n) ? 1 : rule.states > 2 ? 2 : 0;
+    }
+    for (int s=0; s<LifeRule::kMaxStates; ++s) m_transition[kDyingBase + s] = (uint8_t)(s + 1 < rule.states ? s + 1 : 0);
+    return true;
+}
+
+// Or and Xor only touch the cells under the block's non-zero states; Xor
+// toggles them as Toggle() does.
+void MultiStateUniverse::Paste(const UniverseSnapshot& snap, int64_t x0, int64_t y0, PasteMode mode) {
+    int64_t ya = std::max<int64_t>(y0, 0), yb = std::min<int64_t>(y0 + snap.height, m_height);
+    int64_t xa = std::max<int64_t>(x0, 0), xb = std::min<int64_t>(x0 + snap.width, m_width);
+    for (int64_t y=ya; y<yb; ++y) {
+        for (int64_t x=xa; x<xb; ++x) {
+            const int sx = (int)(x - x0), sy = (int)(y - y0);
+            int s = snap.states.empty() ? snap.Get(sx, sy) : snap.states[(size_t)sy*snap.width + sx];
+            if (mode == PasteMode::Copy) SetState((int)x, (int)y, s < m_rule.states ? s : 0);
+            else if (s == 0) continue;
+            else if (mode == PasteMode::Or) SetState((int)x, (int)y, s < m_rule.states ? s : 0);
+            else SetState((int)x, (int)y, GetState((int)x, (int)y) == 0);
+        }
+    }
+}
+
+void MultiStateUniverse::CopyTo(UniverseSnapshot& snap, int64_t x0, int64_t y0, int w, int h) const {
+    snap.Reset(w, h);
+    snap.states.assign((size_t)w*h, 0);
+    ForEachCellIn(x0, y0, x0 + w, y0 + h, [&](int x, int y, int s) {
+        snap.states[(size_t)(y - y0)*w + (x - x0)] = (uint8_t)s;
+        if (s == 1) snap.Set((int)(x - x0), (int)(y - y0));
+    });
+}
+
+void MultiStateUniverse::CopyDensity(UniverseSnapshot& snap, int64_t x0, int64_t y0, int w, int h, int shift) const {
+    snap.width = w; snap.height = h; snap.stride = 0;
+    snap.cells.clear();
+    std::vector<uint64_t>& counts = DensityCounts(snap, w, h);
+    ForEachCellIn(x0, y0, x0 + ((int64_t)w << shift), y0 + ((int64_t)h << shift), [&](int x, int y, int s) {
+        if (s == 1) ++counts[(size_t)((y - y0) >> shift)*w + ((x - x0) >> shift)];
+    });
+    StoreDensity(snap, shift);
+}
+
+void MultiStateUniverse::GetStats(EngineStats& stats) const {
+    stats.memoryBytes = m_cells.size() + m_next.size() + m_sums.size()*sizeof(uint16_t);
+    stats.births = m_births;
+    stats.deaths = m_deaths;
+}
+
+// Nothing is cached, so this reads the whole board every time.
+bool MultiStateUniverse::StateHash(uint64_t& hash) {
+    hash = 0;
+    for (size_t i=0; i<m_cells.size(); i+=8) {
+        uint64_t w = 0;
+        std::memcpy(&w, &m_cells[i], std::min<size_t>(8, m_cells.size() - i));
+        if (w) hash ^= WordHash(i >> 3, w);
+    }
+    return true;
+}
+
+// x brought onto [0, n) by wrapping round, or by reflecting it back and
+// forth across the edges.
+static inline int WrapIndex(int x, int n) { return (x % n + n) % n; }
+static inline int ReflectIndex(int x, int n) {
+    const int p = WrapIndex(x, 2*n);
+    return p < n ? p : 2*n-1 - p;
+}
+
+// The board row that row y stands for, which may lie off the board, and
+// whether it is flipped left to right; -1 for a dead one. A radius larger
+// than the board can reach several boards away.
+template <Boundary B>
+int MultiStateUniverse::BoardRow(int y, bool& flipped) const {
+    flipped = false;
+    if (y >= 0 && y < m_height) return y;
+    if constexpr (B == Boundary::Toroidal || B == Boundary::KleinBottle) {
+        const int wrapped = WrapIndex(y, m_height);
+        flipped = B == Boundary::KleinBottle && (((y - wrapped) / m_height) & 1);
+        return wrapped;
+    } else if constexpr (B == Boundary::Mirror) {
+        return ReflectIndex(y, m_height);
+    } else {
+        return -1;
+    }
+}
+
+// The r column sums off each side of the board: wrapped round, reflected or
+// empty.
+template <Boundary B>
+void MultiStateUniverse::EdgeColumns(uint16_t* sums) const {
+    const int r = m_rule.radius, w = m_width;
+    for (int k=0; k<r; ++k) {
+        if constexpr (B == Boundary::Toroidal || B == Boundary::KleinBottle) {
+            sums[k] = sums[r + WrapIndex(k - r, w)];
+            sums[r + w + k] = sums[r + WrapIndex(w + k, w)];
+        } else if constexpr (B == Boundary::Mirror) {
+            sums[k] = sums[r + ReflectIndex(k - r, w)];
+            sums[r + w + k] = sums[r + ReflectIndex(w + k, w)];
+        } else {
+            sums[k] = sums[r + w + k] = 0;
+        }
+    }
+}
+
+// Adds row y's live cells to the column sums, which start r entries in, or
+// with sign -1 takes them away.
+template <Boundary B, int Bits>
+void MultiStateUniverse::AddRow(int y, int sign, uint16_t* sums) const {
+    bool flipped;
+    y = BoardRow<B>(y, flipped);
+    if (y < 0) return;
+    const uint8_t* row = Row(y);
+    uint16_t* col = sums + m_rule.radius;
+    constexpr int perByte = 8 / Bits, mask = (1 << Bits) - 1;
+    if (B == Boundary::KleinBottle && flipped) {
+        // only ever the r rows nearest the top and bottom edges
+        for (int x=0; x<m_width; ++x) col[m_width-1 - x] += sign * (GetState(x, y) == 1);
+        return;
+    }
+    // Whole bytes straight through without tests, which the compiler can
+    // vectorize; a part-filled last byte stops at the board's edge, since
+    // the sums are only as wide as the board and its margins.
+    const int whole = m_width / perByte;
+    for (int i=0; i<whole; ++i) {
+        const unsigned b = row[i];
+        for (int k=0; k<perByte; ++k) col[i*perByte + k] += sign * (((b >> (k * Bits)) & mask) == 1);
+    }
+    const unsigned last = whole < (int)m_rowBytes ? row[whole] : 0;
+    for (int k=0; k<m_width - whole*perByte; ++k) col[whole*perByte + k] += sign * (((last >> (k * Bits)) & mask) == 1);
+}
+
+// Rows [y0, y1) into m_next. The column sums are built up for the first
+// row, then each row after it moves them down by one.
+template <Boundary B, int Bits>
+void MultiStateUniverse::StepRows(int y0, int y1, uint16_t* sums, uint64_t& births, uint64_t& deaths) {
+    const int r = m_rule.radius, w = m_width;
+    constexpr int perByte = 8 / Bits, mask = (1 << Bits) - 1;
+    std::fill(sums, sums + w + 2*r + 1, 0);
+    for (int dy=-r; dy<=r; ++dy) AddRow<B, Bits>(y0 + dy, 1, sums);
+    for (int y=y0; y<y1; ++y) {
+        EdgeColumns<B>(sums);
+        const uint8_t* cur = Row(y);
+        uint8_t* next = &m_next[(size_t)y*m_rowBytes];
+        int count = 0; // live cells in the window around x, x's own included
+        for (int k=0; k<=2*r; ++k) count += sums[k];
+        // Masks rather than branches, since on a busy board which kind of
+        // cell comes next is anybody's guess. Everything the loop reads is
+        // local, or the byte stores would make the compiler reload it, and
+        // each byte is put together before it is stored.
+        const uint8_t* transition = m_transition;
+        const uint16_t* leaving = sums;
+        const uint16_t* entering = sums + 2*r + 1;
+        uint64_t born = 0, died = 0;
+        for (int x0=0; x0<w; x0+=perByte) {
+            const int n = std::min(perByte, w - x0);
+            unsigned in = cur[x0 / perByte], out = 0;
+            for (int k=0; k<n; ++k, in >>= Bits) {
+                const int s = in & mask, live = s == 1, dying = Bits > 1 ? -(s > 1) : 0;
+                const int t = transition[((live*(kMaxCount + 1) + count - live) & ~dying) | ((kDyingBase + s) & dying)];
+                born += (s == 0) & t;
+                died += live & (t != 1);
+                out |= t << (k * Bits);
+                count += entering[x0 + k] - leaving[x0 + k];
+            }
+            next[x0 / perByte] = (uint8_t)out;
+        }
+        births += born;
+        deaths += died;
+        if (y + 1 < y1) {
+            AddRow<B, Bits>(y + r + 1, 1, sums);
+            AddRow<B, Bits>(y - r, -1, sums);
+        }
+    }
+}
+
+template <Boundary B>
+void MultiStateUniverse::StepBoundary(int y0, int y1, uint16_t* sums, uint64_t& births, uint64_t& deaths) {
+    switch (m_bits) {
+    case 1: StepRows<B, 1>(y0, y1, sums, births, deaths); break;
+    case 4: StepRows<B, 4>(y0, y1, sums, births, deaths); break;
+    default: StepRows<B, 8>(y0, y1, sums, births, deaths); break;
+    }
+}
+
+void MultiStateUniverse::StepStripe(int y0, int y1, uint16_t* sums, uint64_t& births, uint64_t& deaths) {
+    switch (m_boundary) {
+    case Boundary::Toroidal: StepBoundary<Boundary::Toroidal>(y0, y1, sums, births, deaths); break;
+    case Boundary::KleinBottle: StepBoundary<Boundary::KleinBottle>(y0, y1, sums, births, deaths); break;
+    case Boundary::Mirror: StepBoundary<Boundary::Mirror>(y0, y1, sums, births, deaths); break;
+    default: StepBoundary<Boundary::Finite>(y0, y1, sums, births, deaths); break;
+    }
+}
+
+// A cell costs here about what a whole word costs the packed engine, so the
+// same threshold in cells decides when stripes are worth it.
+uint64_t MultiStateUniverse::Step() {
+    if (m_width<=0 || m_height<=0) return 1;
+    int stripes = 1;
+    if (m_pool && m_pool->GetThreadCount()>1 && (size_t)m_width*m_height >= kParallelMinWords)
+        stripes = std::max(1, std::min(m_pool->GetThreadCount()*kStripesPerThread, m_height));
+    const size_t span = (size_t)m_width + 2*m_rule.radius + 1;
+    if (m_sums.size() < span*stripes) m_sums.resize(span*stripes);
+    m_stripeBirths.assign(stripes, 0);
+    m_stripeDeaths.assign(stripes, 0);
+    if (stripes==1) {
+        StepStripe(0, m_height, m_sums.data(), m_stripeBirths[0], m_stripeDeaths[0]);
+    } else {
+        // every stripe builds its own column sums from m_cells, which
+        // nobody writes during the step
+        m_pool->Run(stripes, [this, stripes, span](int s) {
+            StepStripe((int)((int64_t)m_height*s/stripes), (int)((int64_t)m_height*(s+1)/stripes),
+                       &m_sums[span*s], m_stripeBirths[s], m_stripeDeaths[s]);
+        });
+    }
+    m_cells.swap(m_next);
+    m_births = m_deaths = 0;
+    for (int s=0; s<stripes; ++s) {
+        m_births += m_stripeBirths[s];
+        m_deaths += m_stripeDeaths[s];
+    }
+    m_population += m_births - m_deaths;
+    return 1;
+}
+
+// ---------------- HashLifeUniverse Impl ----------------
+static inline uint64_t SaturatingAdd(uint64_t a, uint64_t b) {
+    return (a + b < a) ? ~uint64_t(0) : a + b;
+}
+
+static inline size_t HashLeaf(uint64_t bits) {
+    bits ^= bits >> 33; bits *= 0xFF51AFD7ED558CCDULL; bits ^= bits >> 33;
+    return (size_t)bits;
+}
+
+static inline size_t HashChildren(uint32_t nw, uint32_t ne, uint32_t sw, uint32_t se) {
+    uint64_t h = nw;
+    h = h*0x9E3779B97F4A7C15ULL + ne;
+    h = h*0x9E3779B97F4A7C15ULL + sw;
+    h = h*0x9E3779B97F4A7C15ULL + se;
+    return HashLeaf(h);
+}
+
+void HashLifeUniverse::Reset() {
+    m_nodes.assign(1, Node());
+    m_nodes[0].level = 0;
+    m_free.clear();
+    m_buckets.assign(1024, 0);
+    m_empty.assign(kMaxLevel+1, 0);
+    m_liveNodes = 0;
+    if (!m_maxNodes) SetMaxMemory(size_t(512) << 20);
+    m_root = Empty(kLeafLevel+1);
+}
+
+void HashLifeUniverse::SetMaxMemory(size_t bytes) {
+    m_maxNodes = std::max<size_t>(bytes / sizeof(Node), 1 << 16);
+}
+
+HashLifeUniverse::NodeId HashLifeUniverse::NewNode() {
+    if (!m_free.empty()) { NodeId id = m_free.back(); m_free.pop_back(); return id; }
+    m_nodes.push_back(Node());
+    return (NodeId)(m_nodes.size()-1);
+}
+
+void HashLifeUniverse::Insert(NodeId id, size_t hash) {
+    size_t b = hash & (m_buckets.size()-1);
+    m_nodes[id].next = m_buckets[b];
+    m_buckets[b] = id;
+}
+
+void HashLifeUniverse::Rehash(size_t buckets) {
+    m_buckets.assign(buckets, 0);
+    for (NodeId id=1; id<m_nodes.size(); ++id) {
+        const Node& n = m_nodes[id];
+        if (!n.level) continue;
+        Insert(id, n.level==kLeafLevel ? HashLeaf(n.bits) : HashChildren(n.child[0], n.child[1], n.child[2], n.child[3]));
+    }
+}
+
+HashLifeUniverse::NodeId HashLifeUniverse::Leaf(uint64_t bits) {
+    size_t h = HashLeaf(bits);
+    for (NodeId id = m_buckets[h & (m_buckets.size()-1)]; id; id = m_nodes[id].next)
+        if (m_nodes[id].level==kLeafLevel && m_nodes[id].bits==bits) return id;
+    NodeId id = NewNode();
+    Node& n = m_nodes[id];
+    n.bits = bits;
+    n.population = PopCount64(bits);
+    n.result = 0; n.resultExp = 0; n.mark = false;
+    n.level = kLeafLevel;
+    Insert(id, h);
+    if (++m_liveNodes > m_buckets.size()) Rehash(m_buckets.size()*2);
+    return id;
+}
+
+HashLifeUniverse::NodeId HashLifeUniverse::Join(NodeId nw, NodeId ne, NodeId sw, NodeId se) {
+    uint8_t level = m_nodes[nw].level + 1;
+    size_t h = HashChildren(nw, ne, sw, se);
+    for (NodeId id = m_buckets[h & (m_buckets.size()-1)]; id; id = m_nodes[id].next) {
+        const Node& n = m_nodes[id];
+        if (n.level==level && n.child[0]==nw && n.child[1]==ne && n.child[2]==sw && n.child[3]==se) return id;
+    }
+    uint64_t pop = SaturatingAdd(SaturatingAdd(m_nodes[nw].population, m_nodes[ne].population),
+                                 SaturatingAdd(m_nodes[sw].population, m_nodes[se].population));
+    NodeId id = NewNode(); // may reallocate m_nodes
+    Node& n = m_nodes[id];
+    n.child[0] = nw; n.child[1] = ne; n.child[2] = sw; n.child[3] = se;
+    n.population = pop;
+    n.result = 0; n.resultExp = 0; n.mark = false;
+    n.level = level;
+    Insert(id, h);
+    if (++m_liveNodes > m_buckets.size()) Rehash(m_buckets.size()*2);
+    return id;
+}
+
+HashLifeUniverse::NodeId HashLifeUniverse::Empty(int level) {
+    if (!m_empty[level]) {
+        if (level==kLeafLevel) m_empty[level] = Leaf(0);
+        else { NodeId e = Empty(level-1); m_empty[level] = Join(e, e, e, e); }
+    }
+    return m_empty[level];
+}
+
+// Lays out a level-4 node (four leaves) as 16 rows of 16 bits.
+void HashLifeUniverse::Assemble16(NodeId n, uint32_t rows[16]) const {
+    uint64_t q[4];
+    for (int i=0; i<4; ++i) q[i] = m_nodes[Child(n, i)].bits;
+    for (int y=0; y<8; ++y) {
+        rows[y]   = (uint32_t)((q[0] >> (8*y)) & 0xFF) | (uint32_t)((q[1] >> (8*y)) & 0xFF) << 8;
+        rows[y+8] = (uint32_t)((q[2] >> (8*y)) & 0xFF) | (uint32_t)((q[3] >> (8*y)) & 0xFF) << 8;
+    }
+}
+
+static inline uint64_t CentreBits16(const uint32_t rows[16]) {
+    uint64_t bits = 0;
+    for (int y=0; y<8; ++y) bits |= (uint64_t)((rows[y+4] >> 4) & 0xFF) << (8*y);
+    return bits;
+}
+
+HashLifeUniverse::NodeId HashLifeUniverse::Centre(NodeId n) {
+    if (Level(n) == kLeafLevel+1) {
+        uint32_t rows[16];
+        Assemble16(n, rows);
+        return Leaf(CentreBits16(rows));
+    }
+    NodeId nw = Child(n,0), ne = Child(n,1), sw = Child(n,2), se = Child(n,3);
+    return Join(Child(nw,3), Child(ne,2), Child(sw,1), Child(se,0));
+}
+
+HashLifeUniverse::NodeId HashLifeUniverse::Expand(NodeId n) {
+    NodeId e = Empty(Level(n)-1);
+    NodeId nw = Child(n,0), ne = Child(n,1), sw = Child(n,2), se = Child(n,3);
+    NodeId a = Join(e, e, e, nw);
+    NodeId b = Join(e, e, ne, e);
+    NodeId c = Join(e, sw, e, e);
+    NodeId d = Join(se, e, e, e);
+    return Join(a, b, c, d);
+}
+
+// True if every live cell of n (level >= 5) is in its centre quarter.
+bool HashLifeUniverse::IsCentred(NodeId n) const {
+    for (int q=0; q<4; ++q) {
+        NodeId c = Child(n, q);
+        if (m_nodes[c].population != m_nodes[Child(c, 3-q)].population) return false;
+    }
+    return true;
+}
+
+// Base case: the centre 8x8 of a 16x16 node after 1, 2 or 4 generations,
+// brute-forced with the packed engine's row kernel. Each of the 16 rows is
+// one word here, so a single call to it computes all the inner rows.
+HashLifeUniverse::NodeId HashLifeUniverse::LeafResult(NodeId n, int gens) {
+    uint32_t rows[16];
+    Assemble16(n, rows);
+    uint64_t cs[16], xs[16], as[16], next[16] = {0}, changed[14] = {0}, born[14] = {0}, died[14] = {0};
+    std::copy(rows, rows+16, cs);
+    const RowInputs in = { xs, as, cs, xs+1, as+1, cs+1, xs+2, as+2, cs+2 };
+    const RowOutputs out = { next+1, changed, born, died };
+    for (int g=0; g<gens; ++g) {
+        for (int y=0; y<16; ++y) {
+            uint64_t west = (cs[y] << 1) & 0xFFFF, east = cs[y] >> 1;
+            xs[y] = west ^ east; as[y] = west & east;
+        }
+        // the outermost ring goes stale each generation; only the centre is kept
+        m_kernels->combineRow(in, out, 0, 14, m_rule);
+        std::copy(next, next+16, cs);
+    }
+    for (int y=0; y<16; ++y) rows[y] = (uint32_t)cs[y];
+    return Leaf(CentreBits16(rows));
+}
+
+// The centre of n (one level down) advanced 2^exp generations, exp <= level-2.
+HashLifeUniverse::NodeId HashLifeUniverse::Result(NodeId n, int exp) {
+    ++m_lookups;
+    if (m_nodes[n].result && m_nodes[n].resultExp == exp) { ++m_hits; return m_nodes[n].result; }
+
+    const int level = Level(n);
+    NodeId res;
+    if (m_nodes[n].population == 0) {
+        res = Empty(level-1);
+    } else if (level == kLeafLevel+1) {
+        res = LeafResult(n, 1 << exp);
+    } else {
+        NodeId nw = Child(n,0), ne = Child(n,1), sw = Child(n,2), se = Child(n,3);
+        // nine overlapping sub-squares one level down
+        NodeId s[9] = {
+            nw,
+            Join(Child(nw,1), Child(ne,0), Child(nw,3), Child(ne,2)),
+            ne,
+            Join(Child(nw,2), Child(nw,3), Child(sw,0), Child(sw,1)),
+            Join(Child(nw,3), Child(ne,2), Child(sw,1), Child(se,0)),
+            Join(Child(ne,2), Child(ne,3), Child(se,0), Child(se,1)),
+            sw,
+            Join(Child(sw,1), Child(se,0), Child(sw,3), Child(se,2)),
+            se
+        };
+        // full speed advances each half of the way; slower steps only take centres
+        const bool full = (exp == level-2);
+        for (int i=0; i<9; ++i) s[i] = full ? Result(s[i], level-3) : Centre(s[i]);
+        const int sub = full ? level-3 : exp;
+        NodeId a = Result(Join(s[0], s[1], s[3], s[4]), sub);
+        NodeId b = Result(Join(s[1], s[2], s[4], s[5]), sub);
+        NodeId c = Result(Join(s[3], s[4], s[6], s[7]), sub);
+        NodeId d = Result(Join(s[4], s[5], s[7], s[8]), sub);
+        res = Join(a, b, c, d);
+    }
+    m_nodes[n].result = res;
+    m_nodes[n].resultExp = (uint8_t)exp;
+    return res;
+}
+
+uint64_t HashLifeUniverse::Step() {
+    const int exp = m_stepExponent;
+    // Pad until the pattern sits in the centre quarter with room to spare:
+    // in 2^exp generations it can grow by at most 2^exp cells per side.
+    while (Level(m_root) < std::max(kLeafLevel+2, exp+3) || !IsCentred(m_root)) {
+        if (Level(m_root) >= kMaxLevel) return 0;
+        m_root = Expand(m_root);
+    }
+    if (Level(m_root) >= kMaxLevel) return 0;
+    m_root = Result(Expand(m_root), exp);
+    while (Level(m_root) > kLeafLevel+2 && IsCentred(m_root)) m_root = Centre(m_root);
+    if (m_liveNodes > m_maxNodes) CollectGarbage();
+    return uint64_t(1) << exp;
+}
+
+void HashLifeUniverse::Mark(NodeId n) {
+    Node& node = m_nodes[n];
+    if (node.mark) return;
+    node.mark = true;
+    if (node.level > kLeafLevel)
+        for (int q=0; q<4; ++q) Mark(node.child[q]);
+}
+
+// Frees every node not reachable from the root. Memoized results are not
+// followed, so the cache is what gets trimmed; results that pointed at freed
+// nodes are forgotten.
+void HashLifeUniverse::CollectGarbage() {
+    Mark(m_root);
+    for (NodeId e : m_empty) if (e) Mark(e);
+    for (NodeId id=1; id<m_nodes.size(); ++id) {
+        Node& n = m_nodes[id];
+        if (n.level && !n.mark) { n.level = 0; m_free.push_back(id); --m_liveNodes; }
+    }
+    for (NodeId id=1; id<m_nodes.size(); ++id) {
+        Node& n = m_nodes[id];
+        if (n.result && !m_nodes[n.result].mark) n.result = 0;
+    }
+    for (Node& n : m_nodes) n.mark = false;
+    Rehash(m_buckets.size());
+}
+
+void HashLifeUniverse::GetStats(EngineStats& stats) const {
+    stats.nodes = m_liveNodes;
+    stats.memoryBytes = m_nodes.capacity()*sizeof(Node) + (m_buckets.capacity() + m_free.capacity())*sizeof(NodeId);
+    stats.cacheLookups = m_lookups;
+    stats.cacheHits = m_hits;
+}
+
+// Memoized results were worked out under the old rule. The empty node's
+// result is only ever empty because B0 rules are refused.
+bool HashLifeUniverse::SetRule(const LifeRule& rule) {
+    if (rule.NeedsBoundedBoard()) return false;
+    if (rule == m_rule) return true;
+    m_rule = rule;
+    m_kernels = KernelsForRule(rule);
+    for (Node& n : m_nodes) { n.result = 0; n.resultExp = 0; }
+    return true;
+}
+
+bool HashLifeUniverse::Get(int64_t x, int64_t y) const {
+    int64_t half = RootHalf();
+    if (x < -half || x >= half || y < -half || y >= half) return false;
+    NodeId n = m_root;
+    int64_t ox = -half, oy = -half;
+    while (Level(n) > kLeafLevel) {
+        if (!m_nodes[n].population) return false;
+        int64_t h = int64_t(1) << (Level(n)-1);
+        int q = 0;
+        if (x >= ox+h) { ox += h; q |= 1; }
+        if (y >= oy+h) { oy += h; q |= 2; }
+        n = Child(n, q);
+    }
+    return (m_nodes[n].bits >> ((y-oy)*8 + (x-ox))) & 1;
+}
+
+bool HashLifeUniverse::EnsureContains(int64_t x0, int64_t y0, int64_t x1, int64_t y1) {
+    for (;;) {
+        int64_t half = RootHalf();
+        if (x0 >= -half && y0 >= -half && x1 <= half && y1 <= half) return true;
+        if (Level(m_root) >= kMaxLevel) return false;
+        m_root = Expand(m_root);
+    }
+}
+
+// Replaces the masked bits of the leaf at (lx, ly) inside node n at (ox, oy).
+HashLifeUniverse::NodeId HashLifeUniverse::SetLeaf(NodeId n, int64_t ox, int64_t oy, int64_t lx, int64_t ly,
+                                                   uint64_t bits, uint64_t mask, PasteMode mode) {
+    if (Level(n) == kLeafLevel) {
+        uint64_t old = m_nodes[n].bits;
+        uint64_t now = PasteWord(old, bits & mask, mask, mode);
+        return now==old ? n : Leaf(now);
+    }
+    int64_t h = int64_t(1) << (Level(n)-1);
+    int q = 0;
+    if (lx >= ox+h) { ox += h; q |= 1; }
+    if (ly >= oy+h) { oy += h; q |= 2; }
+    NodeId c[4] = { Child(n,0), Child(n,1), Child(n,2), Child(n,3) };
+    NodeId updated = SetLeaf(c[q], ox, oy, lx, ly, bits, mask, mode);
+    if (updated == c[q]) return n;
+    c[q] = updated;
+    return Join(c[0], c[1], c[2], c[3]);
+}
+
+void HashLifeUniverse::Set(int64_t x, int64_t y, bool alive) {
+    if (!EnsureContains(x, y, x+1, y+1)) return;
+    int64_t lx = x & ~int64_t(7), ly = y & ~int64_t(7);
+    uint64_t bit = uint64_t(1) << ((y-ly)*8 + (x-lx));
+    m_root = SetLeaf(m_root, -RootHalf(), -RootHalf(), lx, ly, alive ? bit : 0, bit);
+}
+
+void HashLifeUniverse::Paste(const UniverseSnapshot& snap, int64_t x0, int64_t y0, PasteMode mode) {
+    if (snap.width<=0 || snap.height<=0) return;
+    const int64_t x1 = x0 + snap.width, y1 = y0 + snap.height;
+    if (!EnsureContains(x0, y0, x1, y1)) return;
+    const int64_t half = RootHalf();
+    for (int64_t ly = y0 & ~int64_t(7); ly < y1; ly += 8) {
+        for (int64_t lx = x0 & ~int64_t(7); lx < x1; lx += 8) {
+            uint64_t bits = 0, mask = 0;
+            uint64_t rowMask = ColumnMask(0, x0-lx, x1-lx) & 0xFF;
+            for (int r=0; r<8; ++r) {
+                int64_t sy = ly + r - y0;
+                if (sy<0 || sy>=snap.height) continue;
+                bits |= (ReadBits64(snap.Row((int)sy), snap.stride, lx - x0) & 0xFF) << (8*r);
+                mask |= rowMask << (8*r);
+            }
+            // blank leaves change nothing unless copying over the board
+            if (mode != PasteMode::Copy && !bits) continue;
+            m_root = SetLeaf(m_root, -half, -half, lx, ly, bits, mask, mode);
+        }
+    }
+}
+
+void HashLifeUniverse::CopyNode(NodeId n, int64_t ox, int64_t oy, UniverseSnapshot& snap, int64_t x0, int64_t y0) const {
+    const Node& node = m_nodes[n];
+    if (!node.population) return;
+    int64_t size = int64_t(1) << node.level;
+    if (ox >= x0 + snap.width || oy >= y0 + snap.height || ox + size <= x0 || oy + size <= y0) return;
+    if (node.level == kLeafLevel) {
+        for (int r=0; r<8; ++r) {
+            uint64_t row = (node.bits >> (8*r)) & 0xFF;
+            int64_t sy = oy + r - y0;
+            if (!row || sy<0 || sy>=snap.height) continue;
+            for (int c=0; c<8; ++c) {
+                int64_t sx = ox + c - x0;
+                if (((row >> c) & 1) && sx>=0 && sx<snap.width) snap.Set((int)sx, (int)sy);
+            }
+        }
+        return;
+    }
+    int64_t h = size/2;
+    CopyNode(node.child[0], ox,   oy,   snap, x0, y0);
+    CopyNode(node.child[1], ox+h, oy,   snap, x0, y0);
+    CopyNode(node.child[2], ox,   oy+h, snap, x0, y0);
+    CopyNode(node.child[3], ox+h, oy+h, snap, x0, y0);
+}
+
+void HashLifeUniverse::CopyTo(UniverseSnapshot& snap, int64_t x0, int64_t y0, int w, int h) const {
+    snap.Reset(w, h);
+    CopyNode(m_root, -RootHalf(), -RootHalf(), snap, x0, y0);
+}
+
+void HashLifeUniverse::CountNode(NodeId n, int64_t ox, int64_t oy, std::vector<uint64_t>& counts,
+                                 int64_t x0, int64_t y0, int w, int h, int shift) const {
+    const Node& node = m_nodes[n];
+    if (!node.population) return;
+    int64_t size = int64_t(1) << node.level;
+    if (ox >= x0 + ((int64_t)w << shift) || oy >= y0 + ((int64_t)h << shift) || ox + size <= x0 || oy + size <= y0) return;
+    int64_t px = (ox - x0) >> shift, py = (oy - y0) >> shift;
+    if (node.level <= shift && px == ((ox + size - 1 - x0) >> shift) && py == ((oy + size - 1 - y0) >> shift)) {
+        // the whole node falls inside one pixel (always true for an aligned view)
+        if (px >= 0 && px < w && py >= 0 && py < h) counts[(size_t)py*w + (size_t)px] += node.population;
+        return;
+    }
+    if (node.level == kLeafLevel) {
+        for (int r=0; r<8; ++r) {
+            uint64_t row = (node.bits >> (8*r)) & 0xFF;
+            int64_t py = (oy + r - y0) >> shift;
+            if (!row || py<0 || py>=h) continue;
+            for (int c=0; c<8; ++c) {
+                int64_t px = (ox + c - x0) >> shift;
+                if (((row >> c) & 1) && px>=0 && px<w) ++counts[(size_t)py*w + (size_t)px];
+            }
+        }
+        return;
+    }
+    int64_t half = size/2;
+    CountNode(node.child[0], ox,      oy,      counts, x0, y0, w, h, shift);
+    CountNode(node.child[1], ox+half, oy,      counts, x0, y0, w, h, shift);
+    CountNode(node.child[2], ox,      oy+half, counts, x0, y0, w, h, shift);
+    CountNode(node.child[3], ox+half, oy+half, counts, x0, y0, w, h, shift);
+}
+
+void HashLifeUniverse::CopyDensity(UniverseSnapshot& snap, int64_t x0, int64_t y0, int w, int h, int shift) const {
+    snap.width = w; snap.height = h; snap.stride = 0;
+    snap.cells.clear();
+    std::vector<uint64_t>& counts = DensityCounts(snap, w, h);
+    CountNode(m_root, -RootHalf(), -RootHalf(), counts, x0, y0, w, h, shift);
+    StoreDensity(snap, shift);
+}
+
+// ---------------- SparseUniverse Impl ----------------
+static inline uint64_t MixKey(uint64_t key) {
+    key ^= key >> 31; key *= 0x7FB5D329728EA185ULL; key ^= key >> 27;
+    return key;
+}
+
+int SparseUniverse::TileIndex::Find(uint64_t key) const {
+    if (m_keys.empty()) return -1;
+    size_t mask = m_keys.size()-1;
+    for (size_t i = MixKey(key) & mask; ; i = (i+1) & mask) {
+        if (m_keys[i] == key) return (int)m_values[i];
+        if (m_keys[i] == kEmpty) return -1;
+    }
+}
+
+void SparseUniverse::TileIndex::Insert(uint64_t key, uint32_t index) {
+    if ((m_count+1)*2 > m_keys.size()) Grow();
+    size_t mask = m_keys.size()-1;
+    size_t i = MixKey(key) & mask;
+    while (m_keys[i] != kEmpty && m_keys[i] != key) i = (i+1) & mask;
+    if (m_keys[i] == kEmpty) ++m_count;
+    m_keys[i] = key;
+    m_values[i] = index;
+}
+
+void SparseUniverse::TileIndex::Grow() {
+    std::vector<uint64_t> keys(std::max<size_t>(64, m_keys.size()*2), kEmpty);
+    std::vector<uint32_t> values(keys.size());
+    keys.swap(m_keys);
+    values.swap(m_values);
+    m_count = 0;
+    for (size_t i=0; i<keys.size(); ++i)
+        if (keys[i] != kEmpty) Insert(keys[i], values[i]);
+}
+
+// Tile coordinates are 32-bit; cells further out than that are ignored.
+bool SparseUniverse::TileCoords(int64_t x, int64_t y, int32_t& tx, int32_t& ty) {
+    int64_t a = x >> 6, b = y >> 6;
+    if (a <= INT32_MIN || a > INT32_MAX || b <= INT32_MIN || b > INT32_MAX) return false;
+    tx = (int32_t)a; ty = (int32_t)b;
+    return true;
+}
+
+// A tile copied out of an attached file shadows the file's copy.
+const SparseUniverse::Tile* SparseUniverse::FindTile(int32_t tx, int32_t ty) const {
+    int i = m_index.Find(Key(tx, ty));
+    if (i>=0) return &m_tiles[i];
+    return m_mapped ? m_mapped->Find(tx, ty) : nullptr;
+}
+
+SparseUniverse::Tile* SparseUniverse::GetOrCreateTile(int32_t tx, int32_t ty) {
+    int i = m_index.Find(Key(tx, ty));
+    if (i>=0) return &m_tiles[i];
+    const Tile* mapped = m_mapped ? m_mapped->Find(tx, ty) : nullptr;
+    m_tiles.push_back(mapped ? *mapped : Tile());
+    Tile& t = m_tiles.back();
+    if (mapped) {
+        ++m_faulted;
+    } else {
+        t.tx = tx; t.ty = ty;
+        std::fill(t.rows, t.rows+64, 0);
+    }
+    m_index.Insert(Key(tx, ty), (uint32_t)(m_tiles.size()-1));
+    return &t;
+}
+
+// Calls fn for every tile: those in m_tiles, then those of an attached file
+// that haven't been copied in.
+template<class Fn>
+void SparseUniverse::ForEachTile(Fn fn) const {
+    for (const Tile& t : m_tiles) fn(t);
+    if (!m_mapped) return;
+    for (size_t i=0; i<m_mapped->TileCount(); ++i) {
+        const Tile& t = m_mapped->TileAt(i);
+        if (!m_faulted || m_index.Find(Key(t.tx, t.ty)) < 0) fn(t);
+    }
+}
+
+size_t SparseUniverse::TileCount() const {
+    return m_tiles.size() + (m_mapped ? m_mapped->TileCount() - m_faulted : 0);
+}
+
+void SparseUniverse::Attach(std::shared_ptr<const TiledPatternFile> file) {
+    Clear();
+    m_mapped = std::move(file);
+    if (m_mapped) m_population = m_mapped->Population();
+}
+
+void SparseUniverse::Clear() {
+    m_tiles.clear();
+    m_index.Clear();
+    m_mapped.reset();
+    m_faulted = 0;
+    m_population = m_births = m_deaths = 0;
+}
+
+bool SparseUniverse::Get(int64_t x, int64_t y) const {
+    int32_t tx, ty;
+    if (!TileCoords(x, y, tx, ty)) return false;
+    const Tile* t = FindTile(tx, ty);
+    return t && ((t->rows[y & 63] >> (x & 63)) & 1);
+}
+
+void SparseUniverse::Set(int64_t x, int64_t y, bool alive) {
+    if (Get(x, y) != alive) Toggle(x, y);
+}
+
+void SparseUniverse::Toggle(int64_t x, int64_t y) {
+    int32_t tx, ty;
+    if (!TileCoords(x, y, tx, ty)) return;
+    uint64_t& row = GetOrCreateTile(tx, ty)->rows[y & 63];
+    row ^= uint64_t(1) << (x & 63);
+    if ((row >> (x & 63)) & 1) ++m_population; else --m_population;
+}
+
+void SparseUniverse::Paste(const UniverseSnapshot& snap, int64_t x0, int64_t y0, PasteMode mode) {
+    if (snap.width<=0 || snap.height<=0) return;
+    const int64_t x1 = x0 + snap.width, y1 = y0 + snap.height;
+    for (int64_t ty = y0 >> 6; ty <= (y1-1) >> 6; ++ty) {
+        for (int64_t tx = x0 >> 6; tx <= (x1-1) >> 6; ++tx) {
+            int32_t cx, cy;
+            if (!TileCoords(tx*64, ty*64, cx, cy)) continue;
+            uint64_t mask = ColumnMask(0, x0 - tx*64, x1 - tx*64);
+            Tile* t = nullptr;
+            for (int r=0; r<64; ++r) {
+                int64_t sy = ty*64 + r - y0;
+                if (sy<0 || sy>=snap.height) continue;
+                uint64_t bits = ReadBits64(snap.Row((int)sy), snap.stride, tx*64 - x0) & mask;
+                if (!t) {
+                    // don't create tiles just to write zeros into them
+                    if (!bits && !FindTile(cx, cy)) continue;
+                    t = GetOrCreateTile(cx, cy);
+                }
+                uint64_t now = PasteWord(t->rows[r], bits, mask, mode);
+                m_population += PopCount64(now) - PopCount64(t->rows[r]);
+                t->rows[r] = now;
+            }
+        }
+    }
+}
+
+// Calls fn for every tile that may intersect the given cell rectangle,
+// looking tiles up by position for small windows and scanning them all
+// otherwise.
+template<class Fn>
+void SparseUniverse::ForEachTileIn(int64_t x0, int64_t y0, int64_t spanX, int64_t spanY, Fn fn) const {
+    double windowTiles = (spanX/64.0 + 2) * (spanY/64.0 + 2);
+    if (windowTiles < (double)TileCount()) {
+        for (int64_t ty = y0 >> 6; ty <= (y0+spanY-1) >> 6; ++ty)
+            for (int64_t tx = x0 >> 6; tx <= (x0+spanX-1) >> 6; ++tx) {
+                int32_t cx, cy;
+                if (!TileCoords(tx*64, ty*64, cx, cy)) continue;
+                if (const Tile* t = FindTile(cx, cy)) fn(*t);
+            }
+    } else {
+        ForEachTile(fn);
+    }
+}
+
+void SparseUniverse::CopyTo(UniverseSnapshot& snap, int64_t x0, int64_t y0, int w, int h) const {
+    snap.Reset(w, h);
+    if (w<=0 || h<=0) return;
+    ForEachTileIn(x0, y0, w, h, [&](const Tile& t) {
+        int64_t ox = (int64_t)t.tx*64 - x0, oy = (int64_t)t.ty*64 - y0;
+        if (ox >= w || oy >= h || ox+64 <= 0 || oy+64 <= 0) return;
+        for (int r=0; r<64; ++r) {
+            int64_t sy = oy + r;
+            if (sy<0 || sy>=h || !t.rows[r]) continue;
+            uint64_t* dst = snap.Row((int)sy);
+            // place the 64-bit tile row at column ox of the snapshot row
+            int64_t word = ox >> 6; int shift = (int)(ox & 63);
+            if (word>=0 && word<snap.stride) dst[word] |= t.rows[r] << shift;
+            if (shift && word+1>=0 && word+1<snap.stride) dst[word+1] |= t.rows[r] >> (64-shift);
+            dst[snap.stride-1] &= ColumnMask(snap.stride-1, 0, w);
+        }
+    });
+}
+
+void SparseUniverse::CopyDensity(UniverseSnapshot& snap, int64_t x0, int64_t y0, int w, int h, int shift) const {
+    snap.width = w; snap.height = h; snap.stride = 0;
+    snap.cells.clear();
+    std::vector<uint64_t>& counts = DensityCounts(snap, w, h);
+    const int64_t spanX = (int64_t)w << shift, spanY = (int64_t)h << shift;
+    if (w>0 && h>0) {
+        ForEachTileIn(x0, y0, spanX, spanY, [&](const Tile& t) {
+            int64_t tx = (int64_t)t.tx*64, ty = (int64_t)t.ty*64;
+            if (tx >= x0 + spanX || ty >= y0 + spanY || tx+64 <= x0 || ty+64 <= y0) return;
+            for (int r=0; r<64; ++r) {
+                int64_t py = (ty + r - y0) >> shift;
+                if (py<0 || py>=h || !t.rows[r]) continue;
+                CountBits64(t.rows[r], tx, x0, shift, &counts[(size_t)py*w], w);
+            }
+        });
+    }
+    StoreDensity(snap, shift);
+}
+
+void SparseUniverse::GetStats(EngineStats& stats) const {
+    stats.nodes = TileCount();
+    stats.mappedBytes = m_mapped ? m_mapped->MappedBytes() : 0;
+    stats.memoryBytes = (m_tiles.capacity() + m_nextTiles.capacity())*sizeof(Tile)
+                      + (m_index.Capacity() + m_nextIndex.Capacity())*(sizeof(uint64_t)+sizeof(uint32_t))
+                      + m_candidates.capacity()*sizeof(uint64_t);
+    stats.births = m_births;
+    stats.deaths = m_deaths;
+}
+
+// Only tiles near live cells are stepped, so empty space must stay empty.
+bool SparseUniverse::SetRule(const LifeRule& rule) {
+    if (rule.NeedsBoundedBoard()) return false;
+    m_rule = rule;
+    m_kernels = KernelsForRule(rule);
+    return true;
+}
+
+void SparseUniverse::AddCandidate(int64_t tx, int64_t ty) {
+    if (tx <= INT32_MIN || tx > INT32_MAX || ty <= INT32_MIN || ty > INT32_MAX) return;
+    m_candidates.push_back(Key((int32_t)tx, (int32_t)ty));
+}
+
+// Next generation of one tile, from the 3x3 block of tiles around it.
+void SparseUniverse::StepTile(int32_t tx, int32_t ty, uint64_t out[64], uint64_t& births, uint64_t& deaths) const {
+    static const uint64_t kZero[64] = {0};
+    const uint64_t* t[3][3];
+    for (int j=0; j<3; ++j)
+        for (int i=0; i<3; ++i) {
+            const Tile* n = FindTile(tx+i-1, ty+j-1);
+            t[j][i] = n ? n->rows : kZero;
+        }
+    // rows -1..64 of the tile with the west/east pair sums, as in the packed kernel
+    uint64_t xs[66], as[66], cs[66];
+    for (int r=-1; r<=64; ++r) {
+        int j = r<0 ? 0 : (r>63 ? 2 : 1);
+        int rr = r & 63;
+        uint64_t c = t[j][1][rr];
+        uint64_t west = (c << 1) | (t[j][0][rr] >> 63);
+        uint64_t east = (c >> 1) | (t[j][2][rr] << 63);
+        xs[r+1] = west ^ east; as[r+1] = west & east; cs[r+1] = c;
+    }
+    // row y of the tile is word y, as in HashLifeUniverse::LeafResult()
+    uint64_t changed[64] = {0}, born[64] = {0}, died[64] = {0};
+    std::fill(out, out+64, 0);
+    const RowInputs in = { xs, as, cs, xs+1, as+1, cs+1, xs+2, as+2, cs+2 };
+    m_kernels->combineRow(in, RowOutputs{ out, changed, born, died }, 0, 64, m_rule);
+    births = deaths = 0;
+    for (int y=0; y<64; ++y) {
+        births += born[y];
+        deaths += died[y];
+    }
+}
+
+uint64_t SparseUniverse::Step() {
+    // Every live tile is a candidate, plus each neighbor that one of its edge
+    // or corner cells touches (births can happen there).
+    m_candidates.clear();
+    ForEachTile([this](const Tile& t) {
+        uint64_t any = 0;
+        for (uint64_t r : t.rows) any |= r;
+        if (!any) return;
+        const uint64_t top = t.rows[0], bottom = t.rows[63];
+        const bool west = any & 1, east = any >> 63;
+        AddCandidate(t.tx, t.ty);
+        if (west) AddCandidate((int64_t)t.tx-1, t.ty);
+        if (east) AddCandidate((int64_t)t.tx+1, t.ty);
+        if (top) AddCandidate(t.tx, (int64_t)t.ty-1);
+        if (bottom) AddCandidate(t.tx, (int64_t)t.ty+1);
+        if (top & 1) AddCandidate((int64_t)t.tx-1, (int64_t)t.ty-1);
+        if (top >> 63) AddCandidate((int64_t)t.tx+1, (int64_t)t.ty-1);
+        if (bottom & 1) AddCandidate((int64_t)t.tx-1, (int64_t)t.ty+1);
+        if (bottom >> 63) AddCandidate((int64_t)t.tx+1, (int64_t)t.ty+1);
+    });
+    std::sort(m_candidates.begin(), m_candidates.end());
+    m_candidates.erase(std::unique(m_candidates.begin(), m_candidates.end()), m_candidates.end());
+
+    m_nextTiles.clear();
+    m_nextIndex.Clear();
+    m_births = m_deaths = 0;
+    Tile next;
+    for (uint64_t key : m_candidates) {
+        next.tx = (int32_t)(key >> 32);
+        next.ty = (int32_t)(uint32_t)key;
+        uint64_t births, deaths;
+        StepTile(next.tx, next.ty, next.rows, births, deaths);
+        m_births += births;
+        m_deaths += deaths;
+        uint64_t any = 0;
+        for (uint64_t r : next.rows) any |= r;
+        if (!any) continue;
+        m_nextTiles.push_back(next);
+        m_nextIndex.Insert(key, (uint32_t)(m_nextTiles.size()-1));
+    }
+    m_population += m_births - m_deaths;
+    m_tiles.swap(m_nextTiles);
+    std::swap(m_index, m_nextIndex);
+    // every live cell has been copied into the new generation
+    m_mapped.reset();
+    m_faulted = 0;
+    return 1;
+}
+
+// ---------------- Pattern Files Impl ----------------
+static const char kBinaryMagic[8] = {'L','I','F','E','P','K','0','2'};
+static const char kBinaryMagicV1[8] = {'L','I','F','E','P','K','0','1'}; // no rule word
+static const size_t kPatternBufferBytes = 1 << 16;
+static const int kPatternBandWords = 1 << 16; // 512 KB of cells per band
+static const int kRLELineLength = 70;
+
+static inline uint64_t LittleEndian64(uint64_t v) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap64(v);
+#else
+    return v;
+#endif
+}
+
+// Sets columns [x0, x1) of a packed row.
+static inline void SetRun(uint64_t* row, int64_t x0, int64_t x1) {
+    for (int64_t w = x0 >> 6; w*64 < x1; ++w) row[w] |= ColumnMask(w, x0, x1);
+}
+
+PatternFormat PatternFormatForExtension(const std::string& ext) {
+    if (ext == "rle") return PatternFormat::RLE;
+    if (ext == "cells") return PatternFormat::Cells;
+    if (ext == "lifb") return PatternFormat::Binary;
+    if (ext == "lift") return PatternFormat::Tiled;
+    return PatternFormat::Text;
+}
+
+// Lower-cased extension of the last path component.
+PatternFormat PatternFormatForPath(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return PatternFormat::Text;
+    std::string ext = path.substr(dot + 1);
+    for (char& c : ext) c = (char)std::tolower((unsigned char)c);
+    return PatternFormatForExtension(ext);
+}
+
+int PatternBandRows(int width) {
+    return std::max(1, kPatternBandWords / std::max(1, (width + 63) / 64));
+}
+
+bool PatternReader::Open(std::FILE* f, PatternFormat format) {
+    Close();
+    if (!f) return false;
+    m_file = f;
+    m_buf.resize(kPatternBufferBytes);
+    m_format = format;
+    char magic[sizeof(kBinaryMagic)];
+    const bool gotMagic = Read(magic, sizeof(magic));
+    bool withRule = false;
+    if (gotMagic && std::equal(magic, magic + sizeof(magic), kBinaryMagic)) {
+        m_format = PatternFormat::Binary;
+        withRule = true;
+    } else if (gotMagic && std::equal(magic, magic + sizeof(magic), kBinaryMagicV1)) {
+        m_format = PatternFormat::Binary;
+    } else if (!Rewind()) {
+        return false;
+    }
+    switch (m_format) {
+    case PatternFormat::Text:   return ReadTextHeader();
+    case PatternFormat::RLE:    return ReadRLEHeader();
+    case PatternFormat::Cells:  return MeasureCells();
+    case PatternFormat::Binary: return ReadBinaryHeader(withRule);
+    case PatternFormat::Tiled:  return false; // mapped, not streamed
+    }
+    return false;
+}
+
+void PatternReader::Close() {
+    if (m_file) std::fclose(m_file);
+    m_file = nullptr;
+    m_pos = m_end = 0;
+    m_width = m_height = 0;
+    m_generation = 0;
+    m_rule = LifeRule();
+    m_row = m_blankRows = 0;
+    m_ended = false;
+}
+
+int PatternReader::Get() {
+    if (m_pos == m_end) {
+        m_pos = 0;
+        m_end = std::fread(m_buf.data(), 1, m_buf.size(), m_file);
+        if (!m_end) return EOF;
+    }
+    return (unsigned char)m_buf[m_pos++];
+}
+
+int PatternReader::Peek() {
+    int c = Get();
+    if (c != EOF) --m_pos;
+    return c;
+}
+
+bool PatternReader::Read(void* dst, size_t bytes) {
+    char* out = (char*)dst;
+    size_t buffered = std::min(bytes, m_end - m_pos);
+    std::copy(m_buf.data() + m_pos, m_buf.data() + m_pos + buffered, out);
+    m_pos += buffered;
+    // bulk data bypasses the buffer
+    return std::fread(out + buffered, 1, bytes - buffered, m_file) == bytes - buffered;
+}
+
+bool PatternReader::Rewind() {
+    m_pos = m_end = 0;
+    return std::fseek(m_file, 0, SEEK_SET) == 0;
+}
+
+std::string PatternReader::ReadLine() {
+    std::string line;
+    for (int c = Get(); c != EOF && c != '\n'; c = Get()) {
+        if (c != '\r') line += (char)c;
+    }
+    return line;
+}
+
+static bool ValidPatternSize(long long w, long long h) {
+    return w > 0 && h > 0 && w <= INT_MAX && h <= INT_MAX;
+}
+
+bool PatternReader::ReadTextHeader() {
+    long long w = 0, h = 0;
+    int used = 0;
+    std::string line = ReadLine();
+    if (std::sscanf(line.c_str(), "%lld %lld%n", &w, &h, &used) != 2 || !ValidPatternSize(w, h)) return false;
+    if (line.find_first_not_of(" \t", used) != std::string::npos && !LifeRule::Parse(line.substr(used), m_rule)) return false;
+    m_width = w;
+    m_height = h;
+    return true;
+}
+
+// Comment lines, then "x = <w>, y = <h>[, rule = ...]". Golly's "#CXRLE"
+// comment may carry the generation. A rule this program can't run, or a
+// bounded grid (":T100,100") after it, makes the file unreadable rather
+// than stepped under the wrong rule.
+bool PatternReader::ReadRLEHeader() {
+    for (;;) {
+        if (Peek() == EOF) return false;
+        std::string line = ReadLine();
+        if (line.empty()) continue;
+        if (line[0] == '#') {
+            size_t gen = line.find("Gen=");
+            if (line.compare(0, 6, "#CXRLE") == 0 && gen != std::string::npos)
+                m_generation = std::strtoull(line.c_str() + gen + 4, nullptr, 10);
+            continue;
+        }
+        long long w = 0, h = 0;
+        if (std::sscanf(line.c_str(), " x = %lld , y = %lld", &w, &h) != 2 || !ValidPatternSize(w, h)) return false;
+        size_t rule = line.find("rule");
+        if (rule != std::string::npos) {
+            size_t eq = line.find('=', rule);
+            if (eq == std::string::npos || !LifeRule::Parse(line.substr(eq + 1), m_rule)) return false;
+        }
+        m_width = w;
+        m_height = h;
+        return true;
+    }
+}
+
+// Plaintext files carry no size; a first pass over the file finds it, and
+// the rule if a comment names one.
+bool PatternReader::MeasureCells() {
+    static const char kRuleComment[] = "!Rule:";
+    int64_t width = 0, height = 0, len = 0;
+    bool comment = false, lineStart = true;
+    std::string text; // of the current comment
+    for (int c = Get(); c != EOF; c = Get()) {
+        if (lineStart) { comment = (c == '!'); lineStart = false; text.clear(); }
+        if (c == '\n') {
+            if (!comment) { width = std::max(width, len); ++height; }
+            else if (text.compare(0, sizeof(kRuleComment)-1, kRuleComment) == 0
+                     && !LifeRule::Parse(text.substr(sizeof(kRuleComment)-1), m_rule)) return false;
+            len = 0; lineStart = true;
+        } else if (c != '\r' && !comment) {
+            ++len;
+        } else if (c != '\r' && text.size() < 256) {
+            text += (char)c;
+        }
+    }
+    if (!lineStart && !comment) { width = std::max(width, len); ++height; }
+    if (!ValidPatternSize(width, height)) return false;
+    m_width = width;
+    m_height = height;
+    return Rewind();
+}
+
+// Rule words hold birth | survival << 16 (and a flag in tiled files).
+static inline uint64_t RuleWord(const LifeRule& rule) { return rule.birth | (uint64_t)rule.survival << 16; }
+
+static inline bool RuleFromWord(uint64_t word, LifeRule& rule) {
+    if (word & ~uint64_t(0x01FF01FF)) return false;
+    rule.birth = (uint16_t)(word & 0xFFFF);
+    rule.survival = (uint16_t)(word >> 16);
+    return true;
+}
+
+bool PatternReader::ReadBinaryHeader(bool withRule) {
+    uint64_t fields[4];
+    if (!Read(fields, (withRule ? 4 : 3)*sizeof(uint64_t))) return false;
+    uint64_t w = LittleEndian64(fields[0]), h = LittleEndian64(fields[1]);
+    if (w > INT_MAX || h > INT_MAX || !ValidPatternSize((long long)w, (long long)h)) return false;
+    if (withRule && !RuleFromWord(LittleEndian64(fields[3]), m_rule)) return false;
+    m_width = (int64_t)w;
+    m_height = (int64_t)h;
+    m_generation = LittleEndian64(fields[2]);
+    return true;
+}
+
+bool PatternReader::NextRow(uint64_t* row, int cols) {
+    if (!m_file || m_row >= m_height) return false;
+    std::fill(row, row + (cols + 63) / 64, 0);
+    bool ok = false;
+    switch (m_format) {
+    case PatternFormat::Text:   ok = ReadTextRow(row, cols); break;
+    case PatternFormat::RLE:    ok = ReadRLERow(row, cols); break;
+    case PatternFormat::Cells:  ok = ReadCellsRow(row, cols); break;
+    case PatternFormat::Binary: ok = ReadBinaryRow(row, cols); break;
+    case PatternFormat::Tiled:  break;
+    }
+    if (ok) ++m_row;
+    return ok;
+}
+
+bool PatternReader::ReadTextRow(uint64_t* row, int cols) {
+    if (Peek() == EOF) return false;
+    // scans the buffer a chunk at a time rather than a character at a time
+    for (int64_t x = 0; Peek() != EOF; ) {
+        const char* begin = m_buf.data() + m_pos;
+        const char* nl = (const char*)std::memchr(begin, '\n', m_end - m_pos);
+        const char* end = nl ? nl : m_buf.data() + m_end;
+        const int64_t n = std::min<int64_t>(end - begin, std::max<int64_t>(cols - x, 0));
+        for (int64_t i = 0; i < n; ++i)
+            row[(x + i) >> 6] |= uint64_t(begin[i] == '1') << ((x + i) & 63);
+        x += end - begin;
+        m_pos = (end - m_buf.data()) + (nl ? 1 : 0);
+        if (nl) break;
+    }
+    return true;
+}
+
+bool PatternReader::ReadCellsRow(uint64_t* row, int cols) {
+    int c = Get();
+    while (c == '!') { // comment line
+        while (c != EOF && c != '\n') c = Get();
+        c = Get();
+    }
+    if (c == EOF) return false;
+    for (int64_t x = 0; c != EOF && c != '\n'; c = Get(), ++x) {
+        if ((c == 'O' || c == '*') && x < cols) row[x >> 6] |= uint64_t(1) << (x & 63);
+    }
+    return true;
+}
+
+// Runs are "<count><tag>": 'b' dead, 'o' alive, '$' end of row(s), '!' end of
+// pattern. Any other letter is alive too, except Golly's dying states, which
+// are read as dead. Rows ended by a count > 1 on '$' or after '!' come out
+// empty.
+bool PatternReader::ReadRLERow(uint64_t* row, int cols) {
+    if (m_blankRows > 0) { --m_blankRows; return true; }
+    if (m_ended) return true;
+    int64_t x = 0, count = 0;
+    for (int c = Get(); ; c = Get()) {
+        if (c == EOF) { m_ended = true; return true; }
+        if (c >= '0' && c <= '9') { count = std::min<int64_t>(count*10 + (c - '0'), INT64_MAX/16); continue; }
+        int64_t n = count ? count : 1;
+        count = 0;
+        if (c == '$') { m_blankRows = n - 1; return true; }
+        if (c == '!') { m_ended = true; return true; }
+        if (c == 'b' || c == '.') { x += n; continue; }
+        // Golly's multi-state cells: 'A' is alive, 'B'..'X' and "pA".."yO"
+        // are dying
+        if (c >= 'p' && c <= 'y' && std::isupper(Peek())) { Get(); x += n; continue; }
+        if (std::isupper(c) && c != 'A') { x += n; continue; }
+        if (std::isalpha(c)) {
+            if (x < cols) SetRun(row, x, std::min<int64_t>(x + n, cols));
+            x += n;
+        }
+        // whitespace and line breaks between runs mean nothing
+    }
+}
+
+bool PatternReader::ReadBinaryRow(uint64_t* row, int cols) {
+    const int64_t stride = (m_width + 63) / 64;
+    const int words = (cols + 63) / 64;
+    uint64_t* dst = row;
+    if (stride > words) {
+        m_wide.resize((size_t)stride);
+        dst = m_wide.data();
+    }
+    if (!Read(dst, (size_t)stride * sizeof(uint64_t))) return false;
+    for (int i = 0; i < std::min<int64_t>(stride, words); ++i)
+        row[i] = LittleEndian64(dst[i]) & ColumnMask(i, 0, std::min<int64_t>(cols, m_width));
+    return true;
+}
+
+// Buffers RLE output into lines of at most kRLELineLength characters.
+class RLEWriter {
+public:
+    explicit RLEWriter(std::FILE* f) : m_file(f) {}
+
+    void Run(int64_t n, char tag) {
+        if (n <= 0) return;
+        // built back to front: tag, then the count's digits from the lowest
+        char token[24];
+        int len = 0;
+        token[len++] = tag;
+        if (n > 1) {
+            for (; n; n /= 10) token[len++] = (char)('0' + n % 10);
+        }
+        if (m_line.size() + len > (size_t)kRLELineLength) Flush();
+        while (len) m_line += token[--len];
+    }
+    // Row ends are held back so that empty rows merge into one "n$" and the
+    // ones at the bottom are dropped.
+    void EndRow() { ++m_rowEnds; }
+    void StartRow() { Run(m_rowEnds, '$'); m_rowEnds = 0; }
+    void Finish() { Run(1, '!'); Flush(); }
+
+private:
+    void Flush() {
+        m_line += '\n';
+        std::fwrite(m_line.data(), 1, m_line.size(), m_file);
+        m_line.clear();
+    }
+
+    std::FILE* m_file;
+    std::string m_line;
+    int64_t m_rowEnds=0;
+};
+
+// First column at or after x whose state differs from 'alive', or limit.
+static int64_t RunEnd(const uint64_t* row, int words, int64_t x, bool alive, int64_t limit) {
+    int64_t w = x >> 6;
+    uint64_t bits = (alive ? ~row[w] : row[w]) & (~uint64_t(0) << (x & 63));
+    while (!bits) {
+        if (++w >= words) return limit;
+        bits = alive ? ~row[w] : row[w];
+    }
+    return std::min(limit, w*64 + CountTrailingZeros64(bits));
+}
+
+bool WritePattern(std::FILE* f, PatternFormat format, const LifeEngine& engine, int w, int h, uint64_t generation,
+                  const LifeRule& rule) {
+    if (!f || w <= 0 || h <= 0) return false;
+    if (format == PatternFormat::Tiled) return WriteTiledPattern(f, engine, w, h, generation, rule);
+    if (format == PatternFormat::Binary && !rule.IsLifeLike()) return false;
+    const bool conway = rule == LifeRule();
+    switch (format) {
+    case PatternFormat::Text:
+        std::fprintf(f, conway ? "%d %d\n" : "%d %d %s\n", w, h, rule.ToString().c_str());
+        break;
+    case PatternFormat::RLE:
+        if (generation) std::fprintf(f, "#CXRLE Gen=%llu\n", (unsigned long long)generation);
+        std::fprintf(f, "x = %d, y = %d, rule = %s\n", w, h, rule.ToString().c_str());
+        break;
+    case PatternFormat::Cells:
+        std::fprintf(f, "!%dx%d\n", w, h);
+        if (!conway) std::fprintf(f, "!Rule: %s\n", rule.ToString().c_str());
+        break;
+    case PatternFormat::Binary: {
+        uint64_t fields[4] = { LittleEndian64((uint64_t)w), LittleEndian64((uint64_t)h), LittleEndian64(generation),
+                               LittleEndian64(RuleWord(rule)) };
+        std::fwrite(kBinaryMagic, 1, sizeof(kBinaryMagic), f);
+        std::fwrite(fields, 1, sizeof(fields), f);
+        break;
+    }
+    case PatternFormat::Tiled:
+        break;
+    }
+
+    RLEWriter rle(f);
+    std::string line;
+    std::vector<uint64_t> words;
+    UniverseSnapshot band;
+    const int bandRows = PatternBandRows(w);
+    for (int y0 = 0; y0 < h; y0 += bandRows) {
+        engine.CopyTo(band, 0, y0, w, std::min(bandRows, h - y0));
+        for (int y = 0; y < band.height; ++y) {
+            const uint64_t* row = band.Row(y);
+            switch (format) {
+            case PatternFormat::Text:
+            case PatternFormat::Cells: {
+                const char alive = format == PatternFormat::Text ? '1' : 'O';
+                const char dead = format == PatternFormat::Text ? '0' : '.';
+                line.assign((size_t)w, dead);
+                for (int i = 0; i < band.stride; ++i) {
+                    for (uint64_t bits = row[i]; bits; bits &= bits - 1)
+                        line[(size_t)i*64 + CountTrailingZeros64(bits)] = alive;
+                }
+                line += '\n';
+                std::fwrite(line.data(), 1, line.size(), f);
+                break;
+            }
+            case PatternFormat::RLE: {
+                int64_t last = -1; // last live column
+                for (int i = band.stride - 1; i >= 0 && last < 0; --i) {
+                    if (row[i]) last = (int64_t)i*64 + 63 - CountLeadingZeros64(row[i]);
+                }
+                if (last >= 0) rle.StartRow();
+                for (int64_t x = 0; x <= last; ) {
+                    bool alive = (row[x >> 6] >> (x & 63)) & 1;
+                    int64_t end = RunEnd(row, band.stride, x, alive, last + 1);
+                    rle.Run(end - x, alive ? 'o' : 'b');
+                    x = end;
+                }
+                rle.EndRow();
+                break;
+            }
+            case PatternFormat::Binary:
+                words.resize((size_t)band.stride);
+                for (int i = 0; i < band.stride; ++i) words[i] = LittleEndian64(row[i]);
+                std::fwrite(words.data(), sizeof(uint64_t), words.size(), f);
+                break;
+            case PatternFormat::Tiled:
+                break;
+            }
+        }
+    }
+    if (format == PatternFormat::RLE) rle.Finish();
+    return !std::ferror(f);
+}
+
+static const char kTiledMagic[8] = {'L','I','F','E','T','L','0','1'};
+static const size_t kTiledHeaderWords = 8;
+static const uint64_t kTiledHasRule = uint64_t(1) << 32; // in the rule word
+
+static inline uint64_t TiledKey(int64_t tx, int64_t ty) { return (uint64_t)(uint32_t)ty << 32 | (uint32_t)tx; }
+
+bool TiledPatternFile::Open(const std::string& path) {
+    Close();
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return false; // tiles are used in place, so they must be in host order
+#endif
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+        m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping) m_data = (const char*)MapViewOfFile((HANDLE)m_mapping, FILE_MAP_READ, 0, 0, 0);
+        m_size = (size_t)size.QuadPart;
+    }
+    CloseHandle(file);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) { m_data = (const char*)p; m_size = (size_t)st.st_size; }
+    }
+    ::close(fd);
+#endif
+    if (!m_data) { Close(); return false; }
+
+    // only the header and the key index are checked; tile records are
+    // left alone until something looks at them
+    const size_t headerBytes = sizeof(kTiledMagic) + kTiledHeaderWords*sizeof(uint64_t);
+    if (m_size < headerBytes || !std::equal(kTiledMagic, kTiledMagic + sizeof(kTiledMagic), m_data)) { Close(); return false; }
+    uint64_t h[kTiledHeaderWords];
+    std::memcpy(h, m_data + sizeof(kTiledMagic), sizeof(h));
+    const uint64_t count = h[4], keysAt = h[5], tilesAt = h[6];
+    LifeRule rule;
+    if ((h[7] && (!(h[7] & kTiledHasRule) || !RuleFromWord(h[7] & ~kTiledHasRule, rule)))
+        || !h[0] || !h[1] || h[0] > INT_MAX || h[1] > INT_MAX || count > m_size / sizeof(Tile)
+        || keysAt % 8 || tilesAt % 8 || keysAt > m_size || tilesAt > m_size
+        || count * sizeof(uint64_t) > m_size - keysAt || count * sizeof(Tile) > m_size - tilesAt) {
+        Close();
+        return false;
+    }
+    m_width = (int64_t)h[0];
+    m_height = (int64_t)h[1];
+    m_generation = h[2];
+    m_population = h[3];
+    m_rule = rule;
+    m_count = (size_t)count;
+    m_keys = (const uint64_t*)(m_data + keysAt);
+    m_tiles = (const Tile*)(m_data + tilesAt);
+    for (size_t i=1; i<m_count; ++i) {
+        if (m_keys[i-1] >= m_keys[i]) { Close(); return false; }
+    }
+    return true;
+}
+
+void TiledPatternFile::Close() {
+#ifdef _WIN32
+    if (m_data) UnmapViewOfFile(m_data);
+    if (m_mapping) CloseHandle((HANDLE)m_mapping);
+    m_mapping = nullptr;
+#else
+    if (m_data) munmap((void*)m_data, m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_width = m_height = 0;
+    m_generation = m_population = 0;
+    m_rule = LifeRule();
+    m_count = 0;
+    m_keys = nullptr;
+    m_tiles = nullptr;
+}
+
+const TiledPatternFile::Tile* TiledPatternFile::Find(int32_t tx, int32_t ty) const {
+    const uint64_t key = TiledKey(tx, ty);
+    const uint64_t* it = std::lower_bound(m_keys, m_keys + m_count, key);
+    if (it == m_keys + m_count || *it != key) return nullptr;
+    return &m_tiles[it - m_keys];
+}
+
+bool WriteTiledPattern(std::FILE* f, const LifeEngine& engine, int w, int h, uint64_t generation,
+                       const LifeRule& rule) {
+    if (!f || w <= 0 || h <= 0 || !rule.IsLifeLike()) return false;
+    const long tilesAt = (long)(sizeof(kTiledMagic) + kTiledHeaderWords*sizeof(uint64_t));
+    if (std::fseek(f, tilesAt, SEEK_SET) != 0) return false;
+
+    // tiles go out a row of tiles at a time; only their keys are kept
+    std::vector<uint64_t> keys;
+    uint64_t population = 0;
+    UniverseSnapshot band;
+    SparseUniverse::Tile tile;
+    for (int y0 = 0; y0 < h; y0 += 64) {
+        engine.CopyTo(band, 0, y0, w, std::min(64, h - y0));
+        for (int tx = 0; tx < band.stride; ++tx) {
+            uint64_t any = 0;
+            for (int r = 0; r < 64; ++r) {
+                tile.rows[r] = r < band.height ? band.Row(r)[tx] : 0;
+                any |= tile.rows[r];
+                population += PopCount64(tile.rows[r]);
+            }
+            if (!any) continue;
+            tile.tx = tx;
+            tile.ty = y0 / 64;
+            std::fwrite(&tile, sizeof(tile), 1, f);
+            keys.push_back(TiledKey(tile.tx, tile.ty));
+        }
+    }
+    const uint64_t keysAt = (uint64_t)tilesAt + keys.size()*sizeof(SparseUniverse::Tile);
+    if (!keys.empty()) std::fwrite(keys.data(), sizeof(uint64_t), keys.size(), f); // an empty board has no keys
+
+    uint64_t header[kTiledHeaderWords] = { (uint64_t)w, (uint64_t)h, generation, population,
+                                           keys.size(), keysAt, (uint64_t)tilesAt, RuleWord(rule) | kTiledHasRule };
+    if (std::fseek(f, 0, SEEK_SET) != 0) return false;
+    std::fwrite(kTiledMagic, 1, sizeof(kTiledMagic), f);
+    std::fwrite(header, sizeof(uint64_t), kTiledHeaderWords, f);
+    return !std::ferror(f);
+}
+
+// ---------------- PatternLibrary Impl ----------------
+static const char kLibraryMagic[8] = {'L','I','F','E','L','B','0','1'};
+// Patterns bigger than this aren't run to find their period.
+static const int kPeriodMaxSide = 1024;
+
+struct PatternFileStamp {
+    std::string name;
+    uint64_t size;
+    int64_t modified;
+};
+
+// Extensions of the formats read a row at a time; tiled files are whole
+// universes rather than patterns.
+static bool IsPatternFile(const std::string& name) {
+    size_t dot = name.find_last_of('.');
+    if (dot == std::string::npos) return false;
+    std::string ext = name.substr(dot + 1);
+    for (char& c : ext) c = (char)std::tolower((unsigned char)c);
+    return ext == "txt" || ext == "rle" || ext == "cells" || ext == "lifb";
+}
+
+// The pattern files directly in dir, sorted by name.
+static bool ListPatternFiles(const std::string& dir, std::vector<PatternFileStamp>& files) {
+    files.clear();
+#ifdef _WIN32
+    WIN32_FIND_DATAA found;
+    HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &found);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    do {
+        if ((found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || !IsPatternFile(found.cFileName)) continue;
+        ULARGE_INTEGER t;
+        t.LowPart = found.ftLastWriteTime.dwLowDateTime;
+        t.HighPart = found.ftLastWriteTime.dwHighDateTime;
+        files.push_back({found.cFileName, (uint64_t)found.nFileSizeHigh << 32 | found.nFileSizeLow, (int64_t)t.QuadPart});
+    } while (FindNextFileA(h, &found));
+    FindClose(h);
+#else
+    DIR* d = opendir(dir.c_str());
+    if (!d) return false;
+    while (struct dirent* e = readdir(d)) {
+        struct stat st;
+        if (!IsPatternFile(e->d_name) || stat((dir + "/" + e->d_name).c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        files.push_back({e->d_name, (uint64_t)st.st_size, (int64_t)st.st_mtime});
+    }
+    closedir(d);
+#endif
+    std::sort(files.begin(), files.end(), [](const PatternFileStamp& a, const PatternFileStamp& b) { return a.name < b.name; });
+    return true;
+}
+
+// Copies the bounding box of in's live cells into out; 0 x 0 if there are
+// none.
+static void TrimToBounds(const UniverseSnapshot& in, UniverseSnapshot& out) {
+    int64_t x0 = INT64_MAX, x1 = -1;
+    int y0 = -1, y1 = -1;
+    for (int y=0; y<in.height; ++y) {
+        const uint64_t* row = in.Row(y);
+        for (int i=0; i<in.stride; ++i) {
+            if (!row[i]) continue;
+            x0 = std::min<int64_t>(x0, (int64_t)i*64 + CountTrailingZeros64(row[i]));
+            x1 = std::max<int64_t>(x1, (int64_t)i*64 + 63 - CountLeadingZeros64(row[i]));
+            if (y0 < 0) y0 = y;
+            y1 = y;
+        }
+    }
+    if (y0 < 0) { out.Reset(0, 0); return; }
+    out.Reset((int)(x1 - x0 + 1), y1 - y0 + 1);
+    for (int y=0; y<out.height; ++y) {
+        for (int i=0; i<out.stride; ++i)
+            out.Row(y)[i] = ReadBits64(in.Row(y0 + y), in.stride, x0 + 64*i) & ColumnMask(i, 0, out.width);
+    }
+}
+
+bool PatternLibrary::Read(const std::string& path, Pattern& pattern) {
+    PatternReader reader;
+    if (!reader.Open(std::fopen(path.c_str(), "rb"), PatternFormatForPath(path))) return false;
+    if (reader.Width() > kMaxSide || reader.Height() > kMaxSide) return false;
+    UniverseSnapshot whole;
+    whole.Reset((int)reader.Width(), (int)reader.Height());
+    for (int y=0; y<whole.height && reader.NextRow(whole.Row(y), whole.width); ++y) {}
+    TrimToBounds(whole, pattern.cells);
+    pattern.rule = reader.Rule();
+    pattern.population = 0;
+    for (uint64_t w : pattern.cells.cells) pattern.population += PopCount64(w);
+    pattern.period = FindPeriod(pattern.cells, pattern.population, pattern.rule);
+    return true;
+}
+
+// Runs the pattern on a finite board with room around it to travel at the
+// speed of light for kMaxPeriod generations, and compares the bounding box
+// of each generation with the start, so that spaceships are found as well as
+// oscillators.
+int PatternLibrary::FindPeriod(const UniverseSnapshot& cells, uint64_t population, const LifeRule& rule) {
+    if (!population || !rule.IsLifeLike() || rule.BirthOnZero()) return 0;
+    if (cells.width > kPeriodMaxSide || cells.height > kPeriodMaxSide) return 0;
+    const int margin = kMaxPeriod + 1;
+    PackedUniverse board;
+    board.Resize(cells.width + 2*margin, cells.height + 2*margin);
+    board.SetBoundary(Boundary::Finite);
+    board.SetRule(rule);
+    board.Paste(cells, margin, margin);
+    UniverseSnapshot whole, trimmed;
+    for (int period=1; period<=kMaxPeriod; ++period) {
+        board.Step();
+        if (!board.Population()) return 0;
+        if (board.Population() != population) continue;
+        board.CopyTo(whole, 0, 0, board.GetWidth(), board.GetHeight());
+        TrimToBounds(whole, trimmed);
+        if (trimmed.width == cells.width && trimmed.height == cells.height && trimmed.cells == cells.cells) return period;
+    }
+    return 0;
+}
+
+int PatternLibrary::Find(const std::string& name) const {
+    auto it = std::lower_bound(m_patterns.begin(), m_patterns.end(), name,
+                               [](const Pattern& p, const std::string& n) { return p.name < n; });
+    return it != m_patterns.end() && it->name == name ? (int)(it - m_patterns.begin()) : -1;
+}
+
+void PatternLibrary::Thumbnail(size_t i, int size, std::vector<uint8_t>& pixels, int& w, int& h) const {
+    const UniverseSnapshot& cells = m_patterns[i].cells;
+    size = std::max(1, size);
+    // cells per pixel side, the fewest that fit both ways
+    const int scale = std::max(1, std::max((cells.width + size-1) / size, (cells.height + size-1) / size));
+    w = (cells.width + scale-1) / scale;
+    h = (cells.height + scale-1) / scale;
+    std::vector<uint32_t> counts((size_t)w*h, 0);
+    for (int y=0; y<cells.height; ++y) {
+        const uint64_t* row = cells.Row(y);
+        uint32_t* line = &counts[(size_t)(y / scale) * w];
+        for (int i=0; i<cells.stride; ++i) {
+            for (uint64_t bits = row[i]; bits; bits &= bits - 1)
+                ++line[(i*64 + CountTrailingZeros64(bits)) / scale];
+        }
+    }
+    pixels.resize(counts.size());
+    const double area = (double)scale * scale;
+    for (size_t p=0; p<counts.size(); ++p)
+        pixels[p] = counts[p] ? (uint8_t)std::min(255.0, std::max(1.0, counts[p] * 255.0 / area)) : 0;
+}
+
+bool PatternLibrary::Open(const std::string& dir, const std::string& cachePath) {
+    m_patterns.clear();
+    m_filesRead = 0;
+    m_dir = dir;
+    std::vector<PatternFileStamp> files;
+    if (!ListPatternFiles(dir, files)) return false;
+    std::vector<Pattern> cached; // sorted by name, as they were written
+    if (!cachePath.empty() && !LoadCache(cachePath, dir, cached)) cached.clear();
+    size_t reused = 0;
+    for (const PatternFileStamp& file : files) {
+        auto it = std::lower_bound(cached.begin(), cached.end(), file.name,
+                                   [](const Pattern& p, const std::string& n) { return p.name < n; });
+        if (it != cached.end() && it->name == file.name && it->fileSize == file.size && it->modified == file.modified) {
+            m_patterns.push_back(std::move(*it));
+            ++reused;
+            continue;
+        }
+        Pattern pattern;
+        if (!Read(dir + "/" + file.name, pattern)) continue; // left out, and tried again next time
+        pattern.name = file.name;
+        pattern.fileSize = file.size;
+        pattern.modified = file.modified;
+        m_patterns.push_back(std::move(pattern));
+        ++m_filesRead;
+    }
+    if (!cachePath.empty() && (m_filesRead || reused != cached.size())) SaveCache(cachePath);
+    return true;
+}
+
+// Cache words are read from a copy of the whole file; strings are padded to
+// whole words, so everything stays aligned.
+struct LibraryCacheReader {
+    std::vector<uint64_t> words;
+    size_t pos = 0;
+
+    bool Word(uint64_t& v) {
+        if (pos >= words.size()) return false;
+        v = LittleEndian64(words[pos++]);
+        return true;
+    }
+    bool String(std::string& s) {
+        uint64_t n;
+        if (!Word(n) || n > 4096 || (n + 7) / 8 > words.size() - pos) return false;
+        s.assign((const char*)&words[pos], (size_t)n);
+        pos += (size_t)(n + 7) / 8;
+        return true;
+    }
+};
+
+static void PutCacheWord(std::FILE* f, uint64_t v) {
+    v = LittleEndian64(v);
+    std::fwrite(&v, sizeof(v), 1, f);
+}
+
+static void PutCacheString(std::FILE* f, const std::string& s) {
+    PutCacheWord(f, s.size());
+    std::fwrite(s.data(), 1, s.size(), f);
+    static const char kPad[8] = {};
+    std::fwrite(kPad, 1, (8 - s.size() % 8) % 8, f);
+}
+
+bool PatternLibrary::LoadCache(const std::string& path, const std::string& dir, std::vector<Pattern>& cached) const {
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return false;
+    LibraryCacheReader in;
+    long bytes = std::fseek(f, 0, SEEK_END) == 0 ? std::ftell(f) : -1;
+    bool ok = bytes >= (long)sizeof(kLibraryMagic) && bytes % 8 == 0 && std::fseek(f, 0, SEEK_SET) == 0;
+    if (ok) {
+        in.words.resize((size_t)bytes / 8);
+        ok = std::fread(in.words.data(), sizeof(uint64_t), in.words.size(), f) == in.words.size();
+    }
+    std::fclose(f);
+    std::string cachedDir;
+    uint64_t count;
+    if (!ok || std::memcmp(in.words.data(), kLibraryMagic, sizeof(kLibraryMagic)) != 0) return false;
+    in.pos = 1;
+    if (!in.String(cachedDir) || cachedDir != dir || !in.Word(count)) return false;
+    for (uint64_t i=0; i<count; ++i) {
+        Pattern p;
+        uint64_t size, modified, w, h, population, period;
+        std::string rule;
+        if (!in.String(p.name) || !in.Word(size) || !in.Word(modified) || !in.Word(w) || !in.Word(h)
+            || !in.Word(population) || !in.Word(period) || !in.String(rule)) return false;
+        if (w > kMaxSide || h > kMaxSide || period > kMaxPeriod || !LifeRule::Parse(rule, p.rule)) return false;
+        p.fileSize = size;
+        p.modified = (int64_t)modified;
+        p.population = population;
+        p.period = (int)period;
+        p.cells.Reset((int)w, (int)h);
+        if (p.cells.cells.size() > in.words.size() - in.pos) return false;
+        for (uint64_t& word : p.cells.cells) in.Word(word);
+        cached.push_back(std::move(p));
+    }
+    return true;
+}
+
+// Written beside the cache and renamed over it, so that a library opened
+// while another copy is writing never reads half a cache.
+bool PatternLibrary::SaveCache(const std::string& path) const {
+    std::string tmp = path + ".tmp";
+    std::FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    std::fwrite(kLibraryMagic, 1, sizeof(kLibraryMagic), f);
+    PutCacheString(f, m_dir);
+    PutCacheWord(f, m_patterns.size());
+    for (const Pattern& p : m_patterns) {
+        PutCacheString(f, p.name);
+        PutCacheWord(f, p.fileSize);
+        PutCacheWord(f, (uint64_t)p.modified);
+        PutCacheWord(f, (uint64_t)p.cells.width);
+        PutCacheWord(f, (uint64_t)p.cells.height);
+        PutCacheWord(f, p.population);
+        PutCacheWord(f, (uint64_t)p.period);
+        PutCacheString(f, p.rule.ToString());
+        for (uint64_t word : p.cells.cells) PutCacheWord(f, word);
+    }
+    bool ok = !std::ferror(f);
+    ok = std::fclose(f) == 0 && ok;
+#ifdef _WIN32
+    if (ok) std::remove(path.c_str()); // rename doesn't replace files here
+#endif
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// ---------------- WorkerPool Impl ----------------
+void WorkerPool::SetThreadCount(int threads) {
+    if (threads<=0) threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    if (threads == GetThreadCount()) return;
+    StopWorkers();
+    m_stop = false;
+    for (int i=1; i<threads; ++i)
+        m_workers.emplace_back(&WorkerPool::WorkerLoop, this, m_job);
+}
+
+void WorkerPool::StopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& t : m_workers) t.join();
+    m_workers.clear();
+}
+
+void WorkerPool::RunTasks() {
+    for (;;) {
+        int i = m_nextTask.fetch_add(1);
+        if (i >= m_count) break;
+        m_taskFn(m_task, i);
+    }
+}
+
+void WorkerPool::Dispatch(int count, TaskFn fn, const void* task) {
+    if (count<=0) return;
+    if (m_workers.empty() || count==1) {
+        for (int i=0; i<count; ++i) fn(task, i);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_taskFn = fn;
+        m_task = task;
+        m_count = count;
+        m_nextTask = 0;
+        m_busy = (int)m_workers.size();
+        ++m_job;
+    }
+    m_wake.notify_all();
+    RunTasks();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]{ return m_busy==0; });
+    m_taskFn = nullptr;
+    m_task = nullptr;
+}
+
+void WorkerPool::WorkerLoop(unsigned seen) {
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&]{ return m_stop || m_job!=seen; });
+            if (m_stop) return;
+            seen = m_job;
+        }
+        RunTasks();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_busy==0) m_done.notify_one();
+    }
+}
+
+// ---------------- PerfTrace Impl ----------------
+void PerfTrace::Record(PerfPhase phase, Clock::time_point start, Clock::time_point end, int count) {
+    Ring& ring = m_rings[(int)phase];
+    const uint64_t n = ring.count.load(std::memory_order_relaxed);
+    Event& e = ring.events[n & (kCapacity - 1)];
+    e.start.store(std::chrono::duration_cast<std::chrono::nanoseconds>(start - m_epoch).count(), std::memory_order_relaxed);
+    e.duration.store(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), std::memory_order_relaxed);
+    e.count.store(count, std::memory_order_relaxed);
+    ring.count.store(n + 1, std::memory_order_release);
+}
+
+// Calls fn(start, duration, count), times in ns, for the events that ended
+// in the last 'seconds', newest first.
+template <typename Fn>
+void PerfTrace::ForEachRecent(PerfPhase phase, double seconds, Fn fn) const {
+    const Ring& ring = m_rings[(int)phase];
+    const int64_t since = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_epoch).count()
+                        - (int64_t)(seconds * 1e9);
+    const uint64_t n = ring.count.load(std::memory_order_acquire);
+    for (uint64_t i = n; i > 0 && n - i < (uint64_t)kCapacity; --i) {
+        const Event& e = ring.events[(i - 1) & (kCapacity - 1)];
+        const int64_t start = e.start.load(std::memory_order_relaxed);
+        const int64_t duration = e.duration.load(std::memory_order_relaxed);
+        if (start + duration < since) break;
+        fn(start, duration, std::max(1, e.count.load(std::memory_order_relaxed)));
+    }
+}
+
+PerfTrace::Summary PerfTrace::Summarize(PerfPhase phase, double seconds) const {
+    std::vector<int64_t> durations;
+    ForEachRecent(phase, seconds, [&](int64_t, int64_t duration, int count) { durations.push_back(duration / count); });
+    Summary s;
+    s.events = (int)durations.size();
+    if (durations.empty()) return s;
+    auto at = [&](double q) {
+        auto it = durations.begin() + (ptrdiff_t)(q * (durations.size() - 1));
+        std::nth_element(durations.begin(), it, durations.end());
+        return *it / 1e6;
+    };
+    s.p50Ms = at(0.5);
+    s.p99Ms = at(0.99);
+    s.maxMs = at(1.0);
+    return s;
+}
+
+bool PerfTrace::WriteChromeTrace(std::FILE* f, double seconds) const {
+    static const char* const names[] = { "Step", "Copy frame", "Paint", "Update status", "Timer lag" };
+    static const int tracks[] = { 1, 1, 2, 2, 1 }; // simulation thread, UI thread
+    std::fputs("{\"traceEvents\":[\n", f);
+    std::fputs("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"Simulation\"}},\n", f);
+    std::fputs("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"UI\"}}", f);
+    for (int p = 0; p < (int)PerfPhase::Count; ++p) {
+        ForEachRecent((PerfPhase)p, seconds, [&](int64_t start, int64_t duration, int count) {
+            std::fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"count\":%d}}",
+                names[p], tracks[p], start / 1e3, duration / 1e3, count);
+        });
+    }
+    std::fputs("\n],\"displayTimeUnit\":\"ms\"}\n", f);
+    return !std::ferror(f);
+}
+
+// ---------------- SimulationThread Impl ----------------
+void SimulationThread::Start(LifeEngine* engine, uint64_t generation, int intervalMs, const ViewWindow& view) {
+    Stop();
+    m_engine = engine;
+    m_generation = generation;
+    m_stop = false;
+    m_intervalMs = intervalMs;
+    m_frameView = view;
+    m_edits.clear();
+    m_frameReady = false;
+    m_frameWanted = true;
+    m_held = false;
+    m_reached.store(generation, std::memory_order_relaxed);
+    m_reachedPopulation.store(engine->Population(), std::memory_order_relaxed);
+    m_thread = std::thread(&SimulationThread::Loop, this);
+}
+
+uint64_t SimulationThread::Stop() {
+    if (!m_thread.joinable()) return m_generation;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    m_thread.join();
+    // edits that arrived after the last generation still belong to the board
+    for (auto& edit : m_edits) edit(*m_engine);
+    m_edits.clear();
+    return m_generation;
+}
+
+void SimulationThread::SetInterval(int intervalMs) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_intervalMs = intervalMs;
+    }
+    m_wake.notify_all();
+}
+
+void SimulationThread::SetPauseOnCycle(bool on) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pauseOnCycle = on;
+    }
+    m_wake.notify_all();
+}
+
+void SimulationThread::SetFrameView(const ViewWindow& view) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_frameView = view;
+}
+
+void SimulationThread::Post(const Edit& edit) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_edits.push_back(edit);
+}
+
+bool SimulationThread::TakeFrame(UniverseSnapshot& frame) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_frameReady) return false;
+        std::swap(frame, m_back);
+        m_frameReady = false;
+    }
+    m_frameWanted = true;
+    return true;
+}
+
+// Copies the frame view out for TakeFrame(). Also called with a frame still
+// waiting to be taken, which it then replaces. The copy goes into m_copy
+// without the lock, which is only held to swap it in, so the UI thread's
+// TakeFrame(), Post() and SetFrameView() never wait for a copy.
+void SimulationThread::PublishFrame() {
+    PerfScope scope(m_trace, PerfPhase::Copy);
+    ViewWindow view;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        view = m_frameView;
+    }
+    m_engine->CopyView(m_copy, view);
+    m_copy.generation = m_generation;
+    m_copy.population = m_engine->Population();
+    m_engine->GetStats(m_copy.stats);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::swap(m_copy, m_back);
+    m_frameReady = true;
+}
+
+// Steps are timed in batches: one step at a time when there is an interval
+// or a step is slow, otherwise as many as take about kStepBatchNs, so that
+// reading the clock doesn't slow small boards at full speed.
+static const int64_t kStepBatchNs = 20000;
+
+void SimulationThread::Loop() {
+    typedef std::chrono::steady_clock Clock;
+    std::vector<Edit> edits;
+    Clock::time_point due = Clock::now();
+    Clock::time_point batchStart;
+    int batchSteps = 0, batchTarget = 1;
+    auto endBatch = [&]() {
+        if (!m_trace || !batchSteps) return;
+        Clock::time_point now = Clock::now();
+        m_trace->Record(PerfPhase::Step, batchStart, now, batchSteps);
+        int64_t perStep = std::max<int64_t>(1, std::chrono::duration_cast<std::chrono::nanoseconds>(now - batchStart).count() / batchSteps);
+        batchTarget = (int)std::max<int64_t>(1, std::min<int64_t>(4096, kStepBatchNs / perStep));
+        batchSteps = 0;
+    };
+    for (;;) {
+        int intervalMs;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stop) break;
+            edits.swap(m_edits);
+            intervalMs = m_intervalMs;
+        }
+        for (auto& edit : edits) edit(*m_engine);
+        edits.clear();
+
+        if (m_trace && !batchSteps) batchStart = Clock::now();
+        m_generation += m_engine->Step();
+        m_reached.store(m_generation, std::memory_order_relaxed);
+        m_reachedPopulation.store(m_engine->Population(), std::memory_order_relaxed);
+        if (m_history) m_history->AfterStep(*m_engine, m_generation);
+        const bool cycle = m_cycles && m_cycles->AfterStep(*m_engine, m_generation);
+        if (++batchSteps >= batchTarget || intervalMs>0) endBatch();
+
+        if (cycle && m_pauseOnCycle) {
+            // show the generation the cycle turned up in and stay on it;
+            // edits wait in the queue for Stop()
+            endBatch();
+            m_frameWanted = false;
+            PublishFrame();
+            m_held = true;
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this]{ return m_stop || !m_pauseOnCycle; });
+            m_held = false;
+            continue;
+        }
+        if (!m_turbo.load(std::memory_order_relaxed) && m_frameWanted.exchange(false)) {
+            endBatch();
+            PublishFrame();
+        }
+
+        if (intervalMs>0) {
+            // fixed cadence; if we fell behind, don't try to catch up in a burst
+            due += std::chrono::milliseconds(intervalMs);
+            due = std::max(due, Clock::now());
+            std::unique_lock<std::mutex> lock(m_mutex);
+            bool woken = m_wake.wait_until(lock, due, [this, intervalMs]{ return m_stop || m_intervalMs != intervalMs; });
+            // how late the wake-up came, against the interval's schedule
+            if (!woken && m_trace) m_trace->Record(PerfPhase::TimerLag, due, Clock::now());
+        }
+        // at full speed 'due' falls behind, and is brought up to now above
+        // once there is an interval again
+    }
+    endBatch();
+}
+
+// ---------------- GenerationHistory Impl ----------------
+void GenerationHistory::Reset(const LifeEngine& engine, int w, int h, uint64_t generation) {
+    m_checkpoints.clear();
+    m_toggles.clear();
+    m_bytes = 0;
+    m_interval = kMinInterval;
+    m_sinceKeyframe = 0;
+    m_generation = generation;
+    m_width = w;
+    m_height = h;
+    m_enabled = m_limit > 0 && w > 0 && h > 0;
+    if (!m_enabled) {
+        m_last = UniverseSnapshot();
+        m_scratch = UniverseSnapshot();
+        m_encoded = std::vector<uint64_t>();
+        return;
+    }
+    m_lastCapture = Clock::now();
+    Capture(engine);
+}
+
+void GenerationHistory::RecordToggle(int64_t x, int64_t y) {
+    if (!m_enabled) return;
+    m_toggles.push_back(ToggleEvent{m_generation, x, y});
+    m_bytes += sizeof(ToggleEvent);
+}
+
+// XORs cur against prev (or nothing, for a keyframe) and stores the result
+// as runs: a header word holding the count of unchanged words and the count
+// of literal words that follow it. A literal run ends at two unchanged words
+// in a row, so scattered changes don't cost a header each.
+void GenerationHistory::Encode(const UniverseSnapshot& cur, const UniverseSnapshot* prev, std::vector<uint64_t>& out) {
+    out.clear();
+    const uint64_t* a = cur.cells.data();
+    const uint64_t* b = prev ? prev->cells.data() : nullptr;
+    const size_t n = cur.cells.size();
+    size_t i = 0;
+    while (i < n) {
+        size_t zeros = 0;
+        while (i < n && a[i] == (b ? b[i] : 0)) { ++i; ++zeros; }
+        if (i == n) break; // trailing unchanged words need no run
+        size_t header = out.size();
+        out.push_back(0);
+        size_t literals = 0;
+        while (i < n) {
+            uint64_t d = a[i] ^ (b ? b[i] : 0);
+            if (!d && (i + 1 == n || a[i+1] == (b ? b[i+1] : 0))) break;
+            out.push_back(d);
+            ++literals; ++i;
+        }
+        out[header] = (uint64_t)zeros << 32 | literals;
+    }
+}
+
+void GenerationHistory::Apply(const std::vector<uint64_t>& data, UniverseSnapshot& snap) {
+    uint64_t* cells = snap.cells.data();
+    size_t pos = 0;
+    for (size_t i = 0; i < data.size(); ) {
+        pos += data[i] >> 32;
+        size_t literals = data[i++] & 0xffffffffu;
+        for (size_t k = 0; k < literals; ++k) cells[pos++] ^= data[i++];
+    }
+}
+
+// The board at checkpoint 'index': its keyframe with every delta since.
+void GenerationHistory::Decode(size_t index, UniverseSnapshot& out) const {
+    size_t k = index;
+    while (k > 0 && !m_checkpoints[k].keyframe) --k;
+    out.Reset(m_width, m_height);
+    for (; k <= index; ++k) Apply(m_checkpoints[k].data, out);
+}
+
+void GenerationHistory::Capture(const LifeEngine& engine) {
+    const Clock::time_point t0 = Clock::now();
+    engine.CopyTo(m_scratch, 0, 0, m_width, m_height);
+    Checkpoint cp;
+    cp.generation = m_generation;
+    cp.keyframe = m_checkpoints.empty() || ++m_sinceKeyframe >= kKeyframeEvery;
+    if (cp.keyframe) m_sinceKeyframe = 0;
+    // encoded into a buffer that keeps its capacity, so the checkpoint
+    // itself is a single exact-sized allocation
+    Encode(m_scratch, cp.keyframe ? nullptr : &m_last, m_encoded);
+    cp.data.assign(m_encoded.begin(), m_encoded.end());
+    std::swap(m_last, m_scratch);
+    m_bytes += cp.data.capacity() * sizeof(uint64_t);
+    m_checkpoints.push_back(std::move(cp));
+    Evict();
+
+    // space checkpoints so that capturing costs about 2% of the time spent
+    // getting from one to the next
+    const Clock::time_point t1 = Clock::now();
+    const uint64_t generations = m_checkpoints.size() > 1 ? m_generation - m_checkpoints[m_checkpoints.size()-2].generation : 0;
+    if (generations > 0) {
+        const double perGeneration = std::chrono::duration<double>(t0 - m_lastCapture).count() / generations;
+        const double spent = std::chrono::duration<double>(t1 - t0).count();
+        const double interval = perGeneration > 0 ? 50 * spent / perGeneration : kMaxInterval;
+        m_interval = (int)std::max<double>(kMinInterval, std::min<double>(kMaxInterval, interval));
+    }
+    m_lastCapture = t1;
+    m_nextCapture = m_generation + m_interval;
+}
+
+// Drops the oldest keyframe and the deltas that depend on it until the
+// history fits, always keeping the newest keyframe.
+void GenerationHistory::Evict() {
+    while (m_bytes + m_last.cells.size() * sizeof(uint64_t) > m_limit) {
+        size_t next = 1;
+        while (next < m_checkpoints.size() && !m_checkpoints[next].keyframe) ++next;
+        if (next >= m_checkpoints.size()) break;
+        for (size_t i = 0; i < next; ++i) {
+            m_bytes -= m_checkpoints.front().data.capacity() * sizeof(uint64_t);
+            m_checkpoints.pop_front();
+        }
+        const uint64_t oldest = m_checkpoints.front().generation;
+        while (!m_toggles.empty() && m_toggles.front().generation < oldest) {
+            m_toggles.pop_front();
+            m_bytes -= sizeof(ToggleEvent);
+        }
+    }
+}
+
+bool GenerationHistory::Rewind(LifeEngine& engine, uint64_t target) {
+    if (!m_enabled || m_checkpoints.empty() || target < m_checkpoints.front().generation || target > m_generation)
+        return false;
+    // the newest checkpoint at or before the target becomes the newest one
+    size_t index = m_checkpoints.size() - 1;
+    while (m_checkpoints[index].generation > target) --index;
+    while (m_checkpoints.size() > index + 1) {
+        m_bytes -= m_checkpoints.back().data.capacity() * sizeof(uint64_t);
+        m_checkpoints.pop_back();
+    }
+    m_sinceKeyframe = 0;
+    for (size_t k = index; k > 0 && !m_checkpoints[k].keyframe; --k) ++m_sinceKeyframe;
+    Decode(index, m_last);
+    engine.Clear();
+    engine.Paste(m_last, 0, 0);
+
+    // step forward to the target, replaying toggles made along the way;
+    // those made at the target itself were made to what was on screen then
+    uint64_t g = m_checkpoints[index].generation;
+    auto toggle = std::lower_bound(m_toggles.begin(), m_toggles.end(), g,
+        [](const ToggleEvent& t, uint64_t gen) { return t.generation < gen; });
+    for (;;) {
+        for (; toggle != m_toggles.end() && toggle->generation == g; ++toggle) engine.Toggle(toggle->x, toggle->y);
+        if (g >= target) break;
+        g += engine.Step();
+    }
+    while (!m_toggles.empty() && m_toggles.back().generation > target) {
+        m_toggles.pop_back();
+        m_bytes -= sizeof(ToggleEvent);
+    }
+    m_generation = target;
+    m_nextCapture = m_checkpoints[index].generation + m_interval;
+    m_lastCapture = Clock::now();
+    return true;
+}
+
+// ---------------- CycleDetector Impl ----------------
+// Only called by the stepping thread, or while nothing steps.
+void CycleDetector::Reset() {
+    // assign() keeps a grown table's memory, but only clears what it uses
+    m_table.assign(kInitialSlots, Entry{0, kEmpty});
+    m_entries = 0;
+    m_nextSample = 0;
+    m_everySince = 0;
+    m_lastSample = Clock::now(); // the first sample's span covers the step after this
+    m_confirming = false;
+    m_found = false;
+    m_period.store(0, std::memory_order_release);
+    m_start.store(0, std::memory_order_relaxed);
+}
+
+bool CycleDetector::Sample(LifeEngine& engine, uint64_t generation) {
+    const Clock::time_point t0 = Clock::now();
+    uint64_t hash;
+    if (!engine.StateHash(hash)) {
+        m_nextSample = kEmpty; // never, until the next Reset()
+        return false;
+    }
+    if (m_confirming) {
+        if (hash == m_repeatHash) {
+            Report(generation - m_repeatGeneration, m_repeatStart);
+            return true;
+        }
+        m_nextSample = generation + 1;
+        return false;
+    }
+    uint64_t first;
+    if (Lookup(hash, generation, first)) {
+        // with every generation in between sampled this is the first repeat,
+        // otherwise the period only divides the gap
+        if (first >= m_everySince) {
+            Report(generation - first, first);
+            return true;
+        }
+        m_confirming = true;
+        m_repeatHash = hash;
+        m_repeatGeneration = generation;
+        m_repeatStart = first;
+        m_nextSample = generation + 1;
+        return false;
+    }
+
+    // the gap that would have made this sample 2% of the time since the
+    // last one, in powers of two and only changed when off by more than
+    // twice, so that it settles rather than flip-flopping
+    const Clock::time_point t1 = Clock::now();
+    const double cost = std::chrono::duration<double>(t1 - t0).count();
+    const double span = std::chrono::duration<double>(t1 - m_lastSample).count();
+    const double want = m_interval * cost / (0.02 * span);
+    if (want > 2*m_interval || 2*want < m_interval) {
+        m_interval = 1;
+        while (m_interval < want && m_interval < kMaxInterval) m_interval *= 2;
+    }
+    m_lastSample = t1;
+    m_nextSample = generation + m_interval;
+    if (m_interval > 1) m_everySince = m_nextSample;
+    return false;
+}
+
+// Finds the generation 'hash' was first sampled at, or enters it for this one.
+bool CycleDetector::Lookup(uint64_t hash, uint64_t generation, uint64_t& first) {
+    // the engine's hash is already well mixed; its low bits pick the slot
+    const size_t mask = m_table.size() - 1;
+    for (size_t i = (size_t)hash & mask; ; i = (i + 1) & mask) {
+        Entry& e = m_table[i];
+        if (e.generation == kEmpty) {
+            e.hash = hash;
+            e.generation = generation;
+            break;
+        }
+        if (e.hash == hash) {
+            first = e.generation;
+            return true;
+        }
+    }
+    if (++m_entries >= kMaxEntries) {
+        // no repeat in all that time; start over rather than grow without end
+        m_table.assign(kInitialSlots, Entry{0, kEmpty});
+        m_entries = 0;
+        m_everySince = generation + 1;
+    } else if (m_entries*2 > m_table.size()) {
+        Grow();
+    }
+    return false;
+}
+
+// Both vectors keep their memory through Reset(), so once a run has grown
+// the table this far, later runs allocate nothing.
+void CycleDetector::Grow() {
+    m_spare.assign(m_table.begin(), m_table.end());
+    m_table.assign(m_table.size()*2, Entry{0, kEmpty});
+    const size_t mask = m_table.size() - 1;
+    for (const Entry& e : m_spare) {
+        if (e.generation == kEmpty) continue;
+        size_t i = (size_t)e.hash & mask;
+        while (m_table[i].generation != kEmpty) i = (i + 1) & mask;
+        m_table[i] = e;
+    }
+}
+
+void CycleDetector::Report(uint64_t period, uint64_t start) {
+    m_found = true;
+    m_confirming = false;
+    m_start.store(start, std::memory_order_relaxed);
+    m_period.store(period, std::memory_order_release);
+}
+
+// ---------------- SoupGenerator Impl ----------------
+// SplitMix64's finalizer: a good enough mix that consecutive counters give
+// unrelated words.
+static inline uint64_t SplitMix(uint64_t x) {
+    x ^= x >> 30; x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27; x *= 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+SoupGenerator::SoupGenerator(uint64_t seed, double density) {
+    m_key = SplitMix(seed + 0x9E3779B97F4A7C15ULL);
+    density = std::max(0.0, std::min(density, 1.0));
+    const double scaled = density * (1u << kDensityBits) + 0.5;
+    m_threshold = (uint32_t)std::min(scaled, (double)(1u << kDensityBits));
+    m_lowBit = 0;
+    while (m_lowBit < kDensityBits && !((m_threshold >> m_lowBit) & 1)) ++m_lowBit;
+}
+
+// Builds the word from the density's bits, lowest first: a 1 bit ORs in a
+// fresh random word and a 0 bit ANDs one in, which takes each cell's chance
+// from p to (p+1)/2 or p/2. After the top bit it is threshold / 2^24.
+uint64_t SoupGenerator::Word(int64_t row, int64_t column) const {
+    if (m_threshold >> kDensityBits) return ~uint64_t(0);
+    const uint64_t counter = (((uint64_t)row << 32) ^ (uint64_t)column) * kDensityBits;
+    uint64_t word = 0;
+    for (int b = m_lowBit; b < kDensityBits; ++b) {
+        const uint64_t r = SplitMix(m_key + (counter + b) * 0x9E3779B97F4A7C15ULL);
+        word = ((m_threshold >> b) & 1) ? word | r : word & r;
+    }
+    return word;
+}
+
+void SoupGenerator::Fill(UniverseSnapshot& snap, WorkerPool* pool) const {
+    const int tailBits = snap.width & 63;
+    const uint64_t tail = tailBits ? (uint64_t(1) << tailBits) - 1 : ~uint64_t(0);
+    auto fillRows = [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            uint64_t* row = snap.Row(y);
+            for (int i = 0; i < snap.stride; ++i) row[i] = Word(y, i);
+            if (snap.stride) row[snap.stride-1] &= tail;
+        }
+    };
+    const int threads = pool ? pool->GetThreadCount() : 1;
+    if (threads > 1 && snap.cells.size() >= kParallelMinWords) {
+        const int stripes = std::min(snap.height, threads * kStripesPerThread);
+        pool->Run(stripes, [&](int s) {
+            fillRows((int)((int64_t)snap.height * s / stripes), (int)((int64_t)snap.height * (s+1) / stripes));
+        });
+    } else {
+        fillRows(0, snap.height);
+    }
+}
+
+// ---------------- SoupSearch Impl ----------------
+// 64 soups' fields, one per bit, for the last kSoupPeriod generations. The
+// kernels write the new generation over the oldest one and flag the words
+// that changed, so a lane that comes out unflagged repeats with a period
+// dividing kSoupPeriod, which covers the common ash: still lifes, blinkers,
+// pulsars and the period 6 pairs gliders leave against the field's edge.
+// Rows and columns have a dead border word each, so the kernels never read
+// outside the field and cells at the edge see dead neighbors beyond it.
+static const int kSoupPeriod = 6;
+
+struct SoupLanes {
+    int side, stride;
+    std::vector<uint64_t> boards;        // kSoupPeriod boards of stride x stride
+    int current = 0;                     // the board holding the latest generation
+    std::vector<uint64_t> x, a;          // W^E and W&E of three rolling rows
+    std::vector<uint64_t> changed;       // lanes that differ from kSoupPeriod generations back, per word
+    std::vector<uint64_t> births, deaths; // the kernels count these; mixed across lanes, so unused
+
+    explicit SoupLanes(int fieldSide) : side(fieldSide), stride(fieldSide + 2) {
+        boards.assign((size_t)kSoupPeriod*stride*stride, 0);
+        x.assign((size_t)3*stride, 0);
+        a.assign(x.size(), 0);
+        changed.assign(stride, 0);
+        births.assign(stride, 0);
+        deaths.assign(stride, 0);
+    }
+
+    // Board 'age' generations before the latest one.
+    uint64_t* Board(int age) { return &boards[(size_t)((current - age + kSoupPeriod) % kSoupPeriod)*stride*stride]; }
+    uint64_t* Row(int age, int y) { return Board(age) + (size_t)y*stride; }
+
+    void PrepareRow(int y) {
+        const uint64_t* c = Row(0, y);
+        uint64_t* xr = &x[(size_t)(y%3)*stride];
+        uint64_t* ar = &a[(size_t)(y%3)*stride];
+        for (int i=1; i<=side; ++i) {
+            xr[i] = c[i-1] ^ c[i+1];
+            ar[i] = c[i-1] & c[i+1];
+        }
+    }
+
+    // Steps every lane; returns the lanes that changed over kSoupPeriod
+    // generations.
+    uint64_t Step(const RuleKernels* kernels, const LifeRule& rule) {
+        std::fill(changed.begin(), changed.end(), 0);
+        PrepareRow(0);
+        PrepareRow(1);
+        for (int y=1; y<=side; ++y) {
+            PrepareRow(y+1);
+            const int t = (y-1)%3, m = y%3, b = (y+1)%3;
+            RowInputs in = { &x[(size_t)t*stride], &a[(size_t)t*stride], Row(0, y-1),
+                             &x[(size_t)m*stride], &a[(size_t)m*stride], Row(0, y),
+                             &x[(size_t)b*stride], &a[(size_t)b*stride], Row(0, y+1) };
+            RowOutputs out = { Row(kSoupPeriod-1, y), changed.data(), births.data(), deaths.data() };
+            kernels->combineRow(in, out, 1, side+1, rule);
+        }
+        current = (current + 1) % kSoupPeriod;
+        uint64_t any = 0;
+        for (uint64_t w : changed) any |= w;
+        return any;
+    }
+
+    void ClearLane(int k) {
+        const uint64_t keep = ~(uint64_t(1) << k);
+        for (uint64_t& w : boards) w &= keep;
+    }
+
+    // Population of lane k, and the smallest period it repeats with.
+    void Measure(int k, uint32_t& population, uint8_t& period) {
+        const size_t n = (size_t)stride*stride;
+        const uint64_t* c = Board(0);
+        uint64_t pop = 0;
+        for (size_t i=0; i<n; ++i) pop += (c[i] >> k) & 1;
+        population = (uint32_t)pop;
+        for (int p : {1, 2, 3}) {
+            const uint64_t* old = Board(p);
+            uint64_t diff = 0;
+            for (size_t i=0; i<n; ++i) diff |= c[i] ^ old[i];
+            if (!((diff >> k) & 1)) { period = (uint8_t)p; return; }
+        }
+        period = kSoupPeriod;
+    }
+};
+
+bool SoupSearch::SetOptions(const SoupSearchOptions& options) {
+    const int field = options.fieldSide ? options.fieldSide : 4*options.soupSide;
+    if (!options.rule.IsLifeLike() || options.rule.BirthOnZero()) return false;
+    if (options.soupSide < 1 || options.soupSide > 64 || field < options.soupSide || field > kMaxPackedSide) return false;
+    m_options = options;
+    m_options.fieldSide = field;
+    m_kernels = KernelsForRule(options.rule);
+    return true;
+}
+
+uint64_t SoupSearch::SoupRow(uint64_t soup, int y) const {
+    const int side = m_options.soupSide;
+    const uint64_t mask = side == 64 ? ~uint64_t(0) : (uint64_t(1) << side) - 1;
+    return SoupGenerator(m_options.seed, m_options.density).Word((int64_t)soup, y) & mask;
+}
+
+void SoupSearch::Run(uint64_t count, std::vector<SoupResult>& results, WorkerPool* pool) const {
+    results.assign(count, SoupResult());
+    std::atomic<uint64_t> nextSoup{0};
+    // a thread only pays off with more than one batch of lanes to fill
+    const int threads = pool ? (int)std::min<uint64_t>(pool->GetThreadCount(), (count + 63) / 64) : 1;
+    if (threads > 1) pool->Run(threads, [&](int) { RunLanes(nextSoup, count, results.data()); });
+    else RunLanes(nextSoup, count, results.data());
+}
+
+void SoupSearch::RunLanes(std::atomic<uint64_t>& nextSoup, uint64_t count, SoupResult* results) const {
+    const SoupSearchOptions& o = m_options;
+    SoupLanes lanes(o.fieldSide);
+    const int offset = 1 + (o.fieldSide - o.soupSide) / 2;
+    const SoupGenerator soups(o.seed, o.density);
+    const uint64_t soupMask = o.soupSide == 64 ? ~uint64_t(0) : (uint64_t(1) << o.soupSide) - 1;
+    uint64_t soupOf[64];
+    uint32_t age[64];
+    uint64_t active = 0;
+
+    // false once there are no soups left for lane k
+    auto seed = [&](int k) {
+        const uint64_t soup = nextSoup.fetch_add(1, std::memory_order_relaxed);
+        if (soup >= count) return false;
+        soupOf[k] = soup;
+        age[k] = 0;
+        for (int y=0; y<o.soupSide; ++y) {
+            uint64_t bits = soups.Word((int64_t)soup, y) & soupMask;
+            uint64_t* row = lanes.Row(0, offset + y) + offset;
+            for (; bits; bits &= bits - 1) row[CountTrailingZeros64(bits)] |= uint64_t(1) << k;
+        }
+        return true;
+    };
+    for (int k=0; k<64; ++k)
+        if (seed(k)) active |= uint64_t(1) << k;
+
+    while (active) {
+        const uint64_t changed = lanes.Step(m_kernels, o.rule);
+        uint64_t done = 0;
+        for (uint64_t m = active; m; m &= m - 1) {
+            const int k = CountTrailingZeros64(m);
+            ++age[k];
+            // until the lane has kSoupPeriod generations it is compared with
+            // cleared cells
+            if ((age[k] >= kSoupPeriod && !((changed >> k) & 1)) || age[k] >= o.maxGenerations)
+                done |= uint64_t(1) << k;
+        }
+        for (; done; done &= done - 1) {
+            const int k = CountTrailingZeros64(done);
+            SoupResult& r = results[soupOf[k]];
+            const bool settled = age[k] >= kSoupPeriod && !((changed >> k) & 1);
+            lanes.Measure(k, r.population, r.period);
+            r.lifetime = settled ? age[k] - kSoupPeriod : age[k];
+            if (!settled) r.period = 0;
+            lanes.ClearLane(k);
+            if (!seed(k)) active &= ~(uint64_t(1) << k);
+        }
+    }
+}
+
+// ---------------- Universe Impl ----------------
+Universe::Universe() {
+    m_packed.SetPool(&m_pool);
+    m_packed.SetBoundary(m_boundary);
+    m_multi.SetPool(&m_pool);
+    m_multi.SetBoundary(m_boundary);
+    m_engine = SelectedEngine();
+    m_packed.Resize(m_width, m_height);
+}
+
+// The rules at the edges change with the boundary, so the history can't be
+// replayed across it.
+void Universe::SetBoundary(Boundary boundary) {
+    m_boundary = boundary;
+    m_packed.SetBoundary(m_boundary);
+    m_multi.SetBoundary(m_boundary);
+    SwitchEngine(SelectedEngine());
+    ResetHistory();
+}
+
+void Universe::SetHashLife(bool on) {
+    m_useHashLife = on;
+    SwitchEngine(SelectedEngine());
+    ResetHistory();
+}
+
+// Stepping on from a past generation under another rule would make a new
+// future, so the history starts over.
+bool Universe::SetRule(const LifeRule& rule) {
+    if (rule.NeedsBoundedBoard() && IsUnbounded()) return false;
+    if (rule == m_rule) return true;
+    ApplyRule(rule);
+    SwitchEngine(SelectedEngine());
+    ResetHistory();
+    return true;
+}
+
+// The engines not in use get the rule too, so that switching keeps it. It
+// is up to the caller to switch to the engine the rule needs.
+void Universe::ApplyRule(const LifeRule& rule) {
+    m_rule = rule;
+    m_multi.SetRule(rule);
+    if (rule.IsLifeLike()) m_packed.SetRule(rule);
+    if (!rule.NeedsBoundedBoard()) {
+        m_hashlife.SetRule(rule);
+        m_sparse.SetRule(rule);
+    }
+}
+
+// HashLife when it is chosen, otherwise the sparse engine for an infinite
+// board, and for finite and toroidal boards the packed one, or the
+// multi-state one for the rules the packed one can't run.
+LifeEngine* Universe::SelectedEngine() {
+    if (m_useHashLife) return &m_hashlife;
+    if (m_boundary == Boundary::Infinite) return &m_sparse;
+    return m_rule.IsLifeLike() ? (LifeEngine*)&m_packed : &m_multi;
+}
+
+// Bounded engines are sized to the board; the unbounded ones just clear.
+void Universe::ResizeEngine(LifeEngine* engine, int w, int h) {
+    if (engine == &m_packed) m_packed.Resize(w, h);
+    else if (engine == &m_multi) m_multi.Resize(w, h);
+    else engine->Clear();
+}
+
+// Switches backends, carrying the cells of the board over. Only the board
+// area is carried, at most kMaxPackedSide on a side; anything an unbounded
+// engine holds outside of that is dropped.
+void Universe::SwitchEngine(LifeEngine* next) {
+    if (next == m_engine) return;
+    const bool bounded = next == &m_packed || next == &m_multi;
+    if (!bounded && m_rule.NeedsBoundedBoard()) ApplyRule(LifeRule());
+    UniverseSnapshot cells;
+    if (bounded) {
+        m_width = std::min(m_width, kMaxPackedSide);
+        m_height = std::min(m_height, kMaxPackedSide);
+    }
+    m_engine->CopyTo(cells, 0, 0, std::min(m_width, kMaxPackedSide), std::min(m_height, kMaxPackedSide));
+    ResizeEngine(m_engine, 0, 0);
+    ResizeEngine(next, m_width, m_height);
+    next->Paste(cells, 0, 0);
+    m_engine = next;
+}
+
+void Universe::Resize(int w, int h) {
+    const int limit = IsUnbounded() ? kMaxUnboundedSide : kMaxPackedSide;
+    m_width = std::max(1, std::min(w, limit));
+    m_height = std::max(1, std::min(h, limit));
+    ResizeEngine(m_engine, m_width, m_height);
+    m_generation = 0;
+    ResetHistory();
+}
+
+void Universe::Clear() {
+    m_engine->Clear();
+    m_generation = 0;
+    ResetHistory();
+}
+
+void Universe::Randomize(double density, uint64_t seed, int64_t x0, int64_t y0, int w, int h) {
+    UniverseSnapshot cells;
+    cells.Reset(w, h);
+    SoupGenerator(seed, density).Fill(cells, &m_pool);
+    m_engine->Clear();
+    m_engine->Paste(cells, x0, y0);
+    m_generation = 0;
+    ResetHistory();
+}
+
+void Universe::Stamp(const UniverseSnapshot& cells, int64_t x0, int64_t y0, PasteMode mode) {
+    m_engine->Paste(cells, x0, y0, mode);
+    ResetHistory();
+}
+
+uint64_t Universe::Step() {
+    uint64_t n = m_engine->Step();
+    m_generation += n;
+    m_history.AfterStep(*m_engine, m_generation);
+    m_cycles.AfterStep(*m_engine, m_generation);
+    return n;
+}
+
+void Universe::Toggle(int64_t x, int64_t y) {
+    m_engine->Toggle(x, y);
+    m_history.RecordToggle(x, y);
+    m_cycles.Reset();
+}
+
+// Only the packed engine keeps a history; an unbounded engine's cells can
+// lie anywhere on the plane, and checkpoints would lose the multi-state
+// engine's dying cells. Whatever reset the history changed the board, so the
+// search for a cycle starts over too.
+void Universe::ResetHistory() {
+    const bool keep = m_engine == &m_packed;
+    m_history.Reset(*m_engine, keep ? m_width : 0, keep ? m_height : 0, m_generation);
+    m_cycles.Reset();
+}
+
+void Universe::SetHistoryMemory(int megabytes) {
+    m_history.SetMemoryLimit((size_t)std::max(0, megabytes) << 20);
+    ResetHistory();
+}
+
+bool Universe::RewindTo(uint64_t generation) {
+    if (!m_history.Rewind(*m_engine, generation)) return false;
+    m_generation = generation;
+    m_cycles.Reset();
+    return true;
+}
+
+EngineStats Universe::Stats() const {
+    EngineStats stats;
+    m_engine->GetStats(stats);
+    return stats;
+}
+
+bool Universe::Save(const std::string& path) const {
+    // rows are streamed out in bands, but a band still spans the full width
+    if (m_width > kMaxPackedSide) return false;
+    // written beside the target and renamed over it, so that a tiled file
+    // the sparse engine still has mapped is never truncated under it
+    std::string tmp = path + ".tmp";
+    std::FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = WritePattern(f, PatternFormatForPath(path), *m_engine, m_width, m_height, m_generation, m_rule);
+    ok = std::fclose(f) == 0 && ok;
+#ifdef _WIN32
+    if (ok) std::remove(path.c_str()); // rename doesn't replace files here
+#endif
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Universe::Load(const std::string& path, bool resizeToFile) {
+    if (PatternFormatForPath(path) == PatternFormat::Tiled) return LoadTiled(path, resizeToFile);
+    PatternReader reader;
+    if (!reader.Open(std::fopen(path.c_str(), "rb"), PatternFormatForPath(path))) return false;
+    if (reader.Rule().NeedsBoundedBoard() && IsUnbounded()) return false;
+    ApplyRule(reader.Rule());
+    SwitchEngine(SelectedEngine());
+    if (resizeToFile) Resize((int)std::min<int64_t>(reader.Width(), INT_MAX), (int)std::min<int64_t>(reader.Height(), INT_MAX));
+    // cells are pasted a band of rows at a time as they are read
+    const int cols = (int)std::min<int64_t>(reader.Width(), m_width);
+    const int rows = (int)std::min<int64_t>(reader.Height(), m_height);
+    const int bandRows = PatternBandRows(cols);
+    UniverseSnapshot band;
+    for (int y0 = 0; y0 < rows; ) {
+        band.Reset(cols, std::min(bandRows, rows - y0));
+        int got = 0;
+        while (got < band.height && reader.NextRow(band.Row(got), cols)) ++got;
+        band.height = got;
+        m_engine->Paste(band, 0, y0);
+        if (got < std::min(bandRows, rows - y0)) break; // file ended early
+        y0 += got;
+    }
+    m_generation = reader.Generation();
+    ResetHistory();
+    return true;
+}
+
+// Tiled files are memory-mapped. The sparse engine takes the mapping as it
+// is and pages tiles in as they are viewed or stepped; the other engines
+// hold every cell themselves and get them a row of tiles at a time.
+bool Universe::LoadTiled(const std::string& path, bool resizeToFile) {
+    std::shared_ptr<TiledPatternFile> file = std::make_shared<TiledPatternFile>();
+    if (!file->Open(path)) return false;
+    if (file->Rule().NeedsBoundedBoard() && IsUnbounded()) return false;
+    ApplyRule(file->Rule());
+    SwitchEngine(SelectedEngine());
+    if (resizeToFile) Resize((int)std::min<int64_t>(file->Width(), INT_MAX), (int)std::min<int64_t>(file->Height(), INT_MAX));
+    if (resizeToFile && IsSparse() && file->Width() <= m_width && file->Height() <= m_height) {
+        m_sparse.Attach(file);
+    } else {
+        const int cols = (int)std::min<int64_t>(file->Width(), m_width);
+        const int rows = (int)std::min<int64_t>(file->Height(), m_height);
+        UniverseSnapshot band;
+        size_t i = 0;
+        for (int y0 = 0; y0 < rows; y0 += 64) {
+            band.Reset(cols, std::min(64, rows - y0));
+            for (; i < file->TileCount() && file->TileAt(i).ty <= y0/64; ++i) {
+                const TiledPatternFile::Tile& t = file->TileAt(i);
+                if (t.ty < y0/64 || t.tx < 0 || t.tx >= band.stride) continue;
+                for (int r = 0; r < band.height; ++r)
+                    band.Row(r)[t.tx] = t.rows[r] & ColumnMask(t.tx, 0, cols);
+            }
+            m_engine->Paste(band, 0, y0);
+        }
+    }
+    m_generation = file->Generation();
+    ResetHistory();
+    return true;
+}
@@ -0,0 +1,1311 @@
+// Game of Life engines, file formats and the background simulation thread.
+// Nothing in here depends on wxWidgets, so the GUI (main1.cpp) and the
+// command-line tool (life_cli.cpp) share it.
+#ifndef LIFE_ENGINE_H
+#define LIFE_ENGINE_H
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <memory>
+#include <new>
+#include <cstdio>
+#include <string>
+#include <deque>
+
+// ---------------- Aligned Storage ----------------
+// Boards live in cache-line aligned blocks, so a row padded to whole lines
+// starts on one and the kernels' vector loads never split a line. Like any
+// vector, resizing to no more than the capacity reuses the block, so loading
+// or resizing to the same size again doesn't go back to the heap.
+static const size_t kCacheLine = 64;
+
+template <class T>
+struct CacheAlignedAllocator {
+    typedef T value_type;
+    CacheAlignedAllocator() = default;
+    template <class U> CacheAlignedAllocator(const CacheAlignedAllocator<U>&) {}
+    T* allocate(size_t n) { return (T*)::operator new(n*sizeof(T), std::align_val_t(kCacheLine)); }
+    void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(kCacheLine)); }
+    template <class U> bool operator==(const CacheAlignedAllocator<U>&) const { return true; }
+    template <class U> bool operator!=(const CacheAlignedAllocator<U>&) const { return false; }
+};
+
+template <class T>
+using AlignedVector = std::vector<T, CacheAlignedAllocator<T>>;
+
+// ---------------- Worker Pool ----------------
+// Persistent threads for data-parallel work. Run() hands task indices
+// [0, count) out to the workers and the calling thread, and returns once all
+// of them have finished. Only one thread may call Run() at a time. The task
+// is passed on as a plain function and pointer rather than a std::function,
+// so a step never allocates however much its lambda captures.
+class WorkerPool {
+public:
+    explicit WorkerPool(int threads=0) { SetThreadCount(threads); }
+    ~WorkerPool() { StopWorkers(); }
+
+    void SetThreadCount(int threads); // 0 = one per hardware thread
+    int GetThreadCount() const { return (int)m_workers.size() + 1; }
+    template <class Task>
+    void Run(int count, const Task& task) {
+        Dispatch(count, [](const void* t, int i) { (*(const Task*)t)(i); }, &task);
+    }
+
+private:
+    typedef void (*TaskFn)(const void* task, int i);
+    void Dispatch(int count, TaskFn fn, const void* task);
+    void WorkerLoop(unsigned seen);
+    void RunTasks();
+    void StopWorkers();
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    TaskFn m_taskFn=nullptr;
+    const void* m_task=nullptr;
+    int m_count=0;
+    std::atomic<int> m_nextTask{0};
+    int m_busy=0;        // workers still inside the current job
+    unsigned m_job=0;    // bumped for every Run()
+    bool m_stop=false;
+};
+
+// ---------------- Rules ----------------
+// An outer-totalistic rule in B/S notation: a dead cell with n live neighbors
+// is born if bit n of 'birth' is set, and a live one survives if bit n of
+// 'survival' is. The default is Conway's B3/S23.
+//
+// Two extensions run on the multi-state engine only. Generations rules
+// ("B2/S/C3") have more than two states: a live cell that doesn't survive
+// goes through states 2 .. states-1 before it is dead, and only state 1
+// counts as a live neighbor. Larger than Life rules have a radius of 2 to
+// kMaxRadius and count the live cells in the (2r+1) x (2r+1) square around
+// a cell, the cell itself left out; one is born or survives if its count is
+// within [birthMin, birthMax] or [survivalMin, survivalMax] instead of the
+// masks.
+struct LifeRule {
+    static constexpr int kMaxRadius = 5;
+    static constexpr int kMaxStates = 256;
+
+    uint16_t birth = 1 << 3;
+    uint16_t survival = 1 << 2 | 1 << 3;
+    int states = 2;
+    int radius = 1;
+    int birthMin = 0, birthMax = 0;       // radius > 1 only
+    int survivalMin = 0, survivalMax = 0;
+
+    // "B36/S23" in either order and any case, or the older "23/36" (S/B),
+    // either with "/C<states>" or "/<states>" after it for Generations; or
+    // Golly's Larger than Life "R5,C0,M1,S34..58,B34..45,NM". False, leaving
+    // rule alone, if text isn't one of those.
+    static bool Parse(const std::string& text, LifeRule& rule);
+    std::string ToString() const; // "B36/S23", "B2/S/C3", "R5,C0,M0,S33..57,B34..45,NM"
+    // Empty space comes alive, so the board can't be unbounded.
+    bool BirthOnZero() const { return radius > 1 ? birthMin == 0 : (birth & 1); }
+    // Two states and the eight nearest neighbors, which every engine runs.
+    bool IsLifeLike() const { return states == 2 && radius == 1; }
+    // B0 and multi-state rules only run on finite and toroidal boards.
+    bool NeedsBoundedBoard() const { return BirthOnZero() || !IsLifeLike(); }
+    bool Born(int n) const { return radius > 1 ? n >= birthMin && n <= birthMax : (birth >> n) & 1; }
+    bool Survives(int n) const { return radius > 1 ? n >= survivalMin && n <= survivalMax : (survival >> n) & 1; }
+
+    bool operator==(const LifeRule& o) const {
+        return birth==o.birth && survival==o.survival && states==o.states && radius==o.radius
+            && birthMin==o.birthMin && birthMax==o.birthMax && survivalMin==o.survivalMin && survivalMax==o.survivalMax;
+    }
+    bool operator!=(const LifeRule& o) const { return !(*this == o); }
+};
+
+// The step kernels compiled for a rule; engines look theirs up once, when
+// the rule is set (see life_engine.cpp).
+struct RuleKernels;
+const RuleKernels* KernelsForRule(const LifeRule& rule);
+
+// ---------------- Life Engine ----------------
+// Runtime figures an engine can report for the HUD.
+struct EngineStats {
+    size_t memoryBytes=0;
+    size_t mappedBytes=0;  // sparse engine: size of an attached tiled file
+    size_t nodes=0;        // HashLife nodes or sparse tiles
+    size_t tiles=0;        // packed engine: tiles on the board
+    size_t activeTiles=0;  // ... and how many the last step computed
+    uint64_t births=0;     // cells born and died in the last step
+    uint64_t deaths=0;     // (packed and sparse engines)
+    uint64_t cacheLookups=0;
+    uint64_t cacheHits=0;
+};
+
+// A rectangle of the plane as it is shown: w x h pixels starting at cell
+// (x0, y0), each pixel covering 2^shift x 2^shift cells. With a shift, x0 and
+// y0 are multiples of 2^shift.
+struct ViewWindow {
+    int64_t x0=0, y0=0;
+    int w=0, h=0;
+    int shift=0;
+
+    bool operator==(const ViewWindow& o) const {
+        return x0==o.x0 && y0==o.y0 && w==o.w && h==o.h && shift==o.shift;
+    }
+    bool operator!=(const ViewWindow& o) const { return !(*this == o); }
+};
+
+// A w x h block of cells in the packed row layout (see PackedUniverse). Used
+// to hand frames to the GUI and to move cells in and out of any engine.
+struct UniverseSnapshot {
+    int width=0;
+    int height=0;
+    int stride=0;
+    std::vector<uint64_t> cells;
+    ViewWindow view;              // where a frame was taken from
+    std::vector<uint8_t> density; // zoomed-out frames: share of live cells per pixel, 0..255
+    std::vector<uint8_t> states;  // multi-state engine: each cell's state, row-major; else empty
+    std::vector<uint64_t> counts; // CopyDensity's live cells per pixel, kept between frames
+    uint64_t generation=0;
+    uint64_t population=0;
+    EngineStats stats;
+
+    void Reset(int w, int h) {
+        width = w; height = h; stride = (w + 63) / 64;
+        cells.assign((size_t)stride*height, 0);
+        states.clear();
+    }
+    const uint64_t* Row(int y) const { return &cells[(size_t)y*stride]; }
+    uint64_t* Row(int y) { return &cells[(size_t)y*stride]; }
+    bool Get(int x, int y) const { return (Row(y)[x>>6] >> (x&63)) & 1; }
+    void Set(int x, int y) { Row(y)[x>>6] |= uint64_t(1) << (x&63); }
+    void Toggle(int x, int y) { Row(y)[x>>6] ^= uint64_t(1) << (x&63); }
+};
+
+// How Paste combines a block of cells with the board under it: Copy
+// overwrites the board, Or adds the block's live cells to it and Xor toggles
+// the cells under them.
+enum class PasteMode { Copy, Or, Xor };
+
+// Interface shared by the stepping backends, so that the panel and the
+// simulation thread don't care how cells are stored. Coordinates are on the
+// plane; bounded engines ignore cells outside their board.
+class LifeEngine {
+public:
+    virtual ~LifeEngine() {}
+
+    virtual uint64_t Step() = 0; // returns the number of generations advanced
+    virtual void Clear() = 0;
+    virtual bool Get(int64_t x, int64_t y) const = 0;
+    virtual void Set(int64_t x, int64_t y, bool alive) = 0;
+    virtual void Toggle(int64_t x, int64_t y) { Set(x, y, !Get(x, y)); }
+    virtual uint64_t Population() const = 0;
+    // Combine snap with the cells under it, its top-left corner at (x0, y0).
+    virtual void Paste(const UniverseSnapshot& snap, int64_t x0, int64_t y0, PasteMode mode=PasteMode::Copy) = 0;
+    // Copy the w x h window at (x0, y0) into snap.
+    virtual void CopyTo(UniverseSnapshot& snap, int64_t x0, int64_t y0, int w, int h) const = 0;
+    // Fill snap.density with w x h pixels of 2^shift x 2^shift cells each.
+    virtual void CopyDensity(UniverseSnapshot& snap, int64_t x0, int64_t y0, int w, int h, int shift) const = 0;
+    virtual void GetStats(EngineStats&) const {}
+    // The cells already on the board stay as they are. False if the engine
+    // can't run the rule: B0 rules need a bounded board, and multi-state
+    // ones the multi-state engine.
+    virtual bool SetRule(const LifeRule& rule) = 0;
+    // A 64-bit hash of the whole board, for spotting repeated states. False
+    // if the engine can't produce one.
+    virtual bool StateHash(uint64_t&) { return false; }
+
+    // Cells when zoomed in, density when zoomed out.
+    void CopyView(UniverseSnapshot& snap, const ViewWindow& v) const {
+        if (v.shift > 0) { CopyDensity(snap, v.x0, v.y0, v.w, v.h, v.shift); snap.states.clear(); }
+        else { CopyTo(snap, v.x0, v.y0, v.w, v.h); snap.density.clear(); }
+        snap.view = v;
+    }
+};
+
+// Density pixel for a block of 2^shift x 2^shift cells; any life at all
+// shows up.
+static inline uint8_t DensityByte(uint64_t count, int shift) {
+    if (!count) return 0;
+    double area = (double)(uint64_t(1) << shift) * (double)(uint64_t(1) << shift);
+    return (uint8_t)std::min(255.0, std::max(1.0, count * 255.0 / area));
+}
+
+// snap.counts, zeroed for a w x h frame, for CopyDensity to count into.
+static inline std::vector<uint64_t>& DensityCounts(UniverseSnapshot& snap, int w, int h) {
+    snap.counts.assign((size_t)w*h, 0);
+    return snap.counts;
+}
+
+// The per-pixel live counts converted into snap.density.
+static inline void StoreDensity(UniverseSnapshot& snap, int shift) {
+    snap.density.resize(snap.counts.size());
+    for (size_t i=0; i<snap.counts.size(); ++i) snap.density[i] = DensityByte(snap.counts[i], shift);
+}
+
+static inline int PopCount64(uint64_t v) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(v);
+#else
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// Index of the lowest/highest set bit; v must not be zero.
+static inline int CountTrailingZeros64(uint64_t v) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(v);
+#else
+    int n=0; while (!(v & 1)) { v >>= 1; ++n; } return n;
+#endif
+}
+
+static inline int CountLeadingZeros64(uint64_t v) {
+#if defined(__GNUC__)
+    return __builtin_clzll(v);
+#else
+    int n=0; while (!(v >> 63)) { v <<= 1; ++n; } return n;
+#endif
+}
+
+// v with its bits in the opposite order.
+static inline uint64_t ReverseBits64(uint64_t v) {
+    v = ((v >> 1) & 0x5555555555555555ULL) | ((v & 0x5555555555555555ULL) << 1);
+    v = ((v >> 2) & 0x3333333333333333ULL) | ((v & 0x3333333333333333ULL) << 2);
+    v = ((v >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((v & 0x0F0F0F0F0F0F0F0FULL) << 4);
+#if defined(__GNUC__)
+    return __builtin_bswap64(v);
+#else
+    v = ((v >> 8) & 0x00FF00FF00FF00FFULL) | ((v & 0x00FF00FF00FF00FFULL) << 8);
+    v = ((v >> 16) & 0x0000FFFF0000FFFFULL) | ((v & 0x0000FFFF0000FFFFULL) << 16);
+    return (v >> 32) | (v << 32);
+#endif
+}
+
+// 64 bits of a packed row starting at column 'bit'; columns outside the row
+// read as dead.
+static inline uint64_t ReadBits64(const uint64_t* row, int words, int64_t bit) {
+    int64_t w = bit >> 6;
+    int s = (int)(bit & 63);
+    uint64_t lo = (w>=0 && w<words) ? row[w] : 0;
+    uint64_t hi = (w+1>=0 && w+1<words) ? row[w+1] : 0;
+    return s ? (lo >> s) | (hi << (64-s)) : lo;
+}
+
+// Mask of the bits of word 'word' that fall in columns [x0, x1).
+static inline uint64_t ColumnMask(int64_t word, int64_t x0, int64_t x1) {
+    int64_t lo = std::max<int64_t>(x0 - word*64, 0);
+    int64_t hi = std::min<int64_t>(x1 - word*64, 64);
+    if (lo >= hi) return 0;
+    uint64_t upto = (hi==64) ? ~uint64_t(0) : (uint64_t(1) << hi) - 1;
+    return upto & ~((uint64_t(1) << lo) - 1);
+}
+
+// A board word after Paste combined it with 'bits', which are already
+// limited to the columns in 'mask'.
+static inline uint64_t PasteWord(uint64_t old, uint64_t bits, uint64_t mask, PasteMode mode) {
+    switch (mode) {
+    case PasteMode::Or: return old | bits;
+    case PasteMode::Xor: return old ^ bits;
+    default: return (old & ~mask) | bits;
+    }
+}
+
+// ---------------- Boundaries ----------------
+// What lies past the edges of a bounded board:
+//   Finite       dead cells
+//   Toroidal     the opposite edge, left to right and top to bottom
+//   KleinBottle  left to right as on a torus, but top to bottom the row is
+//                flipped, so a glider leaving through the top comes back in
+//                at the bottom mirror-imaged
+//   Mirror       the board reflected across each edge, so the cells just
+//                past an edge are copies of the edge cells themselves
+//   Infinite     no edges at all, on the sparse engine
+// The bounded engines are specialized on the boundary at compile time, and
+// meet it through ghost rows and edge words rather than tests per cell.
+enum class Boundary { Finite, Toroidal, KleinBottle, Mirror, Infinite };
+
+const char* BoundaryName(Boundary boundary);
+bool ParseBoundary(const std::string& name, Boundary& boundary); // false if unknown
+
+// ---------------- Packed Universe ----------------
+// One bit per cell, 64 cells per word, each row padded to a whole number of
+// words. Column x lives in bit (x % 64) of word (x / 64); the padding bits
+// past the last column are always kept zero. In memory each row takes a
+// whole number of cache lines, and there is a ghost row above and below the
+// board holding whatever the boundary puts past the edge: dead cells, the
+// opposite edge row (flipped on a Klein bottle) or the edge row itself.
+// They are refreshed before every step, so the kernels read the rows around
+// every row alike; the left and right edges are handled in the first and
+// last word of each row.
+//
+// The board is also divided into tiles of kTileRows rows by one word, and the
+// step skips any tile whose neighborhood did not change in the last
+// generation, or is back to what it was two generations ago (period-2
+// oscillators). The skipped tile's previous-but-one state, still sitting in
+// m_next, is then already its next state.
+//
+// Each tile also caches a hash of its current and its previous state, the
+// XOR of a hash of each non-zero word and its position. Skipped tiles just
+// swap the two; computed and edited ones are only hashed again when
+// StateHash() asks, so a board that has mostly settled hashes in next to no
+// time and one that hasn't costs nothing until somebody wants its hash.
+class PackedUniverse : public LifeEngine {
+public:
+    static const int kTileRows = 32;
+
+    void Resize(int w, int h);
+    // Infinite is taken as Finite.
+    void SetBoundary(Boundary boundary) { if (boundary != m_boundary) { m_boundary = boundary; MarkAllDirty(); } }
+    void SetPool(WorkerPool* pool) { m_pool = pool; }
+
+    uint64_t Step() override;
+    void Clear() override;
+    bool Get(int64_t x, int64_t y) const override { return Contains(x, y) && GetCell((int)x, (int)y); }
+    void Set(int64_t x, int64_t y, bool alive) override { if (Contains(x, y)) SetCell((int)x, (int)y, alive); }
+    void Toggle(int64_t x, int64_t y) override {
+        if (!Contains(x, y)) return;
+        uint64_t& w = Row((int)y)[x>>6];
+        w ^= uint64_t(1) << (x&63);
+        m_population += ((w >> (x&63)) & 1) ? 1 : -1;
+        MarkDirty((int)x, (int)y);
+    }
+    uint64_t Population() const override { return m_population; }
+    void Paste(const UniverseSnapshot& snap, int64_t x0, int64_t y0, PasteMode mode=PasteMode::Copy) override;
+    void CopyTo(UniverseSnapshot& snap, int64_t x0, int64_t y0, int w, int h) const override;
+    void CopyDensity(UniverseSnapshot& snap, int64_t x0, int64_t y0, int w, int h, int shift) const override;
+    void GetStats(EngineStats& stats) const override;
+    bool SetRule(const LifeRule& rule) override;
+    bool StateHash(uint64_t& hash) override;
+
+    int GetWidth() const { return m_width; }
+    int GetHeight() const { return m_height; }
+    int GetStride() const { return m_stride; }
+    bool Contains(int64_t x, int64_t y) const { return x>=0 && x<m_width && y>=0 && y<m_height; }
+    bool GetCell(int x, int y) const { return (Row(y)[x>>6] >> (x&63)) & 1; }
+    void SetCell(int x, int y, bool alive) {
+        uint64_t bit = uint64_t(1) << (x&63);
+        uint64_t& w = Row(y)[x>>6];
+        if (((w & bit) != 0) == alive) return;
+        w ^= bit;
+        m_population += alive ? 1 : -1;
+        MarkDirty(x, y);
+    }
+
+    uint64_t* Row(int y) { return &m_cells[(size_t)(y+1)*m_pitch]; }
+    const uint64_t* Row(int y) const { return &m_cells[(size_t)(y+1)*m_pitch]; }
+    uint64_t LastWordMask() const {
+        int used = m_width & 63;
+        return used ? (uint64_t(1) << used) - 1 : ~uint64_t(0);
+    }
+
+private:
+    // Per-tile change flags. kTileEdited keeps a tile's kTileChanged2 set for
+    // one more step after it was written from outside, since its m_next no
+    // longer holds the generation before it.
+    enum : uint8_t { kTileChanged1 = 1, kTileChanged2 = 2, kTileEdited = 4, kTileDirty = 7 };
+
+    template <Boundary B> void RefreshGhostRows();
+    template <Boundary B> void HorizontalPairs(const uint64_t* row, uint64_t* x, uint64_t* a, int begin, int end) const;
+    template <Boundary B> void StepRows(int y0, int y1, int begin, int end, uint64_t* scratch);
+    template <Boundary B> void StepBands(int b0, int b1, uint64_t* scratch);
+    template <Boundary B> void FindActiveTiles();
+    template <Boundary B> void StepWith();
+    int TileRows() const { return (m_height + kTileRows-1) / kTileRows; }
+    void MarkDirty(int x, int y) {
+        size_t t = (size_t)(y/kTileRows)*m_stride + (x>>6);
+        m_tileFlags[t] = kTileDirty;
+        m_tileHashed[t] = 0;
+    }
+    void MarkAllDirty() {
+        std::fill(m_tileFlags.begin(), m_tileFlags.end(), (uint8_t)kTileDirty);
+        std::fill(m_tileHashed.begin(), m_tileHashed.end(), (uint8_t)0);
+    }
+
+    int m_width=0;
+    int m_height=0;
+    int m_stride=0; // words per row
+    int m_pitch=0;  // ... in memory, a whole number of cache lines
+    Boundary m_boundary=Boundary::Toroidal;
+    LifeRule m_rule;
+    const RuleKernels* m_kernels=KernelsForRule(LifeRule());
+    WorkerPool* m_pool=nullptr;
+    AlignedVector<uint64_t> m_cells;   // m_height + 2 rows of m_pitch words, ghosts included
+    AlignedVector<uint64_t> m_next;
+    AlignedVector<uint64_t> m_scratch; // kScratchRows rows of m_pitch words per stripe
+    std::vector<uint8_t> m_tileFlags;  // one per tile, row-major
+    std::vector<uint8_t> m_tileActive; // tiles the current step computes
+    std::vector<uint8_t> m_tileOr;     // FindActiveTiles temporary
+    std::vector<uint16_t> m_tileBirths; // per tile, in the last step
+    std::vector<uint16_t> m_tileDeaths;
+    std::vector<uint64_t> m_tileHash;  // per tile, of the current generation
+    std::vector<uint64_t> m_tileHash2; // ... and of the one before
+    std::vector<uint8_t> m_tileHashed; // bit 0: m_tileHash is valid, bit 1: m_tileHash2 is
+    std::vector<int> m_staleTiles;     // StateHash temporary
+    size_t m_activeTiles=0;
+    uint64_t m_population=0; // kept up to date by Step() and the edits
+    uint64_t m_births=0, m_deaths=0;
+};
+
+// ---------------- Multi-State Universe ----------------
+// Bounded board for the rules the packed engine can't run: Generations and
+// Larger than Life (see LifeRule). Cells are packed at the fewest bits their
+// rule's states fit in, 1, 4 or 8, with each row padded to whole bytes.
+//
+// Neighbor counts are running sums. Each column keeps the number of live
+// cells in the 2r+1 rows around the current row, updated by adding the row
+// that comes into range and taking away the one that leaves it, and a
+// window of 2r+1 of those column sums slides along the row. A cell costs the
+// same whatever the radius.
+class MultiStateUniverse : public LifeEngine {
+public:
+    static constexpr int kMaxCount = (2*LifeRule::kMaxRadius + 1) * (2*LifeRule::kMaxRadius + 1) - 1;
+
+    MultiStateUniverse() { SetRule(LifeRule()); }
+
+    void Resize(int w, int h);
+    void SetBoundary(Boundary boundary) { m_boundary = boundary; } // Infinite is taken as Finite
+    void SetPool(WorkerPool* pool) { m_pool = pool; }
+
+    uint64_t Step() override;
+    void Clear() override;
+    // State 1 is alive. Setting a cell makes it state 1 or 0, and toggling a
+    // dying cell kills it.
+    bool Get(int64_t x, int64_t y) const override { return Contains(x, y) && GetState((int)x, (int)y) == 1; }
+    void Set(int64_t x, int64_t y, bool alive) override { if (Contains(x, y)) SetState((int)x, (int)y, alive); }
+    void Toggle(int64_t x, int64_t y) override {
+        if (Contains(x, y)) SetState((int)x, (int)y, GetState((int)x, (int)y) == 0);
+    }
+    uint64_t Population() const override { return m_population; } // state 1 only
+    void Paste(const UniverseSnapshot& snap, int64_t x0, int64_t y0, PasteMode mode=PasteMode::Copy) override;
+    // Fills snap.states as well as the live cells.
+    void CopyTo(UniverseSnapshot& snap, int64_t x0, int64_t y0, int w, int h) const override;
+    void CopyDensity(UniverseSnapshot& snap, int64_t x0, int64_t y0, int w, int h, int shift) const override;
+    void GetStats(EngineStats& stats) const override;
+    // Cells in states the new rule doesn't have are cleared.
+    bool SetRule(const LifeRule& rule) override;
+    bool StateHash(uint64_t& hash) override;
+
+    bool Contains(int64_t x, int64_t y) const { return x>=0 && x<m_width && y>=0 && y<m_height; }
+    int GetState(int x, int y) const {
+        return (Row(y)[(size_t)x*m_bits >> 3] >> ((x*m_bits) & 7)) & ((1 << m_bits) - 1);
+    }
+    void SetState(int x, int y, int state);
+    int CellBits() const { return m_bits; }
+
+private:
+    static int BitsForStates(int states) { return states <= 2 ? 1 : states <= 16 ? 4 : 8; }
+    uint8_t* Row(int y) { return &m_cells[(size_t)y*m_rowBytes]; }
+    const uint8_t* Row(int y) const { return &m_cells[(size_t)y*m_rowBytes]; }
+    template <class Fn> void ForEachCellIn(int64_t x0, int64_t y0, int64_t x1, int64_t y1, Fn fn) const;
+    template <Boundary B> int BoardRow(int y, bool& flipped) const;
+    template <Boundary B> void EdgeColumns(uint16_t* sums) const;
+    template <Boundary B, int Bits> void AddRow(int y, int sign, uint16_t* sums) const;
+    template <Boundary B, int Bits> void StepRows(int y0, int y1, uint16_t* sums, uint64_t& births, uint64_t& deaths);
+    template <Boundary B> void StepBoundary(int y0, int y1, uint16_t* sums, uint64_t& births, uint64_t& deaths);
+    void StepStripe(int y0, int y1, uint16_t* sums, uint64_t& births, uint64_t& deaths);
+    void Repack(int bits, int states);
+
+    int m_width=0;
+    int m_height=0;
+    int m_bits=1;         // per cell
+    size_t m_rowBytes=0;
+    Boundary m_boundary=Boundary::Toroidal;
+    LifeRule m_rule;
+    // Next states: of dead and then live cells by live-neighbor count, then
+    // of dying cells by state.
+    static constexpr int kDyingBase = 2*(kMaxCount + 1);
+    uint8_t m_transition[kDyingBase + LifeRule::kMaxStates] = {};
+    WorkerPool* m_pool=nullptr;
+    AlignedVector<uint8_t> m_cells;
+    AlignedVector<uint8_t> m_next;
+    std::vector<uint16_t> m_sums;    // column sums, one row of them per stripe
+    std::vector<uint64_t> m_stripeBirths, m_stripeDeaths;
+    uint64_t m_population=0;
+    uint64_t m_births=0, m_deaths=0;
+};
+
+// ---------------- HashLife ----------------
+// Gosper's HashLife on an unbounded plane. The universe is a quadtree whose
+// nodes are canonicalized through a hash table, so identical regions are
+// stored once, and the result of advancing a node is memoized on the node.
+// That lets one Step() jump 2^k generations in time roughly proportional to
+// the number of distinct regions instead of area x generations. Leaves are
+// 8x8 blocks packed into a uint64_t (bit y*8+x). The root is centred on the
+// origin; a node of level L covers 2^L x 2^L cells.
+class HashLifeUniverse : public LifeEngine {
+public:
+    static constexpr int kMaxStepExponent = 48;
+
+    HashLifeUniverse() { Reset(); }
+
+    void SetStepExponent(int e) { m_stepExponent = std::max(0, std::min(e, kMaxStepExponent)); }
+    int GetStepExponent() const { return m_stepExponent; }
+    void SetMaxMemory(size_t bytes);
+    void CollectGarbage();
+
+    uint64_t Step() override;
+    void Clear() override { Reset(); }
+    bool Get(int64_t x, int64_t y) const override;
+    void Set(int64_t x, int64_t y, bool alive) override;
+    uint64_t Population() const override { return m_nodes[m_root].population; }
+    void Paste(const UniverseSnapshot& snap, int64_t x0, int64_t y0, PasteMode mode=PasteMode::Copy) override;
+    void CopyTo(UniverseSnapshot& snap, int64_t x0, int64_t y0, int w, int h) const override;
+    void CopyDensity(UniverseSnapshot& snap, int64_t x0, int64_t y0, int w, int h, int shift) const override;
+    void GetStats(EngineStats& stats) const override;
+    bool SetRule(const LifeRule& rule) override;
+
+private:
+    typedef uint32_t NodeId;
+    struct Node {
+        union {
+            NodeId child[4];   // nw, ne, sw, se
+            uint64_t bits;     // leaves only
+        };
+        uint64_t population;   // saturates at 2^64-1
+        NodeId result;         // memoized centre after 2^resultExp generations, 0 = none
+        NodeId next;           // hash chain
+        uint8_t level;         // 0 = free slot
+        uint8_t resultExp;
+        bool mark;
+    };
+    static constexpr int kLeafLevel = 3;
+    static constexpr int kMaxLevel = 62;  // keeps every coordinate inside int64_t
+
+    void Reset();
+    NodeId NewNode();
+    void Insert(NodeId id, size_t hash);
+    void Rehash(size_t buckets);
+    NodeId Leaf(uint64_t bits);
+    NodeId Join(NodeId nw, NodeId ne, NodeId sw, NodeId se);
+    NodeId Empty(int level);
+    NodeId Child(NodeId n, int q) const { return m_nodes[n].child[q]; }
+    int Level(NodeId n) const { return m_nodes[n].level; }
+    void Assemble16(NodeId n, uint32_t rows[16]) const;
+    NodeId Centre(NodeId n);
+    NodeId Expand(NodeId n);
+    bool IsCentred(NodeId n) const;
+    NodeId Result(NodeId n, int exp);
+    NodeId LeafResult(NodeId n, int gens);
+    int64_t RootHalf() const { return int64_t(1) << (Level(m_root)-1); }
+    bool EnsureContains(int64_t x0, int64_t y0, int64_t x1, int64_t y1);
+    NodeId SetLeaf(NodeId n, int64_t ox, int64_t oy, int64_t lx, int64_t ly, uint64_t bits, uint64_t mask,
+                   PasteMode mode=PasteMode::Copy);
+    void CopyNode(NodeId n, int64_t ox, int64_t oy, UniverseSnapshot& snap, int64_t x0, int64_t y0) const;
+    void CountNode(NodeId n, int64_t ox, int64_t oy, std::vector<uint64_t>& counts,
+                   int64_t x0, int64_t y0, int w, int h, int shift) const;
+    void Mark(NodeId n);
+
+    std::vector<Node> m_nodes;     // slot 0 is the null id
+    std::vector<NodeId> m_free;
+    std::vector<NodeId> m_buckets; // power-of-two hash table of chains
+    std::vector<NodeId> m_empty;   // canonical empty node per level
+    size_t m_liveNodes=0;
+    size_t m_maxNodes=0;
+    NodeId m_root=0;
+    int m_stepExponent=0;
+    LifeRule m_rule;
+    const RuleKernels* m_kernels=KernelsForRule(LifeRule());
+    uint64_t m_lookups=0;
+    uint64_t m_hits=0;
+};
+
+// ---------------- Sparse Universe ----------------
+class TiledPatternFile;
+
+// Unbounded plane stored as a hash map of 64x64 tiles, each tile 64 packed
+// rows. Only tiles holding live cells are kept, and a step only visits those
+// tiles plus the neighbors their edge cells can reach, so the cost of a
+// generation follows the population rather than the area.
+class SparseUniverse : public LifeEngine {
+public:
+    // Also the record layout of tiled files (see TiledPatternFile).
+    struct Tile {
+        int32_t tx, ty;
+        uint64_t rows[64];
+    };
+
+    // Replaces the board with the cells of a memory-mapped tiled file. Its
+    // tiles are read straight from the mapping, so only the ones looked at
+    // get paged in; they are copied into the engine when edited, and the
+    // first step copies the rest and lets go of the file.
+    void Attach(std::shared_ptr<const TiledPatternFile> file);
+
+    uint64_t Step() override;
+    void Clear() override;
+    bool Get(int64_t x, int64_t y) const override;
+    void Set(int64_t x, int64_t y, bool alive) override;
+    void Toggle(int64_t x, int64_t y) override;
+    uint64_t Population() const override { return m_population; }
+    void Paste(const UniverseSnapshot& snap, int64_t x0, int64_t y0, PasteMode mode=PasteMode::Copy) override;
+    void CopyTo(UniverseSnapshot& snap, int64_t x0, int64_t y0, int w, int h) const override;
+    void CopyDensity(UniverseSnapshot& snap, int64_t x0, int64_t y0, int w, int h, int shift) const override;
+    void GetStats(EngineStats& stats) const override;
+    bool SetRule(const LifeRule& rule) override;
+
+private:
+    // Open-addressing map from packed tile coordinates to an index into a
+    // tile vector. Clear() keeps the capacity, so stepping doesn't allocate
+    // once the tables have grown to fit the pattern.
+    class TileIndex {
+    public:
+        static constexpr uint64_t kEmpty = 0x8000000080000000ULL; // tile (INT32_MIN, INT32_MIN) is never used
+        void Clear() { std::fill(m_keys.begin(), m_keys.end(), kEmpty); m_count = 0; }
+        int Find(uint64_t key) const;
+        void Insert(uint64_t key, uint32_t index);
+        size_t Capacity() const { return m_keys.size(); }
+    private:
+        void Grow();
+        std::vector<uint64_t> m_keys;
+        std::vector<uint32_t> m_values;
+        size_t m_count=0;
+    };
+
+    static uint64_t Key(int32_t tx, int32_t ty) { return (uint64_t)(uint32_t)tx << 32 | (uint32_t)ty; }
+    static bool TileCoords(int64_t x, int64_t y, int32_t& tx, int32_t& ty);
+    const Tile* FindTile(int32_t tx, int32_t ty) const;
+    template<class Fn> void ForEachTileIn(int64_t x0, int64_t y0, int64_t spanX, int64_t spanY, Fn fn) const;
+    Tile* GetOrCreateTile(int32_t tx, int32_t ty);
+    void AddCandidate(int64_t tx, int64_t ty);
+    void StepTile(int32_t tx, int32_t ty, uint64_t out[64], uint64_t& births, uint64_t& deaths) const;
+    template<class Fn> void ForEachTile(Fn fn) const;
+    size_t TileCount() const;
+
+    std::vector<Tile> m_tiles;      // may contain empty tiles after edits
+    TileIndex m_index;
+    std::shared_ptr<const TiledPatternFile> m_mapped; // tiles not in m_tiles yet
+    size_t m_faulted=0;             // mapped tiles since copied into m_tiles
+    std::vector<Tile> m_nextTiles;
+    TileIndex m_nextIndex;
+    std::vector<uint64_t> m_candidates;
+    LifeRule m_rule;
+    const RuleKernels* m_kernels=KernelsForRule(LifeRule());
+    uint64_t m_population=0;
+    uint64_t m_births=0, m_deaths=0;
+};
+
+// ---------------- Pattern Files ----------------
+// Universe file formats. Readers and writers stream through the file a row
+// at a time, so neither the whole file nor the whole board is ever held in
+// memory.
+//   Text    "w h [rule]" line, then one line of '0'/'1' characters per row
+//   RLE     the run-length encoding most Life programs exchange patterns in
+//   Cells   plaintext: '.' dead, 'O' alive, lines starting with '!' are
+//           comments; a "!Rule: B36/S23" comment sets the rule
+//   Binary  magic "LIFEPK02", then width, height, generation and rule
+//           (birth | survival << 16) as 64-bit little-endian integers, then
+//           each row as ceil(width/64) little-endian words in the packed row
+//           layout. "LIFEPK01" files have no rule word.
+//   Tiled   memory-mapped rather than streamed; see TiledPatternFile
+// A file that names no rule is B3/S23, and Conway's rule is only written
+// where a format always carries one. The rule word of binary and tiled
+// files only holds two-state rules on the 3x3 neighborhood, so writing
+// either under a Generations or Larger than Life rule fails. RLE files with
+// Golly's multi-state cells ('.', 'A', 'B', ...) read state A as alive and
+// the rest as dead.
+enum class PatternFormat { Text, RLE, Cells, Binary, Tiled };
+
+PatternFormat PatternFormatForExtension(const std::string& ext); // Text if unknown
+PatternFormat PatternFormatForPath(const std::string& path);
+
+class PatternReader {
+public:
+    ~PatternReader() { Close(); }
+
+    // Takes ownership of f and reads the header. 'format' is a guess from the
+    // file name; binary files are recognized by their magic number.
+    bool Open(std::FILE* f, PatternFormat format);
+    void Close();
+    PatternFormat Format() const { return m_format; }
+    int64_t Width() const { return m_width; }
+    int64_t Height() const { return m_height; }
+    uint64_t Generation() const { return m_generation; }
+    const LifeRule& Rule() const { return m_rule; }
+
+    // Reads the next row into row, keeping its first 'cols' columns; row
+    // must hold (cols+63)/64 words. False after the last row or at the end
+    // of a truncated file.
+    bool NextRow(uint64_t* row, int cols);
+
+private:
+    int Get();
+    int Peek();
+    bool Read(void* dst, size_t bytes);
+    bool Rewind();
+    std::string ReadLine();
+    bool ReadTextHeader();
+    bool ReadRLEHeader();
+    bool MeasureCells();
+    bool ReadBinaryHeader(bool withRule);
+    bool ReadTextRow(uint64_t* row, int cols);
+    bool ReadRLERow(uint64_t* row, int cols);
+    bool ReadCellsRow(uint64_t* row, int cols);
+    bool ReadBinaryRow(uint64_t* row, int cols);
+
+    std::FILE* m_file=nullptr;
+    std::vector<char> m_buf;
+    size_t m_pos=0, m_end=0;
+    PatternFormat m_format=PatternFormat::Text;
+    int64_t m_width=0, m_height=0;
+    uint64_t m_generation=0;
+    LifeRule m_rule;
+    int64_t m_row=0;               // rows handed out so far
+    int64_t m_blankRows=0;         // RLE: empty rows still owed by an "n$"
+    bool m_ended=false;            // RLE: '!' seen, the rest is empty
+    std::vector<uint64_t> m_wide;  // binary rows wider than the caller wants
+};
+
+// Writes the w x h block at the engine's origin, copying it out a band of
+// rows at a time.
+bool WritePattern(std::FILE* f, PatternFormat format, const LifeEngine& engine, int w, int h, uint64_t generation,
+                  const LifeRule& rule);
+
+// Rows per band when streaming a board of the given width through a file.
+int PatternBandRows(int width);
+
+// A tiled universe file, opened through a read-only memory map so that
+// opening costs the same whatever the size of the file and only the tiles
+// that are looked at get paged in. Layout, all little-endian:
+//   header  magic "LIFETL01", then width, height, generation, population,
+//           tile count, key offset, tile offset and rule as 64-bit integers;
+//           the rule word is birth | survival << 16 | 1 << 32, or 0 in
+//           files from before it was written, which are B3/S23
+//   tiles   one SparseUniverse::Tile record per 64x64 tile with live cells,
+//           ordered by row of tiles, then column
+//   keys    one 64-bit key per tile, (ty << 32) | tx, in the same order; a
+//           binary search over these finds a tile without touching the
+//           tile records
+class TiledPatternFile {
+public:
+    typedef SparseUniverse::Tile Tile;
+
+    TiledPatternFile() {}
+    TiledPatternFile(const TiledPatternFile&) = delete;
+    TiledPatternFile& operator=(const TiledPatternFile&) = delete;
+    ~TiledPatternFile() { Close(); }
+
+    bool Open(const std::string& path);
+    void Close();
+    int64_t Width() const { return m_width; }
+    int64_t Height() const { return m_height; }
+    uint64_t Generation() const { return m_generation; }
+    uint64_t Population() const { return m_population; }
+    const LifeRule& Rule() const { return m_rule; }
+    size_t TileCount() const { return m_count; }
+    size_t MappedBytes() const { return m_size; }
+    const Tile& TileAt(size_t i) const { return m_tiles[i]; }
+    const Tile* Find(int32_t tx, int32_t ty) const;
+
+private:
+    const char* m_data=nullptr;
+    size_t m_size=0;
+    void* m_mapping=nullptr; // Windows file mapping handle
+    int64_t m_width=0, m_height=0;
+    uint64_t m_generation=0, m_population=0;
+    LifeRule m_rule;
+    size_t m_count=0;
+    const uint64_t* m_keys=nullptr;
+    const Tile* m_tiles=nullptr;
+};
+
+// Writes the w x h block at the engine's origin as a tiled file. f must be
+// seekable; the header is filled in last.
+bool WriteTiledPattern(std::FILE* f, const LifeEngine& engine, int w, int h, uint64_t generation,
+                       const LifeRule& rule);
+
+// ---------------- Pattern Library ----------------
+// The pattern files (Text, RLE, Cells and Binary) of one directory, each read
+// once and kept as packed cells cut down to its live cells' bounding box, so
+// that stamping one into a universe is a single word-level Paste and a
+// browser can draw thumbnails without going back to the files. Still lifes,
+// oscillators and spaceships up to kMaxPeriod get their period found by
+// running them.
+//
+// What was read is cached in a binary file, and a file whose size and
+// modification time still match its cache entry isn't read again. Cache
+// layout, 64-bit little-endian words, strings as their length followed by
+// their bytes padded to a whole word:
+//   header  magic "LIFELB01", the directory, the entry count
+//   entry   name, file size, modification time, width, height, population,
+//           period, rule, then height rows of ceil(width/64) words in the
+//           packed row layout
+class PatternLibrary {
+public:
+    static constexpr int kMaxSide = 4096; // larger files are left out
+    static constexpr int kMaxPeriod = 64;
+
+    struct Pattern {
+        std::string name;       // file name within the directory
+        uint64_t fileSize=0;
+        int64_t modified=0;     // the file system's time stamp, only compared
+        LifeRule rule;
+        uint64_t population=0;
+        int period=0;           // 1 for a still life, 0 if none was found
+        UniverseSnapshot cells; // the bounding box, 0 x 0 for an empty file
+    };
+
+    // Indexes dir, taking what it can from the cache at cachePath and
+    // rewriting the cache if anything changed; an empty cachePath uses none.
+    // False, with the library emptied, if dir can't be listed.
+    bool Open(const std::string& dir, const std::string& cachePath);
+    const std::string& Directory() const { return m_dir; }
+    size_t Size() const { return m_patterns.size(); }
+    const Pattern& At(size_t i) const { return m_patterns[i]; } // sorted by name
+    int Find(const std::string& name) const; // -1 if there is none
+    size_t FilesRead() const { return m_filesRead; } // by the last Open, not cached
+
+    // At most size x size pixels of one byte each, the share of live cells
+    // under the pixel; any life at all shows up.
+    void Thumbnail(size_t i, int size, std::vector<uint8_t>& pixels, int& w, int& h) const;
+
+    // Reads one file into everything but the name and the file's stamps.
+    static bool Read(const std::string& path, Pattern& pattern);
+    // The period of cells, which are cut to their bounding box, under rule;
+    // 0 if it has none up to kMaxPeriod or can't be run.
+    static int FindPeriod(const UniverseSnapshot& cells, uint64_t population, const LifeRule& rule);
+
+private:
+    bool LoadCache(const std::string& path, const std::string& dir, std::vector<Pattern>& cached) const;
+    bool SaveCache(const std::string& path) const;
+
+    std::string m_dir;
+    std::vector<Pattern> m_patterns;
+    size_t m_filesRead=0;
+};
+
+// ---------------- Generation History ----------------
+// Past generations of a bounded board, for stepping back and rewinding.
+// Every so many generations the board is captured as a checkpoint: XORed
+// against the previous one and stored as runs of changed 64-bit words, with
+// a full keyframe every kKeyframeEvery checkpoints. Cell toggles are logged
+// with their generation. A generation between checkpoints is rebuilt from
+// the one before it by stepping forward and replaying the toggles.
+//
+// The gap between checkpoints adapts so that capturing costs about 2% of
+// the time spent stepping. When the memory limit is reached the oldest
+// keyframe and its deltas are dropped.
+class GenerationHistory {
+public:
+    static constexpr int kKeyframeEvery = 16;
+    static constexpr int kMinInterval = 8;    // generations between checkpoints
+    static constexpr int kMaxInterval = 4096;
+
+    void SetMemoryLimit(size_t bytes) { m_limit = bytes; } // takes effect on Reset(); 0 = off
+    size_t GetMemoryLimit() const { return m_limit; }
+
+    // Starts over from the engine's w x h board at (0, 0); w = 0 turns
+    // history off, as it is for unbounded engines.
+    void Reset(const LifeEngine& engine, int w, int h, uint64_t generation);
+    bool IsEnabled() const { return m_enabled; }
+
+    // Called after each step, by whichever thread is stepping the engine.
+    void AfterStep(const LifeEngine& engine, uint64_t generation) {
+        m_generation = generation;
+        if (m_enabled && generation >= m_nextCapture) Capture(engine);
+    }
+    void RecordToggle(int64_t x, int64_t y);
+
+    // Puts the engine back to 'target', which must lie between
+    // OldestGeneration() and the current generation; later history is
+    // discarded. Returns false if it is out of range.
+    bool Rewind(LifeEngine& engine, uint64_t target);
+    uint64_t OldestGeneration() const { return m_checkpoints.empty() ? m_generation : m_checkpoints.front().generation; }
+    size_t MemoryBytes() const { return m_bytes + m_last.cells.size() * sizeof(uint64_t); }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    struct Checkpoint {
+        uint64_t generation;
+        bool keyframe;
+        std::vector<uint64_t> data; // run headers (zeros << 32 | literals), each followed by its literals
+    };
+    struct ToggleEvent {
+        uint64_t generation;
+        int64_t x, y;
+    };
+
+    void Capture(const LifeEngine& engine);
+    void Evict();
+    void Decode(size_t index, UniverseSnapshot& out) const;
+    static void Encode(const UniverseSnapshot& cur, const UniverseSnapshot* prev, std::vector<uint64_t>& out);
+    static void Apply(const std::vector<uint64_t>& data, UniverseSnapshot& snap);
+
+    std::deque<Checkpoint> m_checkpoints; // oldest first
+    std::deque<ToggleEvent> m_toggles;    // oldest first
+    UniverseSnapshot m_last;              // the board at the newest checkpoint
+    UniverseSnapshot m_scratch;
+    std::vector<uint64_t> m_encoded;      // Encode's output before it is copied into a checkpoint
+    int m_width=0, m_height=0;
+    uint64_t m_generation=0;
+    uint64_t m_nextCapture=0;
+    int m_interval=kMinInterval;
+    int m_sinceKeyframe=0;
+    size_t m_limit=0;
+    size_t m_bytes=0;
+    Clock::time_point m_lastCapture;
+    bool m_enabled=false;
+};
+
+// ---------------- Cycle Detection ----------------
+// Notices the board coming back to a state it was in before, going by the
+// engine's StateHash(). Sampled generations go into an open-addressed table
+// of hash -> generation, and a hash seen twice means the board has been
+// periodic since at least the first of the two. The period is then pinned
+// down by hashing every generation until that state comes round again.
+// Period 1 means the board has stopped changing.
+//
+// Like GenerationHistory, the gap between samples adapts so that hashing
+// costs about 2% of the time spent stepping; it comes down to every
+// generation once most of the board has settled and hashes cheaply. Start()
+// is exact while every generation is sampled and otherwise may be up to one
+// gap late. Once a cycle is found nothing more is recorded until Reset(),
+// which edits to the board must call.
+//
+// Fed by whichever thread steps the engine; Found(), Period() and Start()
+// may be read from any thread.
+class CycleDetector {
+public:
+    static constexpr size_t kMaxEntries = size_t(1) << 20; // samples before starting over
+    static constexpr int kMaxInterval = 1024;               // generations between samples
+
+    CycleDetector() { Reset(); }
+    void Reset();
+
+    // Called after each step; true on the step that finds the cycle.
+    bool AfterStep(LifeEngine& engine, uint64_t generation) {
+        if (m_found || generation < m_nextSample) return false;
+        return Sample(engine, generation);
+    }
+    bool Found() const { return m_period.load(std::memory_order_acquire) != 0; }
+    uint64_t Period() const { return m_period.load(std::memory_order_acquire); }
+    uint64_t Start() const { return m_start.load(std::memory_order_relaxed); }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    struct Entry {
+        uint64_t hash;
+        uint64_t generation; // kEmpty for a free slot
+    };
+    static constexpr uint64_t kEmpty = ~uint64_t(0);
+    static constexpr size_t kInitialSlots = 1024;
+
+    bool Sample(LifeEngine& engine, uint64_t generation);
+    bool Lookup(uint64_t hash, uint64_t generation, uint64_t& first);
+    void Grow();
+    void Report(uint64_t period, uint64_t start);
+
+    std::vector<Entry> m_table; // a power of two, at most half full
+    std::vector<Entry> m_spare; // Grow()'s copy of the old table, kept for its memory
+    size_t m_entries=0;
+    uint64_t m_nextSample=0;
+    uint64_t m_everySince=0;    // every generation has been sampled since this one
+    int m_interval=1;
+    Clock::time_point m_lastSample;
+    // a repeat was seen: waiting for m_repeatHash to come round again
+    bool m_confirming=false;
+    uint64_t m_repeatHash=0, m_repeatGeneration=0, m_repeatStart=0;
+    bool m_found=false;         // the stepping thread's copy of Found()
+    std::atomic<uint64_t> m_period{0};
+    std::atomic<uint64_t> m_start{0};
+};
+
+// ---------------- Random Soups ----------------
+// Random boards from a counter-based generator: every 64-cell word is a pure
+// function of the seed and the word's row and column, so a seed names the
+// same soup whatever the thread count, and a smaller soup is the top-left
+// corner of a larger one from the same seed. 'density' is the chance of a
+// cell being live, kept to 1/2^24; each word costs one random word per
+// significant bit of it, so 50% takes one and 25% two.
+class SoupGenerator {
+public:
+    static constexpr int kDensityBits = 24;
+
+    SoupGenerator(uint64_t seed, double density);
+    uint64_t Word(int64_t row, int64_t column) const;
+    // Fills the whole of snap, which Reset() has sized, spreading the rows
+    // over the pool when there are enough of them.
+    void Fill(UniverseSnapshot& snap, WorkerPool* pool=nullptr) const;
+
+private:
+    uint64_t m_key;
+    uint32_t m_threshold; // density * 2^kDensityBits
+    int m_lowBit;         // lowest set bit of m_threshold
+};
+
+// ---------------- Soup Search ----------------
+// Runs many small random soups until they settle, 64 at a time per thread:
+// bit k of every word is a cell of soup k, so one pass of the packed
+// engine's row kernels steps 64 boards with words for cells. Each soup sits
+// in the middle of a finite field and has settled once it repeats with a
+// period dividing 6; its lifetime is the first generation of that cycle.
+// Anything else, such as a pentadecathlon, runs into the generation cap. A
+// lane is reseeded with the next soup as soon as its soup is done, so lanes
+// don't idle while the slowest soup finishes. Soup i is SoupGenerator(seed,
+// density) row i, column y for its row y, and gives the same result
+// whatever the thread count.
+struct SoupSearchOptions {
+    int soupSide = 16;       // 1..64
+    int fieldSide = 0;       // 0 = four times soupSide
+    double density = 0.5;
+    uint64_t seed = 1;
+    uint32_t maxGenerations = 10000;
+    LifeRule rule;           // life-like and without B0
+};
+
+struct SoupResult {
+    uint32_t lifetime = 0;   // generations until it repeated, or the cap
+    uint32_t population = 0; // live cells at the end
+    uint8_t period = 0;      // 1, 2, 3 or 6; 0 = still changing at the cap
+};
+
+class SoupSearch {
+public:
+    // False, keeping the old options, for a rule or sizes it can't run.
+    bool SetOptions(const SoupSearchOptions& options);
+    const SoupSearchOptions& GetOptions() const { return m_options; }
+    // Row y of soup i's starting cells, bit x for column x.
+    uint64_t SoupRow(uint64_t soup, int y) const;
+    // Runs soups 0..count-1 into results[0..count-1], one batch of 64 lanes
+    // per pool thread.
+    void Run(uint64_t count, std::vector<SoupResult>& results, WorkerPool* pool=nullptr) const;
+
+private:
+    void RunLanes(std::atomic<uint64_t>& nextSoup, uint64_t count, SoupResult* results) const;
+
+    SoupSearchOptions m_options;
+    const RuleKernels* m_kernels=KernelsForRule(LifeRule());
+};
+
+// ---------------- Universe ----------------
+// Largest side the bounded engines are allowed to allocate, and the largest
+// nominal board size for the unbounded engines.
+static const int kMaxPackedSide = 16384;
+static const int kMaxUnboundedSide = 1 << 30;
+
+// A board as the GUI and the command-line tool see it: a nominal size, a
+// boundary mode and a choice of backend, with the cells carried over when
+// the backend changes. Engine() is what a SimulationThread steps; while one
+// does, nothing else may touch the universe.
+class Universe {
+public:
+    Universe();
+
+    // Infinite switches to the sparse engine.
+    void SetBoundary(Boundary boundary);
+    Boundary GetBoundary() const { return m_boundary; }
+    void SetHashLife(bool on);
+    bool IsHashLife() const { return m_engine == &m_hashlife; }
+    bool IsSparse() const { return m_engine == &m_sparse; }
+    bool IsMultiState() const { return m_engine == &m_multi; }
+    bool IsUnbounded() const { return m_engine == &m_hashlife || m_engine == &m_sparse; }
+    void SetThreadCount(int n) { m_pool.SetThreadCount(n); }
+    int GetThreadCount() const { return m_pool.GetThreadCount(); }
+    void SetHashLifeStep(int exponent) { m_hashlife.SetStepExponent(exponent); }
+    int GetHashLifeStep() const { return m_hashlife.GetStepExponent(); }
+    void SetHashLifeMemory(int megabytes) { m_hashlife.SetMaxMemory((size_t)megabytes << 20); }
+    // The rule the engines step with. Generations and Larger than Life rules
+    // switch a bounded board over to the multi-state engine. Those and B0
+    // rules need a bounded board: they are refused on an unbounded one, and
+    // switching to an unbounded engine puts the rule back to B3/S23.
+    bool SetRule(const LifeRule& rule);
+    const LifeRule& GetRule() const { return m_rule; }
+
+    // Resizing clears the board. Bounded boards are capped at kMaxPackedSide.
+    void Resize(int w, int h);
+    int Width() const { return m_width; }
+    int Height() const { return m_height; }
+    void Clear();
+    // Clears the board, then fills the w x h block at (x0, y0) with the
+    // soup SoupGenerator(seed, density) makes.
+    void Randomize(double density, uint64_t seed, int64_t x0, int64_t y0, int w, int h);
+    // Pastes cells with their top-left corner at (x0, y0) as an edit of the
+    // current generation. The history starts over from the result.
+    void Stamp(const UniverseSnapshot& cells, int64_t x0, int64_t y0, PasteMode mode);
+    uint64_t Step(); // returns the number of generations advanced
+    void Toggle(int64_t x, int64_t y);
+    uint64_t Generation() const { return m_generation; }
+    void SetGeneration(uint64_t g) { m_generation = g; ResetHistory(); } // renumbers
+    // The engine was stepped elsewhere (by a SimulationThread), which kept
+    // the history up to date itself.
+    void SyncGeneration(uint64_t g) { m_generation = g; }
+
+    // History of a bounded board, off until a memory limit is set. Changing
+    // the limit starts the history over.
+    void SetHistoryMemory(int megabytes);
+    bool StepBack() { return m_generation > 0 && RewindTo(m_generation - 1); }
+    bool RewindTo(uint64_t generation);
+    uint64_t OldestGeneration() const { return m_history.OldestGeneration(); }
+    GenerationHistory& History() { return m_history; }
+    const GenerationHistory& History() const { return m_history; }
+    // Watches for the board repeating itself; bounded boards only.
+    CycleDetector& Cycles() { return m_cycles; }
+    const CycleDetector& Cycles() const { return m_cycles; }
+    uint64_t Population() const { return m_engine->Population(); }
+    EngineStats Stats() const;
+    LifeEngine& Engine() { return *m_engine; }
+    const LifeEngine& Engine() const { return *m_engine; }
+
+    // The whole board and the rule, in the format its extension names
+    // (PatternFormat). Loading takes the file's rule too, and fails if the
+    // board is unbounded and the rule needs a bounded one. Files hold live
+    // cells only, so dying cells aren't saved.
+    bool Save(const std::string& path) const;
+    bool Load(const std::string& path, bool resizeToFile=true);
+
+private:
+    LifeEngine* SelectedEngine();
+    void SwitchEngine(LifeEngine* next);
+    void ResizeEngine(LifeEngine* engine, int w, int h);
+    bool LoadTiled(const std::string& path, bool resizeToFile);
+    void ApplyRule(const LifeRule& rule);
+    void ResetHistory();
+
+    int m_width=50;
+    int m_height=30;
+    Boundary m_boundary = Boundary::Toroidal;
+    LifeRule m_rule;
+    uint64_t m_generation=0;
+    WorkerPool m_pool;
+    PackedUniverse m_packed;
+    MultiStateUniverse m_multi;
+    HashLifeUniverse m_hashlife;
+    SparseUniverse m_sparse;
+    LifeEngine* m_engine; // one of the four above
+    bool m_useHashLife=false;
+    GenerationHistory m_history;
+    CycleDetector m_cycles;
+};
+
+// ---------------- Performance Trace ----------------
+// Always-on timing of the phases of a frame. Each phase keeps the last
+// kCapacity events in a ring written by one thread at a time (stepping by
+// the simulation thread, painting and status updates by the UI thread);
+// any thread can read them. Fields are relaxed atomics, so recording costs
+// two clock reads and a few plain stores, and a reader racing a writer at
+// worst sees an event from a moment later than it asked for. Phases too
+// short to time one by one can be recorded as one event for 'count' of them.
+enum class PerfPhase { Step, Copy, Paint, Status, TimerLag, Count };
+
+class PerfTrace {
+public:
+    typedef std::chrono::steady_clock Clock;
+    static constexpr int kCapacity = 1 << 16; // events per phase, a power of two
+
+    void Record(PerfPhase phase, Clock::time_point start, Clock::time_point end, int count=1);
+
+    // Over the events that ended in the last 'seconds'; an event of several
+    // counts as one sample of their mean.
+    struct Summary {
+        int events=0;
+        double p50Ms=0, p99Ms=0, maxMs=0;
+    };
+    Summary Summarize(PerfPhase phase, double seconds) const;
+
+    // The events of the last 'seconds' as Chrome trace-event JSON, one
+    // track per phase; load it in chrome://tracing or Perfetto.
+    bool WriteChromeTrace(std::FILE* f, double seconds) const;
+
+private:
+    struct Event {
+        std::atomic<int64_t> start{0}; // ns since m_epoch
+        std::atomic<int64_t> duration{0};
+        std::atomic<int> count{1};
+    };
+    struct Ring {
+        std::unique_ptr<Event[]> events{new Event[kCapacity]};
+        std::atomic<uint64_t> count{0};
+    };
+    template <typename Fn> void ForEachRecent(PerfPhase phase, double seconds, Fn fn) const;
+
+    const Clock::time_point m_epoch = Clock::now();
+    Ring m_rings[(int)PerfPhase::Count];
+};
+
+// Records the time from construction to destruction as one event.
+class PerfScope {
+public:
+    PerfScope(PerfTrace* trace, PerfPhase phase) : m_trace(trace), m_phase(phase) {
+        if (m_trace) m_start = PerfTrace::Clock::now();
+    }
+    ~PerfScope() { if (m_trace) m_trace->Record(m_phase, m_start, PerfTrace::Clock::now()); }
+private:
+    PerfTrace* m_trace;
+    PerfPhase m_phase;
+    PerfTrace::Clock::time_point m_start;
+};
+
+// ---------------- Simulation Thread ----------------
+// Advances a LifeEngine on a background thread. While it runs, nothing else
+// may touch the engine: edits are queued with Post() and applied between
+// generations, and finished generations come back through TakeFrame(), which
+// swaps a snapshot buffer under the lock instead of copying it. The frame is
+// copied out of the engine before the lock is taken. The thread only copies
+// a frame out after the previous one has been taken, so stepping never
+// waits on painting. In turbo mode it copies none at all, and the generation
+// and population it has reached can still be read at any time.
+class SimulationThread {
+public:
+    typedef std::function<void(LifeEngine&)> Edit;
+
+    ~SimulationThread() { Stop(); }
+
+    // intervalMs is the minimum time per step, 0 = as fast as possible
+    void Start(LifeEngine* engine, uint64_t generation, int intervalMs, const ViewWindow& view);
+    uint64_t Stop(); // returns the generation reached
+    bool IsRunning() const { return m_thread.joinable(); }
+    void SetInterval(int intervalMs);
+    void SetFrameView(const ViewWindow& view); // window copied out for display
+    void Post(const Edit& edit);
+    bool TakeFrame(UniverseSnapshot& frame);
+    // No frames are published while on, except for a cycle it is held on.
+    void SetTurbo(bool on) { m_turbo = on; }
+    bool IsTurbo() const { return m_turbo; }
+    // Updated after every step, from any thread.
+    uint64_t GenerationReached() const { return m_reached.load(std::memory_order_relaxed); }
+    uint64_t PopulationReached() const { return m_reachedPopulation.load(std::memory_order_relaxed); }
+    // steps, frame copies and wake-up lag are recorded here; set while stopped
+    void SetTrace(PerfTrace* trace) { m_trace = trace; }
+    // told about every generation stepped; set while stopped
+    void SetHistory(GenerationHistory* history) { m_history = history; }
+    // also fed every generation; set while stopped
+    void SetCycleDetector(CycleDetector* cycles) { m_cycles = cycles; }
+    // When on, the thread stops stepping at the generation a cycle is found
+    // in, publishes it as a frame and waits there to be stopped.
+    void SetPauseOnCycle(bool on);
+    bool IsHeldOnCycle() const { return m_held; }
+
+private:
+    void Loop();
+    void PublishFrame();
+
+    std::thread m_thread;
+    LifeEngine* m_engine=nullptr;
+    PerfTrace* m_trace=nullptr;
+    GenerationHistory* m_history=nullptr;
+    CycleDetector* m_cycles=nullptr;
+    uint64_t m_generation=0; // owned by the simulation thread while running
+    UniverseSnapshot m_copy;   // likewise; the next frame, copied without the lock
+
+    std::mutex m_mutex;            // guards everything below
+    std::condition_variable m_wake;
+    bool m_stop=false;
+    int m_intervalMs=0;
+    ViewWindow m_frameView;
+    std::vector<Edit> m_edits;
+    UniverseSnapshot m_back;
+    bool m_frameReady=false;
+    std::atomic<bool> m_frameWanted{true};
+    std::atomic<bool> m_pauseOnCycle{false};
+    std::atomic<bool> m_held{false};
+    std::atomic<bool> m_turbo{false};
+    std::atomic<uint64_t> m_reached{0};
+    std::atomic<uint64_t> m_reachedPopulation{0};
+};
+
+#endif // LIFE_ENGINE_H
@@ -12,6 +12,18 @@
 #include <wx/spinctrl.h>
 #include <wx/config.h>
 #include <wx/dir.h>
+#include <wx/numdlg.h>
+#include <wx/image.h>
+#include <wx/listbox.h>
+#include <wx/statbmp.h>
+#include <wx/stattext.h>
+#include <wx/sizer.h>
+#include <wx/dirdlg.h>
+
+#include <cstdarg>
+#include <cstring>
+
+#include "life_engine.h"
 
 // ---------------- Settings ----------------
 struct AppSettings {
@@ -22,39 +34,79 @@ struct AppSettings {
     wxColour gridColor = *wxLIGHT_GREY;
     wxColour bgColor = *wxBLACK;
     wxColour aliveColor = *wxWHITE;
-    wxString boundary = "Toroidal"; // "Finite" or "Toroidal"
+    Boundary boundary = Boundary::Toroidal;
+    wxString rule = "B3/S23";       // B/S, Generations or Larger than Life notation
+    int threads = 0; // stepping threads, 0 = one per hardware thread
+    wxString engine = "Packed"; // "Packed" or "HashLife"
+    int hashlifeStep = 0;       // HashLife advances 2^hashlifeStep generations per step
+    int hashlifeMemoryMB = 512; // node cache size before garbage collection
+    int historyMemoryMB = 256;  // past generations kept for stepping back, 0 = off
+    bool pauseOnCycle = false;  // stop running once the board repeats itself
+    double randomPercent = 30;  // density Randomize fills the board to
+    int intervalMs = 100;       // pause between generations while running
+    bool maxSpeed = false;      // run without pausing between generations
+    bool turbo = false;         // run without showing frames
+    wxString patternFolder;     // the pattern library, empty = "patterns" beside the settings
+    bool showPatterns = false;  // pattern browser beside the board
+    bool stampXor = false;      // stamps toggle cells rather than adding them
+
+    // Where the settings and the pattern library's cache are kept.
+    static wxString DataDir() {
+        wxString dir = wxStandardPaths::Get().GetUserLocalDataDir();
+        if (!wxDirExists(dir)) wxMkdir(dir);
+        return dir;
+    }
 
     wxString SettingsPath() const {
-        wxString dir = wxStandardPaths::Get().GetUserLocalDataDir();
+        return wxFileName(DataDir(), "settings.txt").GetFullPath();
+    }
+
+    wxString PatternFolderPath() const {
+        if (!patternFolder.empty()) return patternFolder;
+        wxString dir = wxFileName(DataDir(), "patterns").GetFullPath();
         if (!wxDirExists(dir)) wxMkdir(dir);
-        return wxFileName(dir, "settings.txt").GetFullPath();
+        return dir;
+    }
+
+    wxString PatternCachePath() const {
+        return wxFileName(DataDir(), "patterns.cache").GetFullPath();
     }
 
     void Reset() {
         *this = AppSettings(); // back to defaults
-        Save();
     }
 
-    void Save() const {
-        wxTextFile file;
-        wxString path = SettingsPath();
-        if (wxFileExists(path)) wxRemoveFile(path);
-        file.Create(path);
-        file.AddLine(wxString::Format("width=%d", width));
-        file.AddLine(wxString::Format("height=%d", height));
-        file.AddLine(wxString::Format("showGrid=%d", showGrid));
-        file.AddLine(wxString::Format("showHUD=%d", showHUD));
-        file.AddLine(wxString::Format("gridColor=%d,%d,%d", gridColor.Red(), gridColor.Green(), gridColor.Blue()));
-        file.AddLine(wxString::Format("bgColor=%d,%d,%d", bgColor.Red(), bgColor.Green(), bgColor.Blue()));
-        file.AddLine(wxString::Format("aliveColor=%d,%d,%d", aliveColor.Red(), aliveColor.Green(), aliveColor.Blue()));
-        file.AddLine(wxString::Format("boundary=%s", boundary));
-        file.Write();
-        file.Close();
+    // The whole file's text; the caller decides when it gets written.
+    wxString Serialize() const {
+        wxString text;
+        text << wxString::Format("width=%d\n", width);
+        text << wxString::Format("height=%d\n", height);
+        text << wxString::Format("showGrid=%d\n", showGrid);
+        text << wxString::Format("showHUD=%d\n", showHUD);
+        text << wxString::Format("gridColor=%d,%d,%d\n", gridColor.Red(), gridColor.Green(), gridColor.Blue());
+        text << wxString::Format("bgColor=%d,%d,%d\n", bgColor.Red(), bgColor.Green(), bgColor.Blue());
+        text << wxString::Format("aliveColor=%d,%d,%d\n", aliveColor.Red(), aliveColor.Green(), aliveColor.Blue());
+        text << wxString::Format("boundary=%s\n", BoundaryName(boundary));
+        text << wxString::Format("rule=%s\n", rule);
+        text << wxString::Format("threads=%d\n", threads);
+        text << wxString::Format("engine=%s\n", engine);
+        text << wxString::Format("hashlifeStep=%d\n", hashlifeStep);
+        text << wxString::Format("hashlifeMemoryMB=%d\n", hashlifeMemoryMB);
+        text << wxString::Format("historyMemoryMB=%d\n", historyMemoryMB);
+        text << wxString::Format("pauseOnCycle=%d\n", pauseOnCycle);
+        text << wxString::Format("randomPercent=%g\n", randomPercent);
+        text << wxString::Format("intervalMs=%d\n", intervalMs);
+        text << wxString::Format("maxSpeed=%d\n", maxSpeed);
+        text << wxString::Format("turbo=%d\n", turbo);
+        text << wxString::Format("patternFolder=%s\n", patternFolder);
+        text << wxString::Format("showPatterns=%d\n", showPatterns);
+        text << wxString::Format("stampXor=%d\n", stampXor);
+        return text;
     }
 
     void Load() {
         wxString path = SettingsPath();
-        if (!wxFileExists(path)) { Save(); return; }
+        if (!wxFileExists(path)) return; // written with the first change
         wxTextFile file(path);
         if (!file.Open()) return;
         for ( size_t i=0; i<file.GetLineCount(); ++i ) {
@@ -70,71 +122,319 @@ struct AppSettings {
             } else if (line.StartsWith("aliveColor=")) {
                 int r,g,b; sscanf(line.Mid(11).c_str(), "%d,%d,%d", &r,&g,&b); aliveColor.Set(r,g,b);
             } else if (line.StartsWith("boundary=")) {
-                boundary = line.Mid(9);
-                if (!(boundary == "Finite" || boundary == "Toroidal")) boundary = "Toroidal";
+                if (!ParseBoundary(line.Mid(9).ToStdString(), boundary)) boundary = Boundary::Toroidal;
+            } else if (line.StartsWith("rule=")) {
+                LifeRule r;
+                LifeRule::Parse(line.Mid(5).ToStdString(), r); // B3/S23 if it doesn't parse
+                rule = r.ToString();
+            } else if (line.StartsWith("threads=")) {
+                long v; line.Mid(8).ToLong(&v); threads = std::max(0L, v);
+            } else if (line.StartsWith("engine=")) {
+                engine = line.Mid(7);
+                if (!(engine == "Packed" || engine == "HashLife")) engine = "Packed";
+            } else if (line.StartsWith("hashlifeStep=")) {
+                long v; line.Mid(13).ToLong(&v); hashlifeStep = (int)std::max(0L, std::min(v, 48L));
+            } else if (line.StartsWith("hashlifeMemoryMB=")) {
+                long v; line.Mid(17).ToLong(&v); hashlifeMemoryMB = (int)std::max(16L, v);
+            } else if (line.StartsWith("historyMemoryMB=")) {
+                long v; line.Mid(16).ToLong(&v); historyMemoryMB = (int)std::max(0L, std::min(v, 65536L));
+            } else if (line.StartsWith("pauseOnCycle=")) {
+                long v; line.Mid(13).ToLong(&v); pauseOnCycle = v!=0;
+            } else if (line.StartsWith("randomPercent=")) {
+                double v; if (line.Mid(14).ToDouble(&v)) randomPercent = std::max(0.0, std::min(v, 100.0));
+            } else if (line.StartsWith("intervalMs=")) {
+                long v; line.Mid(11).ToLong(&v); intervalMs = (int)std::max(1L, std::min(v, 10000L));
+            } else if (line.StartsWith("maxSpeed=")) {
+                long v; line.Mid(9).ToLong(&v); maxSpeed = v!=0;
+            } else if (line.StartsWith("turbo=")) {
+                long v; line.Mid(6).ToLong(&v); turbo = v!=0;
+            } else if (line.StartsWith("patternFolder=")) {
+                patternFolder = line.Mid(14);
+            } else if (line.StartsWith("showPatterns=")) {
+                long v; line.Mid(13).ToLong(&v); showPatterns = v!=0;
+            } else if (line.StartsWith("stampXor=")) {
+                long v; line.Mid(9).ToLong(&v); stampXor = v!=0;
             }
         }
         file.Close();
     }
 };
 
+// ---------------- Settings Writer ----------------
+// Writes the settings file on a thread of its own, so that a slow disk or
+// network home directory never stalls the UI. Changes arriving in quick
+// succession are batched: the file is only written once no newer text has
+// come in for kDelayMs, and then only the latest text. Each write goes to a
+// temporary file that is renamed over the old one, so an interrupted write
+// leaves the previous settings in place.
+class SettingsWriter {
+public:
+    static constexpr int kDelayMs = 500;
+
+    ~SettingsWriter();
+    void Write(const wxString& path, const std::string& text);
+    // Writes whatever is still pending right away and waits for it.
+    void Flush();
+
+private:
+    using Clock = std::chrono::steady_clock;
+    void Loop();
+    static bool WriteFile(const wxString& path, const std::string& text);
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    wxString m_path;
+    std::string m_text; // the newest text not yet written
+    Clock::time_point m_due;
+    bool m_pending = false;
+    bool m_writing = false;
+    bool m_flush = false;
+    bool m_stop = false;
+};
+
 // Forward declarations
 class LifePanel;
 class MainFrame;
 
+// From bg at d = 0 to alive at d = 255.
+static wxColour BlendColor(const wxColour& bg, const wxColour& alive, uint8_t d) {
+    auto mix = [d](int b, int a) { return (unsigned char)(b + (a - b) * d / 255); };
+    return wxColour(mix(bg.Red(), alive.Red()), mix(bg.Green(), alive.Green()), mix(bg.Blue(), alive.Blue()));
+}
+
+// ---------------- Labels ----------------
+// The HUD and status bar text is rebuilt for every frame, so it is printed
+// into a fixed buffer rather than pieced together from wxString::Format
+// results. Only the wxString finally handed to wx is allocated.
+class Label {
+public:
+    Label& Add(const char* format, ...) {
+        va_list args;
+        va_start(args, format);
+        int n = std::vsnprintf(m_text + m_length, sizeof m_text - m_length, format, args);
+        va_end(args);
+        if (n > 0) m_length = std::min(sizeof m_text - 1, m_length + (size_t)n);
+        return *this;
+    }
+    const char* c_str() const { return m_text; }
+    bool operator==(const Label& o) const { return std::strcmp(m_text, o.m_text) == 0; }
+    bool operator!=(const Label& o) const { return !(*this == o); }
+
+private:
+    char m_text[512] = {};
+    size_t m_length = 0;
+};
+
 // ---------------- Application ----------------
 class LifeApp : public wxApp {
 public:
     AppSettings settings;
+    // Call after changing settings; they are written out shortly after.
+    void SettingsChanged();
     bool OnInit() override;
+    int OnExit() override;
+
+private:
+    SettingsWriter m_settingsWriter;
+    wxString m_settingsPath;
 };
 
 wxIMPLEMENT_APP(LifeApp);
 
 // ---------------- Life Panel ----------------
+// Recent population counts for the HUD sparkline, one sample per displayed
+// generation, oldest first.
+class PopulationHistory {
+public:
+    static constexpr int kLength = 200;
+
+    void Clear() { m_head = m_count = 0; }
+    void Push(uint64_t population) {
+        m_samples[m_head] = population;
+        m_head = (m_head + 1) % kLength;
+        m_count = std::min(m_count + 1, kLength);
+    }
+    int Size() const { return m_count; }
+    uint64_t operator[](int i) const { return m_samples[(m_head - m_count + i + kLength) % kLength]; }
+
+private:
+    uint64_t m_samples[kLength] = {};
+    int m_head=0;
+    int m_count=0;
+};
+
 class LifePanel : public wxPanel {
 public:
     LifePanel(MainFrame* parent);
+    ~LifePanel();
 
     void ResizeUniverse(int w, int h);
     void ClearUniverse();
-    void Randomize(int percent=30);
+    // Fills the board (on an unbounded one, the part on screen) with the
+    // soup 'seed' makes at 'density'.
+    void Randomize(double density, uint64_t seed);
+    uint64_t GetSoupSeed() const { return m_soupSeed; } // of the last Randomize
     void NextGeneration();
+    bool StepBack();
+    bool RewindTo(uint64_t generation);
+    uint64_t OldestGeneration() const { return m_universe.OldestGeneration(); }
+    bool HasHistory() const { return m_universe.History().IsEnabled(); }
+    size_t HistoryMemory() const { return m_universe.History().MemoryBytes(); }
+    void SetHistoryMemory(int megabytes);
+    // The period and first generation of the cycle the board has fallen
+    // into; false while none has been seen.
+    bool GetCycle(uint64_t& period, uint64_t& start) const;
+    void SetPauseOnCycle(bool on) { m_sim.SetPauseOnCycle(on); }
+    bool IsHeldOnCycle() const { return m_sim.IsHeldOnCycle(); }
     void ToggleCellAt(const wxPoint& pt);
-    int AliveCount() const;
-    int GetWidth() const { return m_width; }
-    int GetHeight() const { return m_height; }
+    // Ctrl-click stamps the armed pattern centred on the cell under the
+    // cursor. The cells are the pattern library's and must stay put while
+    // armed; nullptr disarms.
+    void SetStamp(const UniverseSnapshot* cells, PasteMode mode) { m_stamp = cells; m_stampMode = mode; }
+    void Stamp(int64_t cx, int64_t cy);
+    void StampInMiddle();
+    uint64_t AliveCount() const;
+    int GetWidth() const { return m_universe.Width(); }
+    int GetHeight() const { return m_universe.Height(); }
     void SetColors(const wxColour& grid, const wxColour& bg, const wxColour& alive) {
-        m_gridColor=grid; m_bgColor=bg; m_aliveColor=alive; Refresh();
+        m_gridColor=grid; m_bgColor=bg; m_aliveColor=alive; InvalidateCanvas();
     }
-    void SetShowGrid(bool v){ m_showGrid=v; Refresh(); }
+    void SetShowGrid(bool v){ m_showGrid=v; InvalidateCanvas(); }
     void SetShowHUD(bool v){ m_showHUD=v; Refresh(); }
     bool GetShowGrid() const { return m_showGrid; }
     bool GetShowHUD() const { return m_showHUD; }
-    void SetBoundary(const wxString& b){ m_boundary=b; }
 
-    void SetGeneration(long g){ m_generation=g; Refresh(); }
-    long GetGeneration() const { return m_generation; }
+    // Viewport
+    void Zoom(int steps); // about the middle of the panel
+    void FitView();
+    void AddZoomLabel(Label& label) const;
+
+    void SetBoundary(Boundary b);
+    const char* GetBoundaryLabel() const;
+    bool SetRule(const LifeRule& rule); // false if the board can't run it
+    const LifeRule& GetRule() const { return m_universe.GetRule(); }
+    const std::string& GetRuleLabel() const; // written out again only when the rule changes
+    void SetThreadCount(int n);
+    int GetThreadCount() const { return m_universe.GetThreadCount(); }
+
+    // Backend selection
+    void SetHashLife(bool on);
+    bool IsHashLife() const { return m_universe.IsHashLife(); }
+    bool IsSparse() const { return m_universe.IsSparse(); }
+    bool IsUnbounded() const { return m_universe.IsUnbounded(); }
+    void SetHashLifeStep(int exponent);
+    int GetHashLifeStep() const { return m_universe.GetHashLifeStep(); }
+    void SetHashLifeMemory(int megabytes);
+    EngineStats GetEngineStats() const;
+
+    void SetGeneration(uint64_t g);
+    uint64_t GetGeneration() const;
+
+    // Background simulation
+    void StartSimulation(int intervalMs);
+    void StopSimulation();
+    bool IsSimulating() const { return m_sim.IsRunning(); }
+    void SetSimulationInterval(int intervalMs);
+    // Turbo mode shows no frames while running, only the text, and so
+    // spends nothing on copying or drawing cells.
+    void SetTurbo(bool on);
+    bool IsTurbo() const { return m_sim.IsTurbo(); }
+    bool PresentFrame();
+    double GetGenerationRate() const { return IsSimulating() ? m_genPerSec : 0.0; }
+
+    // Instrumentation
+    PerfTrace& GetPerfTrace() { return m_perf; }
+    bool SavePerfTrace(const wxString& path, double seconds) const;
 
     // Serialization
     bool SaveUniverse(const wxString& path);
     bool LoadUniverse(const wxString& path, bool resizeToFile=true);
 
 private:
+    friend class SimulationPause;
+
     void OnPaint(wxPaintEvent&);
     void OnLeftDown(wxMouseEvent&);
+    void OnDragStart(wxMouseEvent&);
+    void OnDragEnd(wxMouseEvent&);
+    void OnMotion(wxMouseEvent&);
+    void OnMouseWheel(wxMouseEvent&);
+    void OnCaptureLost(wxMouseCaptureLostEvent&);
     void OnSize(wxSizeEvent&);
-
-    int m_width;
-    int m_height;
-    std::vector<bool> m_current;
-    std::vector<bool> m_next;
+    ViewWindow CurrentView() const;
+    bool CellAt(const wxPoint& pt, int64_t& x, int64_t& y) const;
+    void ZoomAt(const wxPoint& pt, int zoom);
+    void FitZoom();
+    void ViewChanged();
+    void CopyFrame();
+    void FrameChanged();
+    void RestartHistory();
+    void DrawSparkline(wxDC& dc, int x, int y, int h) const;
+    void BuildHUD();
+    const wxString& PerfLabel();
+
+    // Rendering
+    void InvalidateCanvas() { m_canvasValid = false; Refresh(); }
+    void RebuildCanvas();
+    void UpdateCanvas(bool invalidate=true);
+    void FillCell(int x, int y, const wxColour& c);
+    wxColour DensityColor(uint8_t d) const;
+    wxColour StateColor(uint8_t state) const;
+    int FrameCellSize() const;
+
+    Universe m_universe;
 
     wxColour m_gridColor, m_bgColor, m_aliveColor;
     bool m_showGrid=true;
     bool m_showHUD=true;
-    long m_generation=0;
-    wxString m_boundary = "Toroidal";
+
+    PerfTrace m_perf;
+    // declared after the universe and the trace so it is torn down before them
+    SimulationThread m_sim;
+    UniverseSnapshot m_frame; // what is on screen
+    PopulationHistory m_history;
+    uint64_t m_soupSeed=0;
+    const UniverseSnapshot* m_stamp=nullptr;
+    PasteMode m_stampMode=PasteMode::Or;
+
+    // The cell at the panel's top-left corner and the zoom as log2 of pixels
+    // per cell: 2 draws 4x4 pixel cells, -3 draws one pixel per 8x8 block.
+    // Zoomed out, the origin stays a multiple of the block size.
+    int64_t m_viewX=0, m_viewY=0;
+    int m_zoom=0;
+    bool m_viewFitted=false; // the first size event fits the board
+    bool m_dragging=false;
+    wxPoint m_dragStart;
+    int64_t m_dragViewX=0, m_dragViewY=0;
+
+    // The panel's pixels, with the grid drawn in. UpdateCanvas() repaints
+    // only the cells (or density pixels) of m_frame that differ from m_shown
+    // and invalidates just those rows; OnPaint blits the damaged parts.
+    wxImage m_canvas;
+    UniverseSnapshot m_shown; // cells as drawn into m_canvas
+    bool m_canvasValid=false;
+    int m_canvasCell=0;      // pixels per cell the canvas was drawn at
+    bool m_canvasGrid=false; // whether grid lines were drawn at that size
+    int m_hudHeight=0;
+    int m_simIntervalMs=0;
+
+    // While running, the HUD text is rebuilt at most every kTextIntervalMs
+    // rather than for every frame, and its performance line a few times a
+    // second; the generation rate comes from the simulation's own count.
+    Label m_hud;
+    wxString m_hudText;
+    PerfTrace::Clock::time_point m_hudTime;
+    PerfTrace::Clock::time_point m_turboTime; // last HUD refresh in turbo mode
+    Label m_perfLine;
+    wxString m_perfText;
+    mutable LifeRule m_labelRule;     // the rule m_ruleLabel was written for
+    mutable std::string m_ruleLabel;
+    PerfTrace::Clock::time_point m_perfLabelTime;
+    PerfTrace::Clock::time_point m_rateTime;
+    uint64_t m_rateGeneration=0;
+    double m_genPerSec=0;
 
     wxDECLARE_EVENT_TABLE();
 };
@@ -144,21 +444,83 @@ enum {
     ID_START,
     ID_PAUSE,
     ID_NEXT,
+    ID_STEP_BACK,
+    ID_REWIND,
     ID_RANDOMIZE,
+    ID_RANDOMIZE_WITH,
+    ID_STEP_INTERVAL,
+    ID_MAX_SPEED,
+    ID_TURBO,
+    ID_PAUSE_ON_CYCLE,
     ID_NEW,
     ID_SAVE,
     ID_SAVEAS,
     ID_OPEN,
     ID_VIEW_GRID,
     ID_VIEW_HUD,
+    ID_VIEW_ZOOM_IN,
+    ID_VIEW_ZOOM_OUT,
+    ID_VIEW_FIT,
+    ID_VIEW_SAVE_TRACE,
     ID_OPTIONS_COLORS,
     ID_OPTIONS_SIZE,
-    ID_OPTIONS_BOUNDARY_FINITE,
+    ID_OPTIONS_RULE,
+    ID_OPTIONS_BOUNDARY_FINITE, // the boundary items in Boundary's order
     ID_OPTIONS_BOUNDARY_TOROIDAL,
+    ID_OPTIONS_BOUNDARY_KLEIN_BOTTLE,
+    ID_OPTIONS_BOUNDARY_MIRROR,
+    ID_OPTIONS_BOUNDARY_INFINITE,
+    ID_OPTIONS_THREADS,
+    ID_OPTIONS_ENGINE_PACKED,
+    ID_OPTIONS_ENGINE_HASHLIFE,
+    ID_OPTIONS_HASHLIFE_STEP,
+    ID_OPTIONS_HASHLIFE_MEMORY,
+    ID_OPTIONS_HISTORY_MEMORY,
+    ID_PATTERNS_SHOW,
+    ID_PATTERNS_STAMP,
+    ID_PATTERNS_XOR,
+    ID_PATTERNS_FOLDER,
+    ID_PATTERNS_REINDEX,
+    ID_PATTERN_LIST,
     ID_SETTINGS_RESET
 };
 
+static int BoundaryMenuId(Boundary b) { return ID_OPTIONS_BOUNDARY_FINITE + (int)b; }
+
+// ---------------- Pattern Browser ----------------
+// The pattern library beside the board: the names, and a thumbnail, the size,
+// population and period of the selected one, all drawn from what the library
+// holds rather than read from the files again. Selecting a name arms it for
+// Ctrl-click stamping; double-clicking stamps it in the middle of the view.
+class PatternBrowser : public wxPanel {
+public:
+    static const int kThumbnailSize = 160; // pixels
+
+    explicit PatternBrowser(MainFrame* parent);
+    void SetLibrary(const PatternLibrary* library);
+    void SetColors(const wxColour& bg, const wxColour& alive);
+    int GetSelection() const; // into the library, -1 for none
+
+private:
+    void OnSelect(wxCommandEvent&);
+    void OnActivate(wxCommandEvent&);
+    void ShowSelection();
+
+    MainFrame* m_owner;
+    const PatternLibrary* m_library=nullptr;
+    wxListBox* m_list;
+    wxStaticBitmap* m_preview;
+    wxStaticText* m_info;
+    wxColour m_bgColor, m_aliveColor;
+    std::vector<uint8_t> m_pixels; // Thumbnail() output
+
+    wxDECLARE_EVENT_TABLE();
+};
+
 // ---------------- Main Frame ----------------
+static const int kFrameIntervalMs = 16; // ~60 Hz display refresh
+static const int kTextIntervalMs = 100; // ~10 Hz HUD and status bar text while running
+
 class MainFrame : public wxFrame {
 public:
     MainFrame();
@@ -167,9 +529,14 @@ public:
     // Accessors
     LifePanel* GetPanel() { return m_panel; }
 
+    // From the pattern browser
+    void SelectPattern(int index);
+    void StampPattern();
+
 private:
     void BuildMenu();
     void BuildToolbar();
+    void OpenPatternLibrary();
 
     // Menu handlers
     void OnQuit(wxCommandEvent&);
@@ -180,21 +547,55 @@ private:
     void OnStart(wxCommandEvent&);
     void OnPause(wxCommandEvent&);
     void OnNext(wxCommandEvent&);
+    void OnStepBack(wxCommandEvent&);
+    void OnRewind(wxCommandEvent&);
     void OnRandomize(wxCommandEvent&);
+    void OnRandomizeWith(wxCommandEvent&);
+    void OnChooseInterval(wxCommandEvent&);
+    void OnMaxSpeed(wxCommandEvent&);
+    void OnTurbo(wxCommandEvent&);
+    void OnPauseOnCycle(wxCommandEvent&);
     void OnToggleGrid(wxCommandEvent&);
     void OnToggleHUD(wxCommandEvent&);
+    void OnZoomIn(wxCommandEvent&);
+    void OnZoomOut(wxCommandEvent&);
+    void OnFitView(wxCommandEvent&);
+    void OnSavePerfTrace(wxCommandEvent&);
     void OnChooseColors(wxCommandEvent&);
     void OnChooseSize(wxCommandEvent&);
+    void OnChooseRule(wxCommandEvent&);
     void OnBoundaryFinite(wxCommandEvent&);
     void OnBoundaryToroidal(wxCommandEvent&);
+    void OnBoundaryKleinBottle(wxCommandEvent&);
+    void OnBoundaryMirror(wxCommandEvent&);
+    void OnBoundaryInfinite(wxCommandEvent&);
+    void ChooseBoundary(Boundary b);
+    void OnChooseThreads(wxCommandEvent&);
+    void OnEnginePacked(wxCommandEvent&);
+    void OnEngineHashLife(wxCommandEvent&);
+    void OnChooseHashLifeStep(wxCommandEvent&);
+    void OnChooseHashLifeMemory(wxCommandEvent&);
+    void OnChooseHistoryMemory(wxCommandEvent&);
+    void OnShowPatterns(wxCommandEvent&);
+    void OnStampPattern(wxCommandEvent&);
+    void OnStampXor(wxCommandEvent&);
+    void OnChoosePatternFolder(wxCommandEvent&);
+    void OnReindexPatterns(wxCommandEvent&);
     void OnResetSettings(wxCommandEvent&);
     void OnTimer(wxTimerEvent&);
+    void SyncRuleSetting();
+    int SimulationInterval() const;
+    void SaveCurrentPath();
 
     LifePanel* m_panel;
+    PatternBrowser* m_browser;
+    PatternLibrary m_library;
+    int m_pattern=-1; // armed for stamping
     wxTimer m_timer;
     bool m_running=false;
-    int m_intervalMs=100; // speed
     wxString m_currentPath;
+    Label m_statusLeft, m_statusState; // what the status bar shows
+    PerfTrace::Clock::time_point m_statusTime; // when it was last worked out
 
     wxDECLARE_EVENT_TABLE();
 };
@@ -203,6 +604,13 @@ private:
 wxBEGIN_EVENT_TABLE(LifePanel, wxPanel)
     EVT_PAINT(LifePanel::OnPaint)
     EVT_LEFT_DOWN(LifePanel::OnLeftDown)
+    EVT_RIGHT_DOWN(LifePanel::OnDragStart)
+    EVT_RIGHT_UP(LifePanel::OnDragEnd)
+    EVT_MIDDLE_DOWN(LifePanel::OnDragStart)
+    EVT_MIDDLE_UP(LifePanel::OnDragEnd)
+    EVT_MOTION(LifePanel::OnMotion)
+    EVT_MOUSEWHEEL(LifePanel::OnMouseWheel)
+    EVT_MOUSE_CAPTURE_LOST(LifePanel::OnCaptureLost)
     EVT_SIZE(LifePanel::OnSize)
 wxEND_EVENT_TABLE()
 
@@ -215,206 +623,831 @@ wxBEGIN_EVENT_TABLE(MainFrame, wxFrame)
     EVT_MENU(ID_START, MainFrame::OnStart)
     EVT_MENU(ID_PAUSE, MainFrame::OnPause)
     EVT_MENU(ID_NEXT, MainFrame::OnNext)
+    EVT_MENU(ID_STEP_BACK, MainFrame::OnStepBack)
+    EVT_MENU(ID_REWIND, MainFrame::OnRewind)
     EVT_MENU(ID_RANDOMIZE, MainFrame::OnRandomize)
+    EVT_MENU(ID_RANDOMIZE_WITH, MainFrame::OnRandomizeWith)
+    EVT_MENU(ID_STEP_INTERVAL, MainFrame::OnChooseInterval)
+    EVT_MENU(ID_MAX_SPEED, MainFrame::OnMaxSpeed)
+    EVT_MENU(ID_TURBO, MainFrame::OnTurbo)
+    EVT_MENU(ID_PAUSE_ON_CYCLE, MainFrame::OnPauseOnCycle)
     EVT_MENU(ID_VIEW_GRID, MainFrame::OnToggleGrid)
     EVT_MENU(ID_VIEW_HUD, MainFrame::OnToggleHUD)
+    EVT_MENU(ID_VIEW_ZOOM_IN, MainFrame::OnZoomIn)
+    EVT_MENU(ID_VIEW_ZOOM_OUT, MainFrame::OnZoomOut)
+    EVT_MENU(ID_VIEW_FIT, MainFrame::OnFitView)
+    EVT_MENU(ID_VIEW_SAVE_TRACE, MainFrame::OnSavePerfTrace)
     EVT_MENU(ID_OPTIONS_COLORS, MainFrame::OnChooseColors)
     EVT_MENU(ID_OPTIONS_SIZE, MainFrame::OnChooseSize)
+    EVT_MENU(ID_OPTIONS_RULE, MainFrame::OnChooseRule)
     EVT_MENU(ID_OPTIONS_BOUNDARY_FINITE, MainFrame::OnBoundaryFinite)
     EVT_MENU(ID_OPTIONS_BOUNDARY_TOROIDAL, MainFrame::OnBoundaryToroidal)
+    EVT_MENU(ID_OPTIONS_BOUNDARY_KLEIN_BOTTLE, MainFrame::OnBoundaryKleinBottle)
+    EVT_MENU(ID_OPTIONS_BOUNDARY_MIRROR, MainFrame::OnBoundaryMirror)
+    EVT_MENU(ID_OPTIONS_BOUNDARY_INFINITE, MainFrame::OnBoundaryInfinite)
+    EVT_MENU(ID_OPTIONS_THREADS, MainFrame::OnChooseThreads)
+    EVT_MENU(ID_OPTIONS_ENGINE_PACKED, MainFrame::OnEnginePacked)
+    EVT_MENU(ID_OPTIONS_ENGINE_HASHLIFE, MainFrame::OnEngineHashLife)
+    EVT_MENU(ID_OPTIONS_HASHLIFE_STEP, MainFrame::OnChooseHashLifeStep)
+    EVT_MENU(ID_OPTIONS_HASHLIFE_MEMORY, MainFrame::OnChooseHashLifeMemory)
+    EVT_MENU(ID_OPTIONS_HISTORY_MEMORY, MainFrame::OnChooseHistoryMemory)
+    EVT_MENU(ID_PATTERNS_SHOW, MainFrame::OnShowPatterns)
+    EVT_MENU(ID_PATTERNS_STAMP, MainFrame::OnStampPattern)
+    EVT_MENU(ID_PATTERNS_XOR, MainFrame::OnStampXor)
+    EVT_MENU(ID_PATTERNS_FOLDER, MainFrame::OnChoosePatternFolder)
+    EVT_MENU(ID_PATTERNS_REINDEX, MainFrame::OnReindexPatterns)
     EVT_MENU(ID_SETTINGS_RESET, MainFrame::OnResetSettings)
     EVT_TIMER(ID_TIMER, MainFrame::OnTimer)
 wxEND_EVENT_TABLE()
 
+wxBEGIN_EVENT_TABLE(PatternBrowser, wxPanel)
+    EVT_LISTBOX(ID_PATTERN_LIST, PatternBrowser::OnSelect)
+    EVT_LISTBOX_DCLICK(ID_PATTERN_LIST, PatternBrowser::OnActivate)
+wxEND_EVENT_TABLE()
+
 // ---------------- LifePanel Impl ----------------
+// Zoom range as log2 pixels per cell, and the smallest cells that still get
+// grid lines drawn.
+static const int kMaxZoomIn = 6;
+static const int kMaxZoomOut = -32;
+static const int kMinGridCellSize = 4;
+
+// Cells spanned by a distance in pixels at a zoom; rounds toward -infinity.
+static inline int64_t PixelsToCells(int64_t px, int zoom) {
+    return zoom >= 0 ? px >> zoom : px * (int64_t(1) << -zoom);
+}
+
+// Stops the simulation thread for as long as it is in scope so the panel can
+// modify the universe directly, then restarts it where it left off.
+class SimulationPause {
+public:
+    explicit SimulationPause(LifePanel* panel) : m_panel(panel), m_resume(panel->IsSimulating()) {
+        if (m_resume) m_panel->StopSimulation();
+    }
+    ~SimulationPause() {
+        if (m_resume) m_panel->StartSimulation(m_panel->m_simIntervalMs);
+    }
+private:
+    LifePanel* m_panel;
+    bool m_resume;
+};
+
 LifePanel::LifePanel(MainFrame* parent)
 : wxPanel(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxBORDER_NONE|wxTAB_TRAVERSAL)
 {
     SetBackgroundStyle(wxBG_STYLE_PAINT);
     LifeApp* app = (LifeApp*)wxApp::GetInstance();
     auto& s = app->settings;
-    m_width = s.width;
-    m_height = s.height;
     m_showGrid = s.showGrid;
     m_showHUD = s.showHUD;
     m_gridColor = s.gridColor;
     m_bgColor = s.bgColor;
     m_aliveColor = s.aliveColor;
-    m_boundary = s.boundary;
+    m_universe.SetThreadCount(s.threads);
+    m_universe.SetHashLifeStep(s.hashlifeStep);
+    m_universe.SetHashLifeMemory(s.hashlifeMemoryMB);
+    m_universe.SetBoundary(s.boundary);
+    m_universe.SetHashLife(s.engine == "HashLife");
+    LifeRule rule;
+    if (LifeRule::Parse(s.rule.ToStdString(), rule)) m_universe.SetRule(rule);
+    m_universe.Resize(s.width, s.height);
+    m_universe.SetHistoryMemory(s.historyMemoryMB);
+    m_sim.SetTrace(&m_perf);
+    m_sim.SetHistory(&m_universe.History());
+    m_sim.SetCycleDetector(&m_universe.Cycles());
+    m_sim.SetPauseOnCycle(s.pauseOnCycle);
+    m_sim.SetTurbo(s.turbo);
+}
 
-    m_current.assign(m_width*m_height, false);
-    m_next.assign(m_width*m_height, false);
+LifePanel::~LifePanel() {
+    StopSimulation();
 }
 
-void LifePanel::ResizeUniverse(int w, int h) {
-    m_width = w; m_height = h;
-    m_current.assign(m_width*m_height, false);
-    m_next.assign(m_width*m_height, false);
-    m_generation = 0;
-    Refresh();
+// The part of the plane that is on screen; only this much is copied out for
+// painting, so a frame costs the same on a 100k x 100k board as on a small
+// one. Zoomed out, each pixel of the window is a block of cells.
+ViewWindow LifePanel::CurrentView() const {
+    wxSize sz = GetClientSize();
+    const int pw = std::max(1, sz.GetWidth()), ph = std::max(1, sz.GetHeight());
+    ViewWindow v;
+    v.x0 = m_viewX;
+    v.y0 = m_viewY;
+    if (m_zoom >= 0) {
+        v.w = ((pw - 1) >> m_zoom) + 1;
+        v.h = ((ph - 1) >> m_zoom) + 1;
+    } else {
+        v.w = pw;
+        v.h = ph;
+        v.shift = -m_zoom;
+    }
+    return v;
 }
 
-void LifePanel::ClearUniverse() {
-    std::fill(m_current.begin(), m_current.end(), false);
-    m_generation = 0;
-    Refresh();
+// The cell under a pixel; false when zoomed out, where a pixel is a block.
+bool LifePanel::CellAt(const wxPoint& pt, int64_t& x, int64_t& y) const {
+    if (m_zoom < 0) return false;
+    x = m_viewX + PixelsToCells(pt.x, m_zoom);
+    y = m_viewY + PixelsToCells(pt.y, m_zoom);
+    return true;
 }
 
-void LifePanel::Randomize(int percent) {
-    for (int y=0; y<m_height; ++y) {
-        for (int x=0; x<m_width; ++x) {
-            bool alive = (rand()%100) < percent;
-            m_current[y*m_width + x] = alive;
-        }
+// Changes the zoom, keeping the cell under pt where it is.
+void LifePanel::ZoomAt(const wxPoint& pt, int zoom) {
+    zoom = std::max(kMaxZoomOut, std::min(kMaxZoomIn, zoom));
+    if (zoom == m_zoom) return;
+    int64_t cx = m_viewX + PixelsToCells(pt.x, m_zoom), cy = m_viewY + PixelsToCells(pt.y, m_zoom);
+    m_zoom = zoom;
+    m_viewX = cx - PixelsToCells(pt.x, zoom);
+    m_viewY = cy - PixelsToCells(pt.y, zoom);
+    if (zoom < 0) {
+        // engines count density over aligned blocks
+        int64_t block = int64_t(1) << -zoom;
+        m_viewX &= ~(block - 1);
+        m_viewY &= ~(block - 1);
     }
-    m_generation = 0;
-    Refresh();
+    ViewChanged();
 }
 
-int LifePanel::AliveCount() const {
-    int c=0; for (bool v : m_current) if (v) ++c; return c;
+void LifePanel::Zoom(int steps) {
+    wxSize sz = GetClientSize();
+    ZoomAt(wxPoint(sz.GetWidth()/2, sz.GetHeight()/2), m_zoom + steps);
 }
 
-void LifePanel::ToggleCellAt(const wxPoint& pt) {
-    // compute cell size
+// The closest zoom at which the whole board fits, with its corner at the
+// panel's. Unbounded engines fit their nominal board size.
+void LifePanel::FitZoom() {
     wxSize sz = GetClientSize();
-    int cellW = std::max(1, sz.GetWidth() / m_width);
-    int cellH = std::max(1, sz.GetHeight() / m_height);
-    int x = pt.x / cellW;
-    int y = pt.y / cellH;
-    if (x>=0 && x<m_width && y>=0 && y<m_height) {
-        size_t idx = y*m_width + x;
-        m_current[idx] = !m_current[idx];
-        Refresh();
+    m_viewFitted = sz.GetWidth() > 0 && sz.GetHeight() > 0;
+    if (!m_viewFitted) return; // not laid out yet; OnSize fits it later
+    int zoom = kMaxZoomIn;
+    while (zoom > kMaxZoomOut && (PixelsToCells(sz.GetWidth(), zoom) < GetWidth() || PixelsToCells(sz.GetHeight(), zoom) < GetHeight()))
+        --zoom;
+    m_zoom = zoom;
+    m_viewX = m_viewY = 0;
+}
+
+void LifePanel::FitView() {
+    FitZoom();
+    ViewChanged();
+}
+
+void LifePanel::AddZoomLabel(Label& label) const {
+    if (m_zoom >= 0) label.Add("%d:1", 1 << m_zoom);
+    else label.Add("1:%llu", (unsigned long long)(uint64_t(1) << -m_zoom));
+}
+
+// The viewport moved or zoomed; frames come from the new window from now on.
+void LifePanel::ViewChanged() {
+    if (IsSimulating()) m_sim.SetFrameView(CurrentView());
+    else CopyFrame();
+    UpdateCanvas();
+}
+
+void LifePanel::StartSimulation(int intervalMs) {
+    m_simIntervalMs = intervalMs;
+    if (IsSimulating()) { m_sim.SetInterval(intervalMs); return; }
+    CopyFrame();
+    m_sim.Start(&m_universe.Engine(), m_universe.Generation(), intervalMs, m_frame.view);
+}
+
+void LifePanel::StopSimulation() {
+    if (!IsSimulating()) return;
+    m_universe.SyncGeneration(m_sim.Stop());
+    FrameChanged();
+}
+
+// Takes a copy of the visible part of the engine; only valid while the
+// simulation is stopped.
+void LifePanel::CopyFrame() {
+    m_universe.Engine().CopyView(m_frame, CurrentView());
+    m_frame.generation = m_universe.Generation();
+    m_frame.population = m_universe.Population();
+    m_frame.stats = m_universe.Stats();
+}
+
+// The board changed: bring m_frame up to date unless the simulation thread
+// is supplying it, and redraw what differs.
+void LifePanel::FrameChanged() {
+    if (!IsSimulating()) CopyFrame();
+    UpdateCanvas();
+}
+
+void LifePanel::SetSimulationInterval(int intervalMs) {
+    m_simIntervalMs = intervalMs;
+    if (IsSimulating()) m_sim.SetInterval(intervalMs);
+}
+
+void LifePanel::SetTurbo(bool on) {
+    m_sim.SetTurbo(on);
+    m_hudTime = PerfTrace::Clock::time_point(); // show the change at once
+    if (m_showHUD && m_hudHeight) RefreshRect(wxRect(0, 0, m_canvas.GetWidth(), m_hudHeight), false);
+}
+
+// Called from the frame timer: shows the newest finished generation, if any.
+// In turbo mode there are none, and only the HUD is redrawn, at the text
+// rate. Returns whether what the status bar shows may have changed.
+bool LifePanel::PresentFrame() {
+    if (!IsSimulating()) return false;
+    // generations per second over the last half second or so, counted by
+    // the simulation thread, so frames it skipped are counted too
+    const uint64_t generation = m_sim.GenerationReached();
+    PerfTrace::Clock::time_point now = PerfTrace::Clock::now();
+    double dt = std::chrono::duration<double>(now - m_rateTime).count();
+    if (generation < m_rateGeneration) m_rateGeneration = generation;
+    if (dt >= 0.5) {
+        m_genPerSec = dt < 2.0 ? (generation - m_rateGeneration) / dt : 0.0;
+        m_rateTime = now;
+        m_rateGeneration = generation;
     }
+    if (IsTurbo()) {
+        if (now - m_turboTime < std::chrono::milliseconds(kTextIntervalMs)) return false;
+        m_turboTime = now;
+        m_history.Push(m_sim.PopulationReached());
+        if (m_showHUD && m_hudHeight) RefreshRect(wxRect(0, 0, m_canvas.GetWidth(), m_hudHeight), false);
+        return true;
+    }
+    if (!m_sim.TakeFrame(m_frame)) return false;
+    m_history.Push(m_frame.population);
+    UpdateCanvas();
+    return true;
 }
 
-static inline int mod(int a, int m) {
-    int r = a % m; return (r<0)? r+m : r;
+void LifePanel::SetBoundary(Boundary b) {
+    SimulationPause pause(this);
+    m_universe.SetBoundary(b);
+    FrameChanged();
 }
 
-void LifePanel::NextGeneration() {
-    auto aliveAt = [&](int x, int y)->bool{
-        if (m_boundary == "Finite") {
-            if (x<0 || x>=m_width || y<0 || y>=m_height) return false;
-            return m_current[y*m_width+x];
-        } else { // Toroidal
-            int xx = mod(x, m_width);
-            int yy = mod(y, m_height);
-            return m_current[yy*m_width+xx];
-        }
-    };
-    for (int y=0; y<m_height; ++y) {
-        for (int x=0; x<m_width; ++x) {
-            int n=0;
-            for (int j=-1;j<=1;++j)
-                for (int i=-1;i<=1;++i)
-                    if (!(i==0 && j==0) && aliveAt(x+i, y+j)) ++n;
-            bool curr = m_current[y*m_width+x];
-            bool next = curr;
-            if (curr && (n<2 || n>3)) next=false;
-            else if (!curr && n==3) next=true;
-            m_next[y*m_width+x] = next;
-        }
+const char* LifePanel::GetBoundaryLabel() const {
+    return IsHashLife() ? "Unbounded" : BoundaryName(m_universe.GetBoundary());
+}
+
+const std::string& LifePanel::GetRuleLabel() const {
+    if (m_ruleLabel.empty() || m_labelRule != m_universe.GetRule()) {
+        m_labelRule = m_universe.GetRule();
+        m_ruleLabel = m_labelRule.ToString();
     }
-    m_current.swap(m_next);
-    ++m_generation;
-    Refresh();
+    return m_ruleLabel;
 }
 
-bool LifePanel::SaveUniverse(const wxString& path) {
-    wxTextFile file;
-    if (wxFileExists(path)) wxRemoveFile(path);
-    if (!file.Create(path)) return false;
-    file.AddLine(wxString::Format("%d %d", m_width, m_height));
-    for (int y=0;y<m_height;++y) {
-        wxString row;
-        row.reserve(m_width*2);
-        for (int x=0;x<m_width;++x) {
-            row += (m_current[y*m_width+x] ? '1' : '0');
+bool LifePanel::SetRule(const LifeRule& rule) {
+    SimulationPause pause(this);
+    if (!m_universe.SetRule(rule)) return false;
+    FrameChanged();
+    return true;
+}
+
+void LifePanel::SetThreadCount(int n) {
+    SimulationPause pause(this);
+    m_universe.SetThreadCount(n);
+}
+
+void LifePanel::SetHashLife(bool on) {
+    SimulationPause pause(this);
+    m_universe.SetHashLife(on);
+    FrameChanged();
+}
+
+void LifePanel::SetHashLifeStep(int exponent) {
+    SimulationPause pause(this);
+    m_universe.SetHashLifeStep(exponent);
+}
+
+void LifePanel::SetHashLifeMemory(int megabytes) {
+    SimulationPause pause(this);
+    m_universe.SetHashLifeMemory(megabytes);
+}
+
+EngineStats LifePanel::GetEngineStats() const {
+    if (IsSimulating()) return m_frame.stats;
+    return m_universe.Stats();
+}
+
+void LifePanel::SetGeneration(uint64_t g) {
+    SimulationPause pause(this);
+    m_universe.SetGeneration(g);
+    FrameChanged();
+}
+
+void LifePanel::ResizeUniverse(int w, int h) {
+    SimulationPause pause(this);
+    m_universe.Resize(w, h);
+    FitZoom();
+    RestartHistory();
+    FrameChanged();
+}
+
+void LifePanel::ClearUniverse() {
+    SimulationPause pause(this);
+    m_universe.Clear();
+    RestartHistory();
+    FrameChanged();
+}
+
+void LifePanel::RestartHistory() {
+    m_history.Clear();
+    m_history.Push(m_universe.Population());
+}
+
+void LifePanel::Randomize(double density, uint64_t seed) {
+    SimulationPause pause(this);
+    // an unbounded board can be far too big to fill; seed what is on screen
+    wxSize area(GetWidth(), GetHeight());
+    int64_t x0 = 0, y0 = 0;
+    if (IsUnbounded()) {
+        ViewWindow v = CurrentView();
+        x0 = v.x0; y0 = v.y0;
+        area = wxSize((int)std::min<int64_t>((int64_t)v.w << v.shift, kMaxPackedSide),
+                      (int)std::min<int64_t>((int64_t)v.h << v.shift, kMaxPackedSide));
+    }
+    m_universe.Randomize(density, seed, x0, y0, area.GetWidth(), area.GetHeight());
+    m_soupSeed = seed;
+    RestartHistory();
+    FrameChanged();
+}
+
+// While running, of the frame on screen, or in turbo mode of the newest
+// generation.
+uint64_t LifePanel::GetGeneration() const {
+    if (!IsSimulating()) return m_universe.Generation();
+    return IsTurbo() ? m_sim.GenerationReached() : m_frame.generation;
+}
+
+uint64_t LifePanel::AliveCount() const {
+    if (!IsSimulating()) return m_universe.Population();
+    return IsTurbo() ? m_sim.PopulationReached() : m_frame.population;
+}
+
+void LifePanel::ToggleCellAt(const wxPoint& pt) {
+    int64_t x, y;
+    if (!CellAt(pt, x, y)) return; // zoomed out, a pixel is a whole block
+    if (!IsUnbounded() && (x<0 || x>=GetWidth() || y<0 || y>=GetHeight())) return;
+    if (IsSimulating()) {
+        // show it right away; the simulation picks it up next generation
+        const ViewWindow& v = m_frame.view;
+        int64_t fx = x - v.x0, fy = y - v.y0;
+        if (v.shift==0 && fx>=0 && fx<m_frame.width && fy>=0 && fy<m_frame.height) {
+            uint8_t* state = m_frame.states.empty() ? nullptr : &m_frame.states[(size_t)fy*m_frame.width + fx];
+            if (state && *state > 1) {
+                *state = 0; // a dying cell just dies
+            } else {
+                m_frame.Toggle((int)fx, (int)fy);
+                m_frame.population += m_frame.Get((int)fx, (int)fy) ? 1 : -1;
+                if (state) *state = m_frame.Get((int)fx, (int)fy);
+            }
         }
-        file.AddLine(row);
+        GenerationHistory* history = &m_universe.History();
+        CycleDetector* cycles = &m_universe.Cycles();
+        m_sim.Post([x, y, history, cycles](LifeEngine& e) {
+            e.Toggle(x, y);
+            history->RecordToggle(x, y);
+            cycles->Reset();
+        });
+    } else {
+        m_universe.Toggle(x, y);
     }
-    file.Write(); file.Close();
+    FrameChanged();
+}
+
+bool LifePanel::StepBack() {
+    return GetGeneration() > 0 && RewindTo(GetGeneration() - 1);
+}
+
+bool LifePanel::RewindTo(uint64_t generation) {
+    SimulationPause pause(this);
+    if (!m_universe.RewindTo(generation)) return false;
+    m_history.Push(m_universe.Population());
+    FrameChanged();
     return true;
 }
 
-bool LifePanel::LoadUniverse(const wxString& path, bool resizeToFile) {
-    wxTextFile file(path);
-    if (!file.Open()) return false;
-    if (file.GetLineCount()<2) { file.Close(); return false; }
-    int w=0,h=0;
+void LifePanel::SetHistoryMemory(int megabytes) {
+    SimulationPause pause(this);
+    m_universe.SetHistoryMemory(megabytes);
+}
+
+bool LifePanel::GetCycle(uint64_t& period, uint64_t& start) const {
+    const CycleDetector& cycles = m_universe.Cycles();
+    period = cycles.Period();
+    start = cycles.Start();
+    return period != 0;
+}
+
+void LifePanel::NextGeneration() {
+    SimulationPause pause(this);
     {
-        wxString header = file.GetLine(0);
-        wxArrayString parts = wxSplit(header, ' ');
-        if (parts.size()>=2) {
-            parts[0].ToLong((long*)&w);
-            parts[1].ToLong((long*)&h);
-        } else {
-            file.Close(); return false;
-        }
+        PerfScope scope(&m_perf, PerfPhase::Step);
+        m_universe.Step();
     }
-    if (resizeToFile) ResizeUniverse(w,h);
-    int rows = std::min((int)file.GetLineCount()-1, m_height);
-    for (int y=0; y<rows; ++y) {
-        wxString row = file.GetLine(1+y);
-        for (int x=0; x<std::min((int)row.length(), m_width); ++x) {
-            m_current[y*m_width+x] = (row[x]=='1');
-        }
-    }
-    m_generation=0;
-    file.Close();
-    Refresh();
+    m_history.Push(m_universe.Population());
+    FrameChanged();
+}
+
+bool LifePanel::SaveUniverse(const wxString& path) {
+    SimulationPause pause(this);
+    return m_universe.Save(path.ToStdString());
+}
+
+// A stamp is one word-level Paste of cells the library already holds, then
+// the usual frame update; a bounded board clips it.
+void LifePanel::Stamp(int64_t cx, int64_t cy) {
+    if (!m_stamp || !m_stamp->width) return;
+    SimulationPause pause(this);
+    m_universe.Stamp(*m_stamp, cx - m_stamp->width/2, cy - m_stamp->height/2, m_stampMode);
+    FrameChanged();
+}
+
+void LifePanel::StampInMiddle() {
+    ViewWindow v = CurrentView();
+    Stamp(v.x0 + ((int64_t)v.w << v.shift) / 2, v.y0 + ((int64_t)v.h << v.shift) / 2);
+}
+
+bool LifePanel::LoadUniverse(const wxString& path, bool resizeToFile) {
+    SimulationPause pause(this);
+    if (!m_universe.Load(path.ToStdString(), resizeToFile)) return false;
+    if (resizeToFile) FitZoom();
+    RestartHistory();
+    FrameChanged();
     return true;
 }
 
+// How the HUD and the status bar describe a cycle the board has settled into.
+static void AddCycleLabel(Label& label, uint64_t period, uint64_t start) {
+    if (period == 1) label.Add("  Stable since gen %llu", (unsigned long long)start);
+    else label.Add("  Period %llu since gen %llu", (unsigned long long)period, (unsigned long long)start);
+}
+
 void LifePanel::OnPaint(wxPaintEvent&) {
+    PerfScope scope(&m_perf, PerfPhase::Paint);
     wxAutoBufferedPaintDC dc(this);
-    dc.SetBackground(wxBrush(m_bgColor));
-    dc.Clear();
+    if (!m_canvasValid) RebuildCanvas();
 
+    // The cells are already drawn into the canvas; copy out the damaged parts.
+    wxRect all(0, 0, m_canvas.GetWidth(), m_canvas.GetHeight());
+    for (wxRegionIterator it(GetUpdateRegion()); it; ++it) {
+        wxRect r = it.GetRect().Intersect(all);
+        if (!r.IsEmpty()) dc.DrawBitmap(wxBitmap(m_canvas.GetSubImage(r)), r.x, r.y);
+    }
+
+    // HUD
+    if (m_showHUD) {
+        if (!IsSimulating() || PerfTrace::Clock::now() - m_hudTime >= std::chrono::milliseconds(kTextIntervalMs))
+            BuildHUD();
+        dc.SetTextForeground(*wxWHITE);
+        int textH = dc.GetTextExtent(m_hudText).GetHeight();
+        dc.DrawText(m_hudText, 5, 5);
+        dc.DrawText(PerfLabel(), 5, 5 + textH + 2);
+        DrawSparkline(dc, 5, 5 + 2*textH + 6, 30);
+        m_hudHeight = 5 + 2*textH + 6 + 30 + 2;
+    }
+}
+
+// The stats are those of the frame on screen; turbo mode leaves them at
+// the last one shown.
+void LifePanel::BuildHUD() {
+    m_hudTime = PerfTrace::Clock::now();
+    Label label;
+    label.Add("Gen: %llu  Alive: %llu  Size: %dx%d  Boundary: %s  Rule: %s  Zoom: ",
+        (unsigned long long)GetGeneration(), (unsigned long long)AliveCount(), GetWidth(), GetHeight(),
+        GetBoundaryLabel(), GetRuleLabel().c_str());
+    AddZoomLabel(label);
+    if (IsHashLife()) {
+        const EngineStats& st = m_frame.stats;
+        double hitRate = st.cacheLookups ? 100.0*st.cacheHits/st.cacheLookups : 0.0;
+        label.Add("  Step: 2^%d  Nodes: %llu  Mem: %.1f MB  Cache hits: %.1f%%",
+            GetHashLifeStep(), (unsigned long long)st.nodes, st.memoryBytes/1048576.0, hitRate);
+    } else if (IsSparse()) {
+        const EngineStats& st = m_frame.stats;
+        label.Add("  Tiles: %llu  Mem: %.1f MB", (unsigned long long)st.nodes, st.memoryBytes/1048576.0);
+        if (st.mappedBytes) label.Add("  Mapped: %.1f MB", st.mappedBytes/1048576.0);
+    } else if (m_frame.stats.tiles) {
+        // share of tiles the last step had to compute; settled areas are skipped
+        const EngineStats& st = m_frame.stats;
+        label.Add("  Active tiles: %.1f%%", 100.0*st.activeTiles/st.tiles);
+    }
+    if (!IsHashLife()) {
+        label.Add("  Births: %llu  Deaths: %llu",
+            (unsigned long long)m_frame.stats.births, (unsigned long long)m_frame.stats.deaths);
+    }
+    uint64_t period, start;
+    if (GetCycle(period, start)) AddCycleLabel(label, period, start);
+    if (IsTurbo()) label.Add("  Turbo");
+    if (label == m_hud) return;
+    m_hud = label;
+    m_hudText = label.c_str();
+}
+
+// Pixels per cell m_frame is drawn at; density frames are one pixel each.
+int LifePanel::FrameCellSize() const {
+    return m_frame.view.shift ? 1 : 1 << std::max(0, m_zoom);
+}
+
+// Paints the background and grid over the whole client area, then every
+// live cell (or density pixel) of m_frame. Grid lines are left out once
+// cells get too small for them to help.
+void LifePanel::RebuildCanvas() {
     wxSize sz = GetClientSize();
-    int cellW = std::max(1, sz.GetWidth() / m_width);
-    int cellH = std::max(1, sz.GetHeight() / m_height);
-
-    // Draw alive cells
-    dc.SetBrush(wxBrush(m_aliveColor));
-    dc.SetPen(*wxTRANSPARENT_PEN);
-    for (int y=0; y<m_height; ++y) {
-        for (int x=0; x<m_width; ++x) {
-            if (m_current[y*m_width+x]) {
-                dc.DrawRectangle(x*cellW, y*cellH, cellW, cellH);
-            }
+    const ViewWindow& v = m_frame.view;
+    m_canvasCell = FrameCellSize();
+    m_canvasGrid = m_showGrid && m_canvasCell >= kMinGridCellSize;
+    m_canvas.Create(std::max(1, sz.GetWidth()), std::max(1, sz.GetHeight()), false);
+    const int cw = m_canvas.GetWidth(), ch = m_canvas.GetHeight();
+    unsigned char* px = m_canvas.GetData();
+    auto fill = [&](int x0, int y0, int x1, int y1, const wxColour& c) {
+        for (int y=std::max(y0, 0); y<std::min(y1, ch); ++y) {
+            unsigned char* p = px + 3*((size_t)y*cw + std::max(x0, 0));
+            for (int x=std::max(x0, 0); x<std::min(x1, cw); ++x, p+=3) { p[0] = c.Red(); p[1] = c.Green(); p[2] = c.Blue(); }
         }
+    };
+    fill(0, 0, cw, ch, m_bgColor);
+
+    // the board's edges in pixels; a bounded board shows where it ends
+    int left = 0, top = 0, right = cw, bottom = ch;
+    if (!IsUnbounded()) {
+        auto toPixels = [&](int64_t cells, bool roundUp) {
+            int64_t p = v.shift ? (cells + (roundUp ? (int64_t(1) << v.shift) - 1 : 0)) >> v.shift : cells * m_canvasCell;
+            return (int)std::max<int64_t>(0, std::min<int64_t>(p, INT_MAX));
+        };
+        left = std::min(toPixels(-v.x0, false), cw);
+        top = std::min(toPixels(-v.y0, false), ch);
+        right = std::min(toPixels(GetWidth() - v.x0, true), cw);
+        bottom = std::min(toPixels(GetHeight() - v.y0, true), ch);
+        fill(0, 0, cw, top, m_gridColor);
+        fill(0, bottom, cw, ch, m_gridColor);
+        fill(0, top, left, bottom, m_gridColor);
+        fill(right, top, cw, bottom, m_gridColor);
+    }
+    if (m_canvasGrid) {
+        const int c = m_canvasCell;
+        for (int x=(left + c - 1)/c*c; x<=std::min(right, cw-1); x+=c) fill(x, top, x+1, bottom, m_gridColor);
+        for (int y=(top + c - 1)/c*c; y<=std::min(bottom, ch-1); y+=c) fill(left, y, right, y+1, m_gridColor);
     }
+    m_shown.Reset(m_frame.width, m_frame.height);
+    m_shown.view = v;
+    m_shown.density.assign(v.shift ? m_frame.density.size() : 0, 0);
+    m_shown.states.assign(m_frame.states.size(), 0);
+    m_canvasValid = true;
+    UpdateCanvas(false); // this paint covers the whole panel anyway
+}
 
-    // Grid
-    if (m_showGrid) {
-        dc.SetPen(wxPen(m_gridColor));
-        for (int x=0; x<=m_width; ++x) {
-            dc.DrawLine(x*cellW, 0, x*cellW, m_height*cellH);
-        }
-        for (int y=0; y<=m_height; ++y) {
-            dc.DrawLine(0, y*cellH, m_width*cellW, y*cellH);
+// Colors the inside of one cell; the grid lines on its top and left edge stay.
+void LifePanel::FillCell(int x, int y, const wxColour& c) {
+    const int inset = m_canvasGrid ? 1 : 0;
+    const int cw = m_canvas.GetWidth();
+    const int x0 = x*m_canvasCell + inset, x1 = std::min((x+1)*m_canvasCell, cw);
+    const int y0 = y*m_canvasCell + inset, y1 = std::min((y+1)*m_canvasCell, m_canvas.GetHeight());
+    unsigned char* px = m_canvas.GetData();
+    for (int py=y0; py<y1; ++py) {
+        unsigned char* p = px + 3*((size_t)py*cw + x0);
+        for (int pxl=x0; pxl<x1; ++pxl, p+=3) { p[0] = c.Red(); p[1] = c.Green(); p[2] = c.Blue(); }
+    }
+}
+
+// Background blended toward the live color by a density pixel.
+wxColour LifePanel::DensityColor(uint8_t d) const {
+    return BlendColor(m_bgColor, m_aliveColor, d);
+}
+
+// Multi-state cells: dying ones fade from the live color toward the
+// background as they go through their states.
+wxColour LifePanel::StateColor(uint8_t state) const {
+    if (state <= 1) return state ? m_aliveColor : m_bgColor;
+    const int states = m_universe.GetRule().states;
+    return DensityColor((uint8_t)(255 * std::max(states - state, 0) / (states - 1)));
+}
+
+// Redraws the cells whose state differs from what the canvas shows and
+// invalidates the rows they are in, one rectangle per run of changed rows.
+void LifePanel::UpdateCanvas(bool invalidate) {
+    wxSize sz = GetClientSize();
+    if (!m_canvasValid || m_shown.view != m_frame.view
+        || m_shown.width != m_frame.width || m_shown.height != m_frame.height
+        || m_shown.states.size() != m_frame.states.size()
+        || m_canvas.GetWidth() != std::max(1, sz.GetWidth()) || m_canvas.GetHeight() != std::max(1, sz.GetHeight())
+        || m_canvasCell != FrameCellSize()) {
+        InvalidateCanvas();
+        return;
+    }
+    const int c = m_canvasCell;
+    int runTop = -1, runLeft = INT_MAX, runRight = -1;
+    auto flush = [&](int yEnd) {
+        if (runTop < 0) return;
+        if (invalidate) RefreshRect(wxRect(runLeft*c, runTop*c, (runRight-runLeft+1)*c, (yEnd-runTop)*c), false);
+        runTop = -1; runLeft = INT_MAX; runRight = -1;
+    };
+    for (int y=0; y<m_frame.height; ++y) {
+        bool rowChanged = false;
+        if (m_frame.view.shift || !m_frame.states.empty()) {
+            // a byte per pixel: the density zoomed out, or the cell states
+            // of a multi-state frame
+            const bool density = m_frame.view.shift != 0;
+            const uint8_t* now = &(density ? m_frame.density : m_frame.states)[(size_t)y*m_frame.width];
+            uint8_t* shown = &(density ? m_shown.density : m_shown.states)[(size_t)y*m_frame.width];
+            for (int x=0; x<m_frame.width; ++x) {
+                if (now[x] == shown[x]) continue;
+                rowChanged = true;
+                runLeft = std::min(runLeft, x);
+                runRight = std::max(runRight, x);
+                FillCell(x, y, density ? DensityColor(now[x]) : StateColor(now[x]));
+                shown[x] = now[x];
+            }
+        } else {
+            const uint64_t* now = m_frame.Row(y);
+            uint64_t* shown = m_shown.Row(y);
+            for (int w=0; w<m_frame.stride; ++w) {
+                uint64_t diff = now[w] ^ shown[w];
+                if (!diff) continue;
+                rowChanged = true;
+                runLeft = std::min(runLeft, w*64 + CountTrailingZeros64(diff));
+                runRight = std::max(runRight, w*64 + 63 - CountLeadingZeros64(diff));
+                for (; diff; diff &= diff-1) {
+                    int x = w*64 + CountTrailingZeros64(diff);
+                    FillCell(x, y, ((now[w] >> (x&63)) & 1) ? m_aliveColor : m_bgColor);
+                }
+                shown[w] = now[w];
+            }
         }
+        if (rowChanged) { if (runTop < 0) runTop = y; }
+        else flush(y);
     }
+    flush(m_frame.height);
+    // the HUD text changes with every generation
+    if (invalidate && m_showHUD && m_hudHeight) RefreshRect(wxRect(0, 0, m_canvas.GetWidth(), m_hudHeight), false);
+}
 
-    // HUD
-    if (m_showHUD) {
-        dc.SetTextForeground(*wxWHITE);
-        wxString hud = wxString::Format("Gen: %ld  Alive: %d  Size: %dx%d  Boundary: %s",
-            m_generation, AliveCount(), m_width, m_height, m_boundary);
-        dc.DrawText(hud, 5, 5);
+// Generation rate, step and paint times (median and 99th percentile over
+// the last second) and how late the simulation's timer fires against its
+// interval. Summarizing sorts up to a second of events, so the label is
+// only rebuilt every quarter second.
+const wxString& LifePanel::PerfLabel() {
+    PerfTrace::Clock::time_point now = PerfTrace::Clock::now();
+    if (!m_perfText.empty() && now - m_perfLabelTime < std::chrono::milliseconds(250)) return m_perfText;
+    m_perfLabelTime = now;
+    PerfTrace::Summary step = m_perf.Summarize(PerfPhase::Step, 1.0);
+    PerfTrace::Summary paint = m_perf.Summarize(PerfPhase::Paint, 1.0);
+    Label label;
+    label.Add("Gen/s: %.0f  Step p50/p99: %.3f/%.3f ms  Paint p50/p99: %.2f/%.2f ms",
+        IsSimulating() ? m_genPerSec : 0.0, step.p50Ms, step.p99Ms, paint.p50Ms, paint.p99Ms);
+    if (IsSimulating() && m_simIntervalMs > 0) {
+        PerfTrace::Summary lag = m_perf.Summarize(PerfPhase::TimerLag, 1.0);
+        label.Add("  Timer lag p99: %.2f ms of %d ms", lag.p99Ms, m_simIntervalMs);
     }
+    if (label != m_perfLine || m_perfText.empty()) {
+        m_perfLine = label;
+        m_perfText = label.c_str();
+    }
+    return m_perfText;
+}
+
+bool LifePanel::SavePerfTrace(const wxString& path, double seconds) const {
+    std::FILE* f = wxFopen(path, "w");
+    if (!f) return false;
+    bool ok = m_perf.WriteChromeTrace(f, seconds);
+    return std::fclose(f) == 0 && ok;
+}
+
+// Population over the last PopulationHistory::kLength displayed generations,
+// scaled to fill the box between its minimum and maximum.
+void LifePanel::DrawSparkline(wxDC& dc, int x, int y, int h) const {
+    const int n = m_history.Size();
+    if (n < 2) return;
+    uint64_t lo = m_history[0], hi = m_history[0];
+    for (int i=1; i<n; ++i) {
+        lo = std::min(lo, m_history[i]);
+        hi = std::max(hi, m_history[i]);
+    }
+    double scale = hi > lo ? (double)(h-1) / (double)(hi - lo) : 0.0;
+    wxPoint pts[PopulationHistory::kLength];
+    for (int i=0; i<n; ++i)
+        pts[i] = wxPoint(x + i, y + (h-1) - (int)((m_history[i] - lo) * scale));
+    dc.SetPen(wxPen(m_aliveColor));
+    dc.DrawLines(n, pts);
 }
 
 void LifePanel::OnLeftDown(wxMouseEvent& e) {
-    ToggleCellAt(e.GetPosition());
+    if (e.ControlDown() && m_stamp) {
+        // zoomed out, the block's top-left cell
+        wxPoint pt = e.GetPosition();
+        Stamp(m_viewX + PixelsToCells(pt.x, m_zoom), m_viewY + PixelsToCells(pt.y, m_zoom));
+    } else {
+        ToggleCellAt(e.GetPosition());
+    }
+}
+
+// Right or middle drag pans the view.
+void LifePanel::OnDragStart(wxMouseEvent& e) {
+    m_dragging = true;
+    m_dragStart = e.GetPosition();
+    m_dragViewX = m_viewX;
+    m_dragViewY = m_viewY;
+    if (!HasCapture()) CaptureMouse();
+}
+
+void LifePanel::OnDragEnd(wxMouseEvent&) {
+    m_dragging = false;
+    if (HasCapture()) ReleaseMouse();
+}
+
+void LifePanel::OnMotion(wxMouseEvent& e) {
+    if (!m_dragging) return;
+    // moves by whole cells, or whole blocks when zoomed out
+    wxPoint pt = e.GetPosition();
+    int64_t x = m_dragViewX - PixelsToCells(pt.x - m_dragStart.x, m_zoom);
+    int64_t y = m_dragViewY - PixelsToCells(pt.y - m_dragStart.y, m_zoom);
+    if (x == m_viewX && y == m_viewY) return;
+    m_viewX = x;
+    m_viewY = y;
+    ViewChanged();
+}
+
+void LifePanel::OnMouseWheel(wxMouseEvent& e) {
+    int steps = e.GetWheelRotation() / std::max(1, e.GetWheelDelta());
+    if (steps) ZoomAt(e.GetPosition(), m_zoom + steps);
+}
+
+void LifePanel::OnCaptureLost(wxMouseCaptureLostEvent&) {
+    m_dragging = false;
 }
 
 void LifePanel::OnSize(wxSizeEvent& e) {
     e.Skip();
-    Refresh();
+    if (!m_viewFitted) FitZoom();
+    if (IsSimulating()) m_sim.SetFrameView(CurrentView());
+    else CopyFrame();
+    InvalidateCanvas();
+}
+
+// ---------------- PatternBrowser Impl ----------------
+PatternBrowser::PatternBrowser(MainFrame* parent)
+: wxPanel(parent, wxID_ANY), m_owner(parent)
+{
+    m_list = new wxListBox(this, ID_PATTERN_LIST);
+    m_preview = new wxStaticBitmap(this, wxID_ANY, wxNullBitmap, wxDefaultPosition, wxSize(kThumbnailSize, kThumbnailSize));
+    m_info = new wxStaticText(this, wxID_ANY, "");
+    wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+    sizer->Add(m_list, 1, wxEXPAND|wxALL, 4);
+    sizer->Add(m_preview, 0, wxALIGN_CENTER|wxALL, 4);
+    sizer->Add(m_info, 0, wxEXPAND|wxALL, 4);
+    SetSizer(sizer);
+    SetMinSize(wxSize(kThumbnailSize + 16, -1));
+}
+
+void PatternBrowser::SetLibrary(const PatternLibrary* library) {
+    m_library = library;
+    m_list->Clear();
+    for (size_t i=0; i<library->Size(); ++i) m_list->Append(wxString::FromUTF8(library->At(i).name.c_str()));
+    ShowSelection();
+}
+
+void PatternBrowser::SetColors(const wxColour& bg, const wxColour& alive) {
+    m_bgColor = bg;
+    m_aliveColor = alive;
+    ShowSelection();
+}
+
+int PatternBrowser::GetSelection() const {
+    return m_library ? m_list->GetSelection() : wxNOT_FOUND;
+}
+
+void PatternBrowser::OnSelect(wxCommandEvent&) {
+    ShowSelection();
+    m_owner->SelectPattern(GetSelection());
+}
+
+void PatternBrowser::OnActivate(wxCommandEvent&) {
+    m_owner->SelectPattern(GetSelection());
+    m_owner->StampPattern();
+}
+
+// Small patterns are drawn a few pixels per cell, large ones a pixel per
+// block of cells.
+void PatternBrowser::ShowSelection() {
+    const int index = GetSelection();
+    if (index < 0) {
+        m_preview->SetBitmap(wxNullBitmap);
+        m_info->SetLabel("");
+        return;
+    }
+    const PatternLibrary::Pattern& p = m_library->At(index);
+    int w, h;
+    m_library->Thumbnail(index, kThumbnailSize, m_pixels, w, h);
+    wxImage image(std::max(w, 1), std::max(h, 1));
+    unsigned char* rgb = image.GetData();
+    std::fill(rgb, rgb + 3*image.GetWidth()*image.GetHeight(), 0);
+    for (size_t i=0; i<m_pixels.size(); ++i) {
+        wxColour c = BlendColor(m_bgColor, m_aliveColor, m_pixels[i]);
+        rgb[3*i] = c.Red(); rgb[3*i+1] = c.Green(); rgb[3*i+2] = c.Blue();
+    }
+    const int scale = std::max(1, kThumbnailSize / std::max(1, std::max(w, h)));
+    image.Rescale(image.GetWidth()*scale, image.GetHeight()*scale, wxIMAGE_QUALITY_NEAREST);
+    m_preview->SetBitmap(wxBitmap(image));
+    Label info;
+    info.Add("%d x %d, %llu cells", p.cells.width, p.cells.height, (unsigned long long)p.population);
+    if (p.period == 1) info.Add("\nStill life");
+    else if (p.period > 1) info.Add("\nPeriod %d", p.period);
+    info.Add("\n%s", p.rule.ToString().c_str());
+    m_info->SetLabel(info.c_str());
+    Layout();
 }
 
 // ---------------- MainFrame Impl ----------------
@@ -425,7 +1458,15 @@ MainFrame::MainFrame()
     BuildMenu();
     BuildToolbar();
     CreateStatusBar(2);
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    m_browser = new PatternBrowser(this);
     m_panel = new LifePanel(this);
+    wxBoxSizer* sizer = new wxBoxSizer(wxHORIZONTAL);
+    sizer->Add(m_browser, 0, wxEXPAND);
+    sizer->Add(m_panel, 1, wxEXPAND);
+    SetSizer(sizer);
+    m_browser->Show(app->settings.showPatterns);
+    OpenPatternLibrary();
     SetMinSize(wxSize(600,400));
 
     UpdateStatus();
@@ -444,20 +1485,54 @@ void MainFrame::BuildMenu() {
     sim->Append(ID_START, "&Start\tF5");
     sim->Append(ID_PAUSE, "&Pause\tF6");
     sim->Append(ID_NEXT, "&Next\tSpace");
+    sim->Append(ID_STEP_BACK, "Step &Back\tBack");
+    sim->Append(ID_REWIND, "Re&wind To Generation...\tCtrl-G");
+    sim->Append(ID_STEP_INTERVAL, "Step &Interval...");
+    sim->AppendCheckItem(ID_MAX_SPEED, "&Max Speed");
+    sim->AppendCheckItem(ID_TURBO, "&Turbo (No Frames)\tCtrl-T");
+    sim->AppendCheckItem(ID_PAUSE_ON_CYCLE, "Pause on &Cycle");
     sim->AppendSeparator();
     sim->Append(ID_RANDOMIZE, "&Randomize\tCtrl-R");
+    sim->Append(ID_RANDOMIZE_WITH, "Randomize &With...\tCtrl-Shift-R");
 
     wxMenu* view = new wxMenu;
     view->AppendCheckItem(ID_VIEW_GRID, "Show &Grid");
     view->AppendCheckItem(ID_VIEW_HUD, "Show &HUD");
+    view->AppendSeparator();
+    view->Append(ID_VIEW_ZOOM_IN, "Zoom &In\tCtrl-+");
+    view->Append(ID_VIEW_ZOOM_OUT, "Zoom &Out\tCtrl--");
+    view->Append(ID_VIEW_FIT, "&Fit Board\tCtrl-0");
+    view->AppendSeparator();
+    view->Append(ID_VIEW_SAVE_TRACE, "Save Performance &Trace...");
 
     wxMenu* options = new wxMenu;
     options->Append(ID_OPTIONS_COLORS, "&Colors...");
     options->Append(ID_OPTIONS_SIZE, "&Universe Size...");
+    options->Append(ID_OPTIONS_RULE, "&Rule...");
     wxMenu* boundary = new wxMenu;
     boundary->AppendRadioItem(ID_OPTIONS_BOUNDARY_FINITE, "&Finite");
     boundary->AppendRadioItem(ID_OPTIONS_BOUNDARY_TOROIDAL, "&Toroidal");
+    boundary->AppendRadioItem(ID_OPTIONS_BOUNDARY_KLEIN_BOTTLE, "&Klein Bottle");
+    boundary->AppendRadioItem(ID_OPTIONS_BOUNDARY_MIRROR, "&Mirror");
+    boundary->AppendRadioItem(ID_OPTIONS_BOUNDARY_INFINITE, "&Infinite");
     options->AppendSubMenu(boundary, "&Boundary");
+    options->Append(ID_OPTIONS_THREADS, "&Threads...");
+    wxMenu* engine = new wxMenu;
+    engine->AppendRadioItem(ID_OPTIONS_ENGINE_PACKED, "&Packed (bounded)");
+    engine->AppendRadioItem(ID_OPTIONS_ENGINE_HASHLIFE, "&HashLife (unbounded)");
+    engine->AppendSeparator();
+    engine->Append(ID_OPTIONS_HASHLIFE_STEP, "HashLife &Step Size...");
+    engine->Append(ID_OPTIONS_HASHLIFE_MEMORY, "HashLife &Memory Limit...");
+    options->AppendSubMenu(engine, "&Engine");
+    options->Append(ID_OPTIONS_HISTORY_MEMORY, "&History Memory Limit...");
+
+    wxMenu* patterns = new wxMenu;
+    patterns->AppendCheckItem(ID_PATTERNS_SHOW, "Show &Library\tCtrl-L");
+    patterns->Append(ID_PATTERNS_STAMP, "&Stamp in Middle\tCtrl-E");
+    patterns->AppendCheckItem(ID_PATTERNS_XOR, "&XOR Stamps");
+    patterns->AppendSeparator();
+    patterns->Append(ID_PATTERNS_FOLDER, "Library &Folder...");
+    patterns->Append(ID_PATTERNS_REINDEX, "&Reindex");
 
     wxMenu* settings = new wxMenu;
     settings->Append(ID_SETTINGS_RESET, "&Reset to Defaults");
@@ -467,6 +1542,7 @@ void MainFrame::BuildMenu() {
     bar->Append(sim, "&Simulation");
     bar->Append(view, "&View");
     bar->Append(options, "&Options");
+    bar->Append(patterns, "&Patterns");
     bar->Append(settings, "&Settings");
     SetMenuBar(bar);
 
@@ -474,10 +1550,16 @@ void MainFrame::BuildMenu() {
     LifeApp* app = (LifeApp*)wxApp::GetInstance();
     GetMenuBar()->Check(ID_VIEW_GRID, app->settings.showGrid);
     GetMenuBar()->Check(ID_VIEW_HUD, app->settings.showHUD);
-    if (app->settings.boundary == "Finite")
-        GetMenuBar()->Check(ID_OPTIONS_BOUNDARY_FINITE, true);
+    GetMenuBar()->Check(ID_MAX_SPEED, app->settings.maxSpeed);
+    GetMenuBar()->Check(ID_TURBO, app->settings.turbo);
+    GetMenuBar()->Check(ID_PAUSE_ON_CYCLE, app->settings.pauseOnCycle);
+    GetMenuBar()->Check(ID_PATTERNS_SHOW, app->settings.showPatterns);
+    GetMenuBar()->Check(ID_PATTERNS_XOR, app->settings.stampXor);
+    GetMenuBar()->Check(BoundaryMenuId(app->settings.boundary), true);
+    if (app->settings.engine == "HashLife")
+        GetMenuBar()->Check(ID_OPTIONS_ENGINE_HASHLIFE, true);
     else
-        GetMenuBar()->Check(ID_OPTIONS_BOUNDARY_TOROIDAL, true);
+        GetMenuBar()->Check(ID_OPTIONS_ENGINE_PACKED, true);
 }
 
 void MainFrame::BuildToolbar() {
@@ -501,10 +1583,14 @@ void MainFrame::OnNew(wxCommandEvent&) {
 }
 
 void MainFrame::OnOpen(wxCommandEvent&) {
-    wxFileDialog dlg(this, "Open Universe", "", "", "Universe files (*.txt)|*.txt|All files|*.*", wxFD_OPEN|wxFD_FILE_MUST_EXIST);
+    wxFileDialog dlg(this, "Open Universe", "", "",
+        "Universe files (*.txt;*.rle;*.cells;*.lifb;*.lift)|*.txt;*.rle;*.cells;*.lifb;*.lift|"
+        "Text (*.txt)|*.txt|RLE (*.rle)|*.rle|Plaintext (*.cells)|*.cells|Packed binary (*.lifb)|*.lifb|"
+        "Tiled, memory-mapped (*.lift)|*.lift|All files|*.*", wxFD_OPEN|wxFD_FILE_MUST_EXIST);
     if (dlg.ShowModal()==wxID_OK) {
         if (m_panel->LoadUniverse(dlg.GetPath(), true)) {
             m_currentPath = dlg.GetPath();
+            SyncRuleSetting();
             UpdateStatus();
         } else {
             wxMessageBox("Failed to open file.", "Error", wxICON_ERROR|wxOK, this);
@@ -514,22 +1600,41 @@ void MainFrame::OnOpen(wxCommandEvent&) {
 
 void MainFrame::OnSave(wxCommandEvent&) {
     if (m_currentPath.IsEmpty()) { OnSaveAs(*(new wxCommandEvent())); return; }
-    if (!m_panel->SaveUniverse(m_currentPath))
+    SaveCurrentPath();
+}
+
+// Binary and tiled files have no room for a multi-state rule, which is the
+// one failure worth explaining.
+void MainFrame::SaveCurrentPath() {
+    if (m_panel->SaveUniverse(m_currentPath)) return;
+    PatternFormat format = PatternFormatForPath(m_currentPath.ToStdString());
+    if ((format == PatternFormat::Binary || format == PatternFormat::Tiled) && !m_panel->GetRule().IsLifeLike()) {
+        wxMessageBox("Packed binary and tiled files only hold two-state rules. Save as RLE, text or plaintext instead.",
+            "Error", wxICON_ERROR|wxOK, this);
+    } else {
         wxMessageBox("Failed to save file.", "Error", wxICON_ERROR|wxOK, this);
+    }
 }
 
 void MainFrame::OnSaveAs(wxCommandEvent&) {
-    wxFileDialog dlg(this, "Save Universe As", "", "", "Universe files (*.txt)|*.txt|All files|*.*", wxFD_SAVE|wxFD_OVERWRITE_PROMPT);
+    // the format follows the extension; a name without one gets the filter's
+    static const char* const exts[] = { "txt", "rle", "cells", "lifb", "lift" };
+    wxFileDialog dlg(this, "Save Universe As", "", "",
+        "Text (*.txt)|*.txt|RLE (*.rle)|*.rle|Plaintext (*.cells)|*.cells|Packed binary (*.lifb)|*.lifb|"
+        "Tiled, memory-mapped (*.lift)|*.lift",
+        wxFD_SAVE|wxFD_OVERWRITE_PROMPT);
     if (dlg.ShowModal()==wxID_OK) {
-        m_currentPath = dlg.GetPath();
-        if (!m_panel->SaveUniverse(m_currentPath))
-            wxMessageBox("Failed to save file.", "Error", wxICON_ERROR|wxOK, this);
+        wxFileName name(dlg.GetPath());
+        if (!name.HasExt()) name.SetExt(exts[std::min(std::max(dlg.GetFilterIndex(), 0), 4)]);
+        m_currentPath = name.GetFullPath();
+        SaveCurrentPath();
     }
 }
 
 void MainFrame::OnStart(wxCommandEvent&) {
     if (!m_running) {
-        m_timer.Start(m_intervalMs);
+        m_panel->StartSimulation(SimulationInterval());
+        m_timer.Start(kFrameIntervalMs);
         m_running=true;
         UpdateStatus();
     }
@@ -538,11 +1643,51 @@ void MainFrame::OnStart(wxCommandEvent&) {
 void MainFrame::OnPause(wxCommandEvent&) {
     if (m_running) {
         m_timer.Stop();
+        m_panel->StopSimulation();
         m_running=false;
         UpdateStatus();
     }
 }
 
+// Milliseconds between generations while running, 0 at max speed.
+int MainFrame::SimulationInterval() const {
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    return app->settings.maxSpeed ? 0 : app->settings.intervalMs;
+}
+
+void MainFrame::OnChooseInterval(wxCommandEvent&) {
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    long ms = wxGetNumberFromUser("Pause between generations while running, unless Max Speed is on.",
+        "Milliseconds:", "Step Interval", app->settings.intervalMs, 1, 10000, this);
+    if (ms<0) return; // cancelled
+    app->settings.intervalMs = (int)ms;
+    app->SettingsChanged();
+    m_panel->SetSimulationInterval(SimulationInterval());
+}
+
+void MainFrame::OnMaxSpeed(wxCommandEvent& e) {
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    app->settings.maxSpeed = e.IsChecked();
+    app->SettingsChanged();
+    m_panel->SetSimulationInterval(SimulationInterval());
+}
+
+void MainFrame::OnTurbo(wxCommandEvent& e) {
+    m_panel->SetTurbo(e.IsChecked());
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    app->settings.turbo = e.IsChecked();
+    app->SettingsChanged();
+    UpdateStatus();
+}
+
+void MainFrame::OnPauseOnCycle(wxCommandEvent& e) {
+    bool on = e.IsChecked();
+    m_panel->SetPauseOnCycle(on);
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    app->settings.pauseOnCycle = on;
+    app->SettingsChanged();
+}
+
 void MainFrame::OnNext(wxCommandEvent&) {
     if (!m_running) {
         m_panel->NextGeneration();
@@ -550,8 +1695,62 @@ void MainFrame::OnNext(wxCommandEvent&) {
     }
 }
 
+void MainFrame::OnStepBack(wxCommandEvent&) {
+    if (!m_running) {
+        if (!m_panel->StepBack()) wxBell(); // at the start of the history
+        UpdateStatus();
+    }
+}
+
+void MainFrame::OnRewind(wxCommandEvent&) {
+    if (!m_panel->HasHistory()) {
+        wxMessageBox("There is no history to rewind: it is off, the board is unbounded, or the rule has more than two states or a wider neighborhood.",
+            "Rewind", wxICON_INFORMATION|wxOK, this);
+        return;
+    }
+    uint64_t oldest = m_panel->OldestGeneration(), current = m_panel->GetGeneration();
+    wxString text = wxGetTextFromUser(wxString::Format("Generation to go back to (%llu to %llu):",
+        (unsigned long long)oldest, (unsigned long long)current), "Rewind To Generation",
+        wxString::Format("%llu", (unsigned long long)oldest), this);
+    if (text.empty()) return; // cancelled
+    unsigned long long target;
+    if (!text.ToULongLong(&target) || !m_panel->RewindTo(target)) {
+        wxMessageBox("That generation is not in the history.", "Rewind", wxICON_ERROR|wxOK, this);
+        return;
+    }
+    UpdateStatus();
+}
+
+// A fresh seed for every Randomize; the last one is offered again by
+// Randomize With so a soup worth keeping can be brought back.
+static uint64_t NewSoupSeed() {
+    static uint64_t counter = (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+    return ++counter * 0x9E3779B97F4A7C15ULL >> 16;
+}
+
 void MainFrame::OnRandomize(wxCommandEvent&) {
-    m_panel->Randomize(30);
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    m_panel->Randomize(app->settings.randomPercent / 100, NewSoupSeed());
+    UpdateStatus();
+}
+
+void MainFrame::OnRandomizeWith(wxCommandEvent&) {
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    wxString text = wxGetTextFromUser("Density in percent, then the seed. The same seed at the same\n"
+        "density and board size always gives the same soup.",
+        "Randomize With", wxString::Format("%g %llu", app->settings.randomPercent,
+        (unsigned long long)m_panel->GetSoupSeed()), this);
+    if (text.empty()) return; // cancelled
+    double percent;
+    unsigned long long seed;
+    if (std::sscanf(text.c_str(), "%lf %llu", &percent, &seed) != 2 || percent < 0 || percent > 100) {
+        wxMessageBox("Give a density from 0 to 100 and a seed, e.g. 30 12345.", "Randomize With",
+            wxICON_ERROR|wxOK, this);
+        return;
+    }
+    m_panel->Randomize(percent / 100, seed);
+    app->settings.randomPercent = percent;
+    app->SettingsChanged();
     UpdateStatus();
 }
 
@@ -560,7 +1759,7 @@ void MainFrame::OnToggleGrid(wxCommandEvent& e) {
     m_panel->SetShowGrid(show);
     LifeApp* app = (LifeApp*)wxApp::GetInstance();
     app->settings.showGrid = show;
-    app->settings.Save();
+    app->SettingsChanged();
     UpdateStatus();
 }
 
@@ -569,10 +1768,36 @@ void MainFrame::OnToggleHUD(wxCommandEvent& e) {
     m_panel->SetShowHUD(show);
     LifeApp* app = (LifeApp*)wxApp::GetInstance();
     app->settings.showHUD = show;
-    app->settings.Save();
+    app->SettingsChanged();
+    UpdateStatus();
+}
+
+void MainFrame::OnZoomIn(wxCommandEvent&) {
+    m_panel->Zoom(1);
+    UpdateStatus();
+}
+
+void MainFrame::OnZoomOut(wxCommandEvent&) {
+    m_panel->Zoom(-1);
+    UpdateStatus();
+}
+
+void MainFrame::OnFitView(wxCommandEvent&) {
+    m_panel->FitView();
     UpdateStatus();
 }
 
+void MainFrame::OnSavePerfTrace(wxCommandEvent&) {
+    long seconds = wxGetNumberFromUser("Steps, frame copies, paints and status updates of the last few seconds\n"
+        "are written as Chrome trace events (chrome://tracing or ui.perfetto.dev).",
+        "Seconds:", "Save Performance Trace", 10, 1, 3600, this);
+    if (seconds<0) return; // cancelled
+    wxFileDialog dlg(this, "Save Performance Trace", "", "trace.json",
+        "Chrome trace (*.json)|*.json", wxFD_SAVE|wxFD_OVERWRITE_PROMPT);
+    if (dlg.ShowModal()==wxID_OK && !m_panel->SavePerfTrace(dlg.GetPath(), (double)seconds))
+        wxMessageBox("Failed to save file.", "Error", wxICON_ERROR|wxOK, this);
+}
+
 void MainFrame::OnChooseColors(wxCommandEvent&) {
     // Grid
     {
@@ -587,8 +1812,9 @@ void MainFrame::OnChooseColors(wxCommandEvent&) {
             wxColour c = dlg.GetColourData().GetColour();
             LifeApp* app = (LifeApp*)wxApp::GetInstance();
             app->settings.gridColor = c;
-            app->settings.Save();
+            app->SettingsChanged();
             m_panel->SetColors(app->settings.gridColor, app->settings.bgColor, app->settings.aliveColor);
+            m_browser->SetColors(app->settings.bgColor, app->settings.aliveColor);
         }
     }
     // Background
@@ -602,8 +1828,9 @@ void MainFrame::OnChooseColors(wxCommandEvent&) {
             wxColour c = dlg.GetColourData().GetColour();
             LifeApp* app = (LifeApp*)wxApp::GetInstance();
             app->settings.bgColor = c;
-            app->settings.Save();
+            app->SettingsChanged();
             m_panel->SetColors(app->settings.gridColor, app->settings.bgColor, app->settings.aliveColor);
+            m_browser->SetColors(app->settings.bgColor, app->settings.aliveColor);
         }
     }
     // Alive
@@ -617,8 +1844,9 @@ void MainFrame::OnChooseColors(wxCommandEvent&) {
             wxColour c = dlg.GetColourData().GetColour();
             LifeApp* app = (LifeApp*)wxApp::GetInstance();
             app->settings.aliveColor = c;
-            app->settings.Save();
+            app->SettingsChanged();
             m_panel->SetColors(app->settings.gridColor, app->settings.bgColor, app->settings.aliveColor);
+            m_browser->SetColors(app->settings.bgColor, app->settings.aliveColor);
         }
     }
 }
@@ -631,7 +1859,10 @@ void MainFrame::OnChooseSize(wxCommandEvent&) {
     wxStaticText* hlbl = new wxStaticText(&dlg, wxID_ANY, "Height:");
     wxSpinCtrl* wspin = new wxSpinCtrl(&dlg, wxID_ANY);
     wxSpinCtrl* hspin = new wxSpinCtrl(&dlg, wxID_ANY);
-    wspin->SetRange(5, 500); hspin->SetRange(5, 500);
+    // HashLife and the sparse engine only keep live regions in memory, so
+    // they can show a much larger board than the packed engine can hold
+    int maxSide = m_panel->IsUnbounded() ? kMaxUnboundedSide : kMaxPackedSide;
+    wspin->SetRange(5, maxSide); hspin->SetRange(5, maxSide);
     wspin->SetValue(m_panel->GetWidth());
     hspin->SetValue(m_panel->GetHeight());
     rowsz->Add(wlbl, 0, wxALIGN_CENTER|wxRIGHT, 8);
@@ -648,65 +1879,355 @@ void MainFrame::OnChooseSize(wxCommandEvent&) {
         LifeApp* app = (LifeApp*)wxApp::GetInstance();
         app->settings.width = w;
         app->settings.height = h;
-        app->settings.Save();
+        app->SettingsChanged();
         UpdateStatus();
     }
 }
 
-void MainFrame::OnBoundaryFinite(wxCommandEvent&) {
-    m_panel->SetBoundary("Finite");
+void MainFrame::OnChooseRule(wxCommandEvent&) {
     LifeApp* app = (LifeApp*)wxApp::GetInstance();
-    app->settings.boundary = "Finite";
-    app->settings.Save();
+    wxString text = wxGetTextFromUser("Rule in B/S notation: the neighbor counts a dead cell is born with, then\n"
+        "the ones a live cell survives with, e.g. B3/S23 (Conway) or B36/S23 (HighLife).\n"
+        "Add /C<states> for a Generations rule, e.g. B2/S/C3 (Brian's Brain), or give a\n"
+        "Larger than Life rule, e.g. R5,C0,M1,S34..58,B34..45,NM (Bosco's Rule).",
+        "Rule", m_panel->GetRuleLabel(), this);
+    if (text.empty()) return; // cancelled
+    LifeRule rule;
+    if (!LifeRule::Parse(text.ToStdString(), rule)) {
+        wxMessageBox("That is not a rule in B/S, Generations or Larger than Life notation.", "Rule",
+            wxICON_ERROR|wxOK, this);
+        return;
+    }
+    if (!m_panel->SetRule(rule)) {
+        wxMessageBox(rule.BirthOnZero()
+            ? "Rules with B0 bring empty space to life, so they need a finite or toroidal board."
+            : "Generations and Larger than Life rules need a finite or toroidal board.",
+            "Rule", wxICON_ERROR|wxOK, this);
+        return;
+    }
+    app->settings.rule = rule.ToString();
+    app->SettingsChanged();
     UpdateStatus();
 }
 
-void MainFrame::OnBoundaryToroidal(wxCommandEvent&) {
-    m_panel->SetBoundary("Toroidal");
+// Switching to an unbounded board or loading a file can change the rule.
+void MainFrame::SyncRuleSetting() {
     LifeApp* app = (LifeApp*)wxApp::GetInstance();
-    app->settings.boundary = "Toroidal";
-    app->settings.Save();
+    if (app->settings.rule == m_panel->GetRuleLabel()) return;
+    app->settings.rule = m_panel->GetRuleLabel();
+    app->SettingsChanged();
+}
+
+void MainFrame::OnBoundaryFinite(wxCommandEvent&) { ChooseBoundary(Boundary::Finite); }
+void MainFrame::OnBoundaryToroidal(wxCommandEvent&) { ChooseBoundary(Boundary::Toroidal); }
+void MainFrame::OnBoundaryKleinBottle(wxCommandEvent&) { ChooseBoundary(Boundary::KleinBottle); }
+void MainFrame::OnBoundaryMirror(wxCommandEvent&) { ChooseBoundary(Boundary::Mirror); }
+void MainFrame::OnBoundaryInfinite(wxCommandEvent&) { ChooseBoundary(Boundary::Infinite); }
+
+// Switching to an infinite board can change the rule.
+void MainFrame::ChooseBoundary(Boundary b) {
+    m_panel->SetBoundary(b);
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    app->settings.boundary = b;
+    app->SettingsChanged();
+    if (b == Boundary::Infinite) SyncRuleSetting();
     UpdateStatus();
 }
 
+void MainFrame::OnChooseThreads(wxCommandEvent&) {
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    long n = wxGetNumberFromUser("Number of threads used to compute each generation.\n0 = one per CPU core.",
+        "Threads:", "Stepping Threads", app->settings.threads, 0, 256, this);
+    if (n<0) return; // cancelled
+    app->settings.threads = (int)n;
+    app->SettingsChanged();
+    m_panel->SetThreadCount(app->settings.threads);
+    UpdateStatus();
+}
+
+void MainFrame::OnEnginePacked(wxCommandEvent&) {
+    m_panel->SetHashLife(false);
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    app->settings.engine = "Packed";
+    app->SettingsChanged();
+    UpdateStatus();
+}
+
+void MainFrame::OnEngineHashLife(wxCommandEvent&) {
+    m_panel->SetHashLife(true);
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    app->settings.engine = "HashLife";
+    app->SettingsChanged();
+    SyncRuleSetting();
+    UpdateStatus();
+}
+
+void MainFrame::OnChooseHashLifeStep(wxCommandEvent&) {
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    long k = wxGetNumberFromUser("Each HashLife step advances 2^k generations.",
+        "k:", "HashLife Step Size", app->settings.hashlifeStep, 0, HashLifeUniverse::kMaxStepExponent, this);
+    if (k<0) return; // cancelled
+    app->settings.hashlifeStep = (int)k;
+    app->SettingsChanged();
+    m_panel->SetHashLifeStep(app->settings.hashlifeStep);
+    UpdateStatus();
+}
+
+void MainFrame::OnChooseHashLifeMemory(wxCommandEvent&) {
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    long mb = wxGetNumberFromUser("Memory HashLife may use for its node cache before collecting garbage.",
+        "Megabytes:", "HashLife Memory Limit", app->settings.hashlifeMemoryMB, 16, 65536, this);
+    if (mb<0) return; // cancelled
+    app->settings.hashlifeMemoryMB = (int)mb;
+    app->SettingsChanged();
+    m_panel->SetHashLifeMemory(app->settings.hashlifeMemoryMB);
+}
+
+void MainFrame::OnChooseHistoryMemory(wxCommandEvent&) {
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    long mb = wxGetNumberFromUser("Memory kept for stepping back through past generations.\n"
+        "0 turns history off. Changing it clears the history.",
+        "Megabytes:", "History Memory Limit", app->settings.historyMemoryMB, 0, 65536, this);
+    if (mb<0) return; // cancelled
+    app->settings.historyMemoryMB = (int)mb;
+    app->SettingsChanged();
+    m_panel->SetHistoryMemory(app->settings.historyMemoryMB);
+    UpdateStatus();
+}
+
+// Files that haven't changed since the last run come from the library's
+// cache, so this stays quick however many patterns the folder holds.
+void MainFrame::OpenPatternLibrary() {
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    wxString folder = app->settings.PatternFolderPath();
+    if (!m_library.Open(folder.ToStdString(), app->settings.PatternCachePath().ToStdString()))
+        wxMessageBox("Can't read the pattern folder " + folder, "Patterns", wxICON_ERROR|wxOK, this);
+    m_browser->SetColors(app->settings.bgColor, app->settings.aliveColor);
+    m_browser->SetLibrary(&m_library);
+    SelectPattern(-1);
+}
+
+void MainFrame::SelectPattern(int index) {
+    m_pattern = index;
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    PasteMode mode = app->settings.stampXor ? PasteMode::Xor : PasteMode::Or;
+    m_panel->SetStamp(index >= 0 ? &m_library.At(index).cells : nullptr, mode);
+}
+
+void MainFrame::StampPattern() {
+    if (m_pattern < 0) return;
+    m_panel->StampInMiddle();
+    UpdateStatus();
+}
+
+void MainFrame::OnShowPatterns(wxCommandEvent& e) {
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    app->settings.showPatterns = e.IsChecked();
+    app->SettingsChanged();
+    m_browser->Show(app->settings.showPatterns);
+    Layout();
+}
+
+void MainFrame::OnStampPattern(wxCommandEvent&) {
+    if (m_pattern < 0) {
+        wxMessageBox("Choose a pattern in the library first (Patterns > Show Library).", "Patterns", wxICON_INFORMATION|wxOK, this);
+        return;
+    }
+    StampPattern();
+}
+
+void MainFrame::OnStampXor(wxCommandEvent& e) {
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    app->settings.stampXor = e.IsChecked();
+    app->SettingsChanged();
+    SelectPattern(m_pattern);
+}
+
+void MainFrame::OnChoosePatternFolder(wxCommandEvent&) {
+    LifeApp* app = (LifeApp*)wxApp::GetInstance();
+    wxDirDialog dlg(this, "Pattern Library Folder", app->settings.PatternFolderPath(), wxDD_DIR_MUST_EXIST);
+    if (dlg.ShowModal() != wxID_OK) return;
+    app->settings.patternFolder = dlg.GetPath();
+    app->SettingsChanged();
+    OpenPatternLibrary();
+}
+
+void MainFrame::OnReindexPatterns(wxCommandEvent&) {
+    OpenPatternLibrary();
+}
+
 void MainFrame::OnResetSettings(wxCommandEvent&) {
     LifeApp* app = (LifeApp*)wxApp::GetInstance();
     app->settings.Reset();
+    app->SettingsChanged();
     // apply
     m_panel->ResizeUniverse(app->settings.width, app->settings.height);
     m_panel->SetColors(app->settings.gridColor, app->settings.bgColor, app->settings.aliveColor);
     m_panel->SetShowGrid(app->settings.showGrid);
     m_panel->SetShowHUD(app->settings.showHUD);
     m_panel->SetBoundary(app->settings.boundary);
+    m_panel->SetThreadCount(app->settings.threads);
+    m_panel->SetHashLife(app->settings.engine == "HashLife");
+    m_panel->SetRule(LifeRule());
+    m_panel->SetHashLifeStep(app->settings.hashlifeStep);
+    m_panel->SetHashLifeMemory(app->settings.hashlifeMemoryMB);
+    m_panel->SetHistoryMemory(app->settings.historyMemoryMB);
+    m_panel->SetPauseOnCycle(app->settings.pauseOnCycle);
+    m_panel->SetSimulationInterval(SimulationInterval());
+    m_panel->SetTurbo(app->settings.turbo);
     GetMenuBar()->Check(ID_VIEW_GRID, app->settings.showGrid);
     GetMenuBar()->Check(ID_VIEW_HUD, app->settings.showHUD);
-    if (app->settings.boundary == "Finite")
-        GetMenuBar()->Check(ID_OPTIONS_BOUNDARY_FINITE, true);
-    else
-        GetMenuBar()->Check(ID_OPTIONS_BOUNDARY_TOROIDAL, true);
+    GetMenuBar()->Check(ID_MAX_SPEED, app->settings.maxSpeed);
+    GetMenuBar()->Check(ID_TURBO, app->settings.turbo);
+    GetMenuBar()->Check(ID_PAUSE_ON_CYCLE, app->settings.pauseOnCycle);
+    GetMenuBar()->Check(ID_PATTERNS_SHOW, app->settings.showPatterns);
+    GetMenuBar()->Check(ID_PATTERNS_XOR, app->settings.stampXor);
+    GetMenuBar()->Check(BoundaryMenuId(app->settings.boundary), true);
+    GetMenuBar()->Check(app->settings.engine == "HashLife" ? ID_OPTIONS_ENGINE_HASHLIFE : ID_OPTIONS_ENGINE_PACKED, true);
+    m_browser->Show(app->settings.showPatterns);
+    Layout();
+    OpenPatternLibrary();
     UpdateStatus();
 }
 
+// The simulation runs on its own thread; the timer only picks up the
+// newest finished generation at display rate. With Pause on Cycle the
+// thread stops stepping by itself once the board repeats, and waits here to
+// be paused properly.
 void MainFrame::OnTimer(wxTimerEvent&) {
-    m_panel->NextGeneration();
-    UpdateStatus();
+    // frames come at up to the timer's rate, the status text at most every
+    // kTextIntervalMs
+    if (m_panel->PresentFrame()) {
+        PerfTrace::Clock::time_point now = PerfTrace::Clock::now();
+        if (now - m_statusTime >= std::chrono::milliseconds(kTextIntervalMs)) UpdateStatus();
+    }
+    if (m_running && m_panel->IsHeldOnCycle()) {
+        wxCommandEvent e;
+        OnPause(e);
+    }
 }
 
+// A field is only handed to wx when its text changed.
 void MainFrame::UpdateStatus() {
-    wxString state = m_running ? "Running" : "Paused";
-    wxString left = wxString::Format("Gen: %ld  Alive: %d  Size: %dx%d",
-        m_panel->GetGeneration(),
-        m_panel->AliveCount(),
+    PerfScope scope(&m_panel->GetPerfTrace(), PerfPhase::Status);
+    m_statusTime = PerfTrace::Clock::now();
+    Label left, state;
+    left.Add("Gen: %llu  Alive: %llu  Size: %dx%d  Rule: %s  Zoom: ",
+        (unsigned long long)m_panel->GetGeneration(),
+        (unsigned long long)m_panel->AliveCount(),
         m_panel->GetWidth(),
-        m_panel->GetHeight());
-    SetStatusText(left, 0);
-    SetStatusText(state, 1);
+        m_panel->GetHeight(),
+        m_panel->GetRuleLabel().c_str());
+    m_panel->AddZoomLabel(left);
+    state.Add(m_running ? "Running" : "Paused");
+    if (m_panel->IsTurbo()) state.Add(" (turbo)");
+    if (m_running) state.Add("  %.0f gen/s", m_panel->GetGenerationRate());
+    if (m_panel->IsHashLife()) {
+        EngineStats st = m_panel->GetEngineStats();
+        double hitRate = st.cacheLookups ? 100.0*st.cacheHits/st.cacheLookups : 0.0;
+        state.Add("  HashLife 2^%d  %.1f MB  %.1f%% hits",
+            m_panel->GetHashLifeStep(), st.memoryBytes/1048576.0, hitRate);
+    } else if (m_panel->IsSparse()) {
+        EngineStats st = m_panel->GetEngineStats();
+        state.Add("  Sparse: %llu tiles  %.1f MB", (unsigned long long)st.nodes, st.memoryBytes/1048576.0);
+    } else {
+        state.Add("  Threads: %d", m_panel->GetThreadCount());
+    }
+    uint64_t period, start;
+    if (m_panel->GetCycle(period, start)) AddCycleLabel(state, period, start);
+    // the simulation thread owns the history while it runs
+    if (!m_running && m_panel->HasHistory()) {
+        state.Add("  History: from gen %llu, %.1f MB",
+            (unsigned long long)m_panel->OldestGeneration(), m_panel->HistoryMemory()/1048576.0);
+    }
+    if (left != m_statusLeft) SetStatusText(left.c_str(), 0);
+    if (state != m_statusState) SetStatusText(state.c_str(), 1);
+    m_statusLeft = left;
+    m_statusState = state;
+}
+
+// ---------------- SettingsWriter Impl ----------------
+SettingsWriter::~SettingsWriter() {
+    Flush();
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_one();
+        m_thread.join();
+    }
+}
+
+void SettingsWriter::Write(const wxString& path, const std::string& text) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_path = path;
+        m_text = text;
+        m_due = Clock::now() + std::chrono::milliseconds(kDelayMs);
+        m_pending = true;
+    }
+    // started with the first change, most runs never change anything
+    if (!m_thread.joinable()) m_thread = std::thread(&SettingsWriter::Loop, this);
+    m_wake.notify_one();
+}
+
+void SettingsWriter::Flush() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_pending && !m_writing) return;
+    m_flush = true;
+    m_wake.notify_one();
+    m_done.wait(lock, [this]{ return !m_pending && !m_writing; });
+    m_flush = false;
+}
+
+void SettingsWriter::Loop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait(lock, [this]{ return m_pending || m_stop; });
+        if (!m_pending) return; // stopping with nothing left to write
+        // a newer change moves the deadline on
+        while (m_pending && !m_flush && !m_stop && Clock::now() < m_due)
+            m_wake.wait_until(lock, m_due);
+        wxString path = m_path;
+        std::string text = m_text;
+        m_pending = false;
+        m_writing = true;
+        lock.unlock();
+        WriteFile(path, text);
+        lock.lock();
+        m_writing = false;
+        if (!m_pending) m_done.notify_all();
+    }
+}
+
+bool SettingsWriter::WriteFile(const wxString& path, const std::string& text) {
+    wxString tmp = path + ".tmp";
+    std::FILE* f = wxFopen(tmp, "w");
+    if (!f) return false;
+    bool ok = std::fwrite(text.data(), 1, text.size(), f) == text.size();
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok || !wxRenameFile(tmp, path, true)) {
+        wxRemoveFile(tmp);
+        return false;
+    }
+    return true;
 }
 
 // ---------------- LifeApp Impl ----------------
+void LifeApp::SettingsChanged() {
+    m_settingsWriter.Write(m_settingsPath, settings.Serialize().ToStdString());
+}
+
 bool LifeApp::OnInit() {
+    m_settingsPath = settings.SettingsPath();
     settings.Load();
     MainFrame* frame = new MainFrame();
     frame->Show(true);
     return true;
 }
+
+int LifeApp::OnExit() {
+    m_settingsWriter.Flush(); // the last changes may still be waiting
+    return wxApp::OnExit();
+}